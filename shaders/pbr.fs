@@ -25,15 +25,19 @@ layout(std140, binding=1) uniform ShadingData
 {
 	LightSource lights[LIGHT_COUNT];
 	vec3 viewerPos;
+	vec4 irradianceSH[9];  // Pre-scaled order-2 SH irradiance coefficients (IRRADIANCE_SH only).
 };
 
 layout(binding=0) uniform sampler2D albedoTex;
 layout(binding=1) uniform sampler2D normalMapTex;
-layout(binding=2) uniform sampler2D metalnessTex;
-layout(binding=3) uniform sampler2D roughnessTex;
+layout(binding=2) uniform sampler2D occlusionRoughnessMetalnessTex;
 layout(binding=4) uniform samplerCube specReflectionTex;
+#ifndef IRRADIANCE_SH
 layout(binding=5) uniform samplerCube diffuseIrradianceTex;
+#endif
+#ifndef BRDF_ANALYTIC
 layout(binding=6) uniform sampler2D specularBRDF_LUT_Tex;
+#endif
 
 // GGX/Towbridge-Reitz normal distribution function.
 float calcNDF(float cosHalfway, float surfaceRoughness)
@@ -60,13 +64,51 @@ vec3 calcFresnelSchlick(vec3 F0, float cosTheta)
 	return F0 + (vec3(1.0) - F0) * pow(1.0 - cosTheta, 5.0);
 }
 
+#ifdef IRRADIANCE_SH
+// Diffuse irradiance (divided by pi) reconstructed from 9 spherical harmonics coefficients.
+vec3 calcIrradianceSH(vec3 n)
+{
+	vec3 result = irradianceSH[0].rgb
+		+ irradianceSH[1].rgb * n.y
+		+ irradianceSH[2].rgb * n.z
+		+ irradianceSH[3].rgb * n.x
+		+ irradianceSH[4].rgb * (n.x * n.y)
+		+ irradianceSH[5].rgb * (n.y * n.z)
+		+ irradianceSH[6].rgb * (3.0 * n.z * n.z - 1.0)
+		+ irradianceSH[7].rgb * (n.x * n.z)
+		+ irradianceSH[8].rgb * (n.x * n.x - n.y * n.y);
+	return max(result, vec3(0.0));
+}
+#endif
+
+#ifdef BRDF_ANALYTIC
+// Polynomial fit of the split-sum (scale, bias) DFG terms [Karis 2014, "Physically Based Shading on Mobile"].
+vec2 calcSpecularBRDFAnalytic(float cosOutgoing, float surfaceRoughness)
+{
+	const vec4 c0 = vec4(-1.0, -0.0275, -0.572, 0.022);
+	const vec4 c1 = vec4(1.0, 0.0425, 1.04, -0.04);
+	vec4 r = surfaceRoughness * c0 + c1;
+	float a004 = min(r.x * r.x, exp2(-9.28 * cosOutgoing)) * r.x + r.y;
+	return vec2(-1.04, 1.04) * a004 + r.zw;
+}
+#endif
+
 void main()
 {
 	vec3 surfaceAlbedo = texture(albedoTex, fragIn.uvCoords).rgb;
-	float metalVal = texture(metalnessTex, fragIn.uvCoords).r;
-	float surfaceRoughness = texture(roughnessTex, fragIn.uvCoords).r;
+	vec3 occlusionRoughnessMetalness = texture(occlusionRoughnessMetalnessTex, fragIn.uvCoords).rgb;
+	float ambientOcclusion = occlusionRoughnessMetalness.r;
+	float surfaceRoughness = occlusionRoughnessMetalness.g;
+	float metalVal = occlusionRoughnessMetalness.b;
 	vec3 outgoingDir = normalize(viewerPos - fragIn.worldPos);
+#ifdef NORMAL_MAP_RG
+	// Two-channel (BC5) normal map: z is reconstructed from the unit length of the tangent-space normal.
+	vec3 fragmentNormal;
+	fragmentNormal.xy = 2.0 * texture(normalMapTex, fragIn.uvCoords).rg - 1.0;
+	fragmentNormal.z = sqrt(max(0.0, 1.0 - dot(fragmentNormal.xy, fragmentNormal.xy)));
+#else
 	vec3 fragmentNormal = normalize(2.0 * texture(normalMapTex, fragIn.uvCoords).rgb - 1.0);
+#endif
 	fragmentNormal = normalize(fragIn.tangentSpaceMat * fragmentNormal);
 	float cosOutgoing = max(0.0, dot(fragmentNormal, outgoingDir));
 	vec3 reflectedDir = 2.0 * cosOutgoing * fragmentNormal - outgoingDir;
@@ -91,15 +133,23 @@ void main()
 	
 	vec3 ambientResult;
 	{
+#ifdef IRRADIANCE_SH
+		vec3 diffuseIrradiance = calcIrradianceSH(fragmentNormal);
+#else
 		vec3 diffuseIrradiance = texture(diffuseIrradianceTex, fragmentNormal).rgb;
+#endif
 		vec3 fresnel = calcFresnelSchlick(F0, cosOutgoing);
 		vec3 diffuseFactor = mix(vec3(1.0) - fresnel, vec3(0.0), metalVal);
 		vec3 diffuseIBL = diffuseFactor * surfaceAlbedo * diffuseIrradiance;
 		int reflectionTexLevels = textureQueryLevels(specReflectionTex);
 		vec3 specIrradiance = textureLod(specReflectionTex, reflectedDir, surfaceRoughness * reflectionTexLevels).rgb;
+#ifdef BRDF_ANALYTIC
+		vec2 specularBRDF = calcSpecularBRDFAnalytic(cosOutgoing, surfaceRoughness);
+#else
 		vec2 specularBRDF = texture(specularBRDF_LUT_Tex, vec2(cosOutgoing, surfaceRoughness)).rg;
+#endif
 		vec3 specularIBL = (F0 * specularBRDF.x + specularBRDF.y) * specIrradiance;
-		ambientResult = diffuseIBL + specularIBL;
+		ambientResult = (diffuseIBL + specularIBL) * ambientOcclusion;
 	}
 	
 	finalColor = vec4(directLightResult + ambientResult, 1.0);
@@ -1,11 +1,18 @@
 #version 450 core
 
 // Input attributes
+#ifdef PACKED_VERTICES
+// Mesh::PackedVertex: position normalized to the mesh bounds, tangent frame as a QTangent, half-float UVs
+layout(location=0) in vec3 vertexPos;
+layout(location=1) in vec4 vertexQTangent;
+layout(location=2) in vec2 vertexUV;
+#else
 layout(location=0) in vec3 vertexPos;
 layout(location=1) in vec3 vertexNormal;
 layout(location=2) in vec3 vertexTangent;
 layout(location=3) in vec3 vertexBitangent;
 layout(location=4) in vec2 vertexUV;
+#endif
 
 // Uniform block for transformation matrices
 layout(std140, binding=0) uniform TransformationBlock
@@ -13,6 +20,8 @@ layout(std140, binding=0) uniform TransformationBlock
 	mat4 viewProjMatrix;      // View projection matrix
 	mat4 skyboxProjMatrix;    // Skybox projection matrix
 	mat4 rotationMatrix;      // Scene rotation matrix
+	vec4 positionScale;       // Packed position dequantization: scale and offset of the mesh bounds
+	vec4 positionOffset;
 };
 
 // Output structure for the fragment shader
@@ -23,17 +32,40 @@ layout(location=0) out FragmentInput
 	mat3 tangentSpaceMat;   // Tangent space transformation matrix
 } fragInput;
 
+#ifdef PACKED_VERTICES
+// Rotates v by the unit quaternion q
+vec3 rotate(vec4 q, vec3 v)
+{
+	return v + 2.0 * cross(q.xyz, cross(q.xyz, v) + q.w * v);
+}
+#endif
+
 void main()
 {
+#ifdef PACKED_VERTICES
+	vec3 position = vertexPos * positionScale.xyz + positionOffset.xyz;
+
+	// The QTangent rotates the x and z axes onto the tangent and normal; a negative w mirrors the bitangent
+	vec4 qtangent = normalize(vertexQTangent);
+	vec3 tangent = rotate(qtangent, vec3(1.0, 0.0, 0.0));
+	vec3 normal = rotate(qtangent, vec3(0.0, 0.0, 1.0));
+	vec3 bitangent = cross(normal, tangent) * (qtangent.w < 0.0 ? -1.0 : 1.0);
+#else
+	vec3 position = vertexPos;
+	vec3 tangent = vertexTangent;
+	vec3 normal = vertexNormal;
+	vec3 bitangent = vertexBitangent;
+#endif
+
 	// Transform the vertex position using the scene's rotation matrix
-	fragInput.worldPos = vec3(rotationMatrix * vec4(vertexPos, 1.0));
+	fragInput.worldPos = vec3(rotationMatrix * vec4(position, 1.0));
 	
 	// Adjust texture coordinates for the fragment
 	fragInput.uvCoords = vec2(vertexUV.x, 1.0 - vertexUV.y);
 	
 	// Compute and pass the tangent space matrix for normal mapping
-	fragInput.tangentSpaceMat = mat3(rotationMatrix) * mat3(vertexTangent, vertexBitangent, vertexNormal);
+	fragInput.tangentSpaceMat = mat3(rotationMatrix) * mat3(tangent, bitangent, normal);
 
 	// Compute the final clip-space position of the vertex
-	gl_Position = viewProjMatrix * rotationMatrix * vec4(vertexPos, 1.0);
+	gl_Position = viewProjMatrix * rotationMatrix * vec4(position, 1.0);
 }
\ No newline at end of file
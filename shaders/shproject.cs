@@ -0,0 +1,73 @@
+#version 450 core
+
+// Projects one mip level of the environment map onto the order-2 spherical harmonics basis.
+// Every workgroup reduces its 8x8 texels in shared memory and writes 9 partial sums (see shreduce.cs).
+
+const uint SH_COEFFICIENT_COUNT = 9;
+const uint GROUP_SIZE = 64;
+
+layout(binding=0) uniform samplerCube envMap;
+layout(std430, binding=0) restrict writeonly buffer PartialSums
+{
+	vec4 partialSums[];
+};
+
+layout(location=0) uniform int sourceLevel;
+
+shared vec3 groupSums[GROUP_SIZE][SH_COEFFICIENT_COUNT];
+
+// Direction through the centre of the current texel, using the face layout of the other bake shaders.
+vec3 getSamplingVector(vec2 st)
+{
+	vec2 uv = 2.0 * vec2(st.x, 1.0 - st.y) - vec2(1.0);
+
+	vec3 ret;
+	if(gl_GlobalInvocationID.z == 0)      ret = vec3(1.0,  uv.y, -uv.x);
+	else if(gl_GlobalInvocationID.z == 1) ret = vec3(-1.0, uv.y,  uv.x);
+	else if(gl_GlobalInvocationID.z == 2) ret = vec3(uv.x, 1.0, -uv.y);
+	else if(gl_GlobalInvocationID.z == 3) ret = vec3(uv.x, -1.0, uv.y);
+	else if(gl_GlobalInvocationID.z == 4) ret = vec3(uv.x, uv.y, 1.0);
+	else if(gl_GlobalInvocationID.z == 5) ret = vec3(-uv.x, uv.y, -1.0);
+	return normalize(ret);
+}
+
+layout(local_size_x=8, local_size_y=8, local_size_z=1) in;
+void main(void)
+{
+	float size = float(textureSize(envMap, sourceLevel).x);
+	vec2 st = (vec2(gl_GlobalInvocationID.xy) + 0.5) / size;
+
+	// Solid angle subtended by the texel on the unit sphere.
+	vec2 uv = 2.0 * st - vec2(1.0);
+	float d = 1.0 + dot(uv, uv);
+	float solidAngle = 4.0 / (size * size * d * sqrt(d));
+
+	vec3 n = getSamplingVector(st);
+	vec3 radiance = textureLod(envMap, n, sourceLevel).rgb * solidAngle;
+
+	uint index = gl_LocalInvocationIndex;
+	groupSums[index][0] = radiance;
+	groupSums[index][1] = radiance * n.y;
+	groupSums[index][2] = radiance * n.z;
+	groupSums[index][3] = radiance * n.x;
+	groupSums[index][4] = radiance * (n.x * n.y);
+	groupSums[index][5] = radiance * (n.y * n.z);
+	groupSums[index][6] = radiance * (3.0 * n.z * n.z - 1.0);
+	groupSums[index][7] = radiance * (n.x * n.z);
+	groupSums[index][8] = radiance * (n.x * n.x - n.y * n.y);
+	barrier();
+
+	for(uint stride = GROUP_SIZE / 2; stride > 0; stride /= 2) {
+		if(index < stride) {
+			for(uint k=0; k<SH_COEFFICIENT_COUNT; ++k) {
+				groupSums[index][k] += groupSums[index + stride][k];
+			}
+		}
+		barrier();
+	}
+
+	if(index < SH_COEFFICIENT_COUNT) {
+		uint group = gl_WorkGroupID.x + gl_NumWorkGroups.x * (gl_WorkGroupID.y + gl_NumWorkGroups.y * gl_WorkGroupID.z);
+		partialSums[group * SH_COEFFICIENT_COUNT + index] = vec4(groupSums[0][index], 0.0);
+	}
+}
@@ -0,0 +1,62 @@
+#version 450 core
+
+// Sums the per-workgroup partial results of shproject.cs into the final 9 irradiance coefficients.
+// Coefficients are scaled by the clamped cosine lobe (divided by pi) and the squared SH normalization,
+// so pbr.fs evaluates irradiance as a plain polynomial in the normal.
+
+const uint SH_COEFFICIENT_COUNT = 9;
+const uint GROUP_SIZE = 64;
+
+const float SH_SCALE[SH_COEFFICIENT_COUNT] = float[](
+	1.0       * 0.282095 * 0.282095,
+	2.0 / 3.0 * 0.488603 * 0.488603,
+	2.0 / 3.0 * 0.488603 * 0.488603,
+	2.0 / 3.0 * 0.488603 * 0.488603,
+	0.25      * 1.092548 * 1.092548,
+	0.25      * 1.092548 * 1.092548,
+	0.25      * 0.315392 * 0.315392,
+	0.25      * 1.092548 * 1.092548,
+	0.25      * 0.546274 * 0.546274
+);
+
+layout(std430, binding=0) restrict readonly buffer PartialSums
+{
+	vec4 partialSums[];
+};
+layout(std430, binding=1) restrict writeonly buffer Coefficients
+{
+	vec4 coefficients[SH_COEFFICIENT_COUNT];
+};
+
+layout(location=0) uniform uint partialCount;
+
+shared vec3 groupSums[GROUP_SIZE][SH_COEFFICIENT_COUNT];
+
+layout(local_size_x=64, local_size_y=1, local_size_z=1) in;
+void main(void)
+{
+	uint index = gl_LocalInvocationIndex;
+
+	for(uint k=0; k<SH_COEFFICIENT_COUNT; ++k) {
+		groupSums[index][k] = vec3(0.0);
+	}
+	for(uint partial = index; partial < partialCount; partial += GROUP_SIZE) {
+		for(uint k=0; k<SH_COEFFICIENT_COUNT; ++k) {
+			groupSums[index][k] += partialSums[partial * SH_COEFFICIENT_COUNT + k].rgb;
+		}
+	}
+	barrier();
+
+	for(uint stride = GROUP_SIZE / 2; stride > 0; stride /= 2) {
+		if(index < stride) {
+			for(uint k=0; k<SH_COEFFICIENT_COUNT; ++k) {
+				groupSums[index][k] += groupSums[index + stride][k];
+			}
+		}
+		barrier();
+	}
+
+	if(index < SH_COEFFICIENT_COUNT) {
+		coefficients[index] = vec4(groupSums[0][index] * SH_SCALE[index], 0.0);
+	}
+}
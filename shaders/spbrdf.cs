@@ -1,40 +1,16 @@
 #version 450 core
 
-const float PI = 3.141592;
-const float TWO_PI = 2 * PI;
 const float MIN_EPSILON = 0.001; 
 
-const uint SAMPLE_COUNT = 1024;
-const float INV_SAMPLE_COUNT = 1.0 / float(SAMPLE_COUNT);
-
 layout(binding=0, rg16f) restrict writeonly uniform image2D LUT;
 
-// Compute Van der Corput radical inverse
-float computeRadicalInverse(uint inputBits)
+// Pre-computed GGX half vectors (see sampletables.hpp), sampleCount per LUT row.
+layout(std430, binding=0) readonly buffer SampleTable
 {
-	inputBits = (inputBits << 16u) | (inputBits >> 16u);
-	inputBits = ((inputBits & 0x55555555u) << 1u) | ((inputBits & 0xAAAAAAAAu) >> 1u);
-	inputBits = ((inputBits & 0x33333333u) << 2u) | ((inputBits & 0xCCCCCCCCu) >> 2u);
-	inputBits = ((inputBits & 0x0F0F0F0Fu) << 4u) | ((inputBits & 0xF0F0F0F0u) >> 4u);
-	inputBits = ((inputBits & 0x00FF00FFu) << 8u) | ((inputBits & 0xFF00FF00u) >> 8u);
-	return float(inputBits) * 2.3283064365386963e-10;
-}
-
-vec2 sampleHammersley(uint sampleIndex)
-{
-	return vec2(sampleIndex * INV_SAMPLE_COUNT, computeRadicalInverse(sampleIndex));
-}
+	vec4 halfVectors[];
+};
 
-vec3 sampleGGXTangentSpace(float randU1, float randU2, float surfaceRoughness)
-{
-	float alpha = surfaceRoughness * surfaceRoughness;
-
-	float cosTheta = sqrt((1.0 - randU2) / (1.0 + (alpha*alpha - 1.0) * randU2));
-	float sinTheta = sqrt(1.0 - cosTheta*cosTheta);
-	float phi = TWO_PI * randU1;
-
-	return vec3(sinTheta * cos(phi), sinTheta * sin(phi), cosTheta);
-}
+layout(location=0) uniform uint sampleCount;
 
 float schlickGGXApproximationSingleTerm(float cosTheta, float k)
 {
@@ -60,17 +36,18 @@ void main(void)
 	float preIntegratedBRDF_DFG1 = 0;
 	float preIntegratedBRDF_DFG2 = 0;
 
-	for(uint i=0; i<SAMPLE_COUNT; ++i) {
-		vec2 randVector  = sampleHammersley(i);
-		vec3 halfVector = sampleGGXTangentSpace(randVector.x, randVector.y, surfaceRoughness);
+	uint firstSample = gl_GlobalInvocationID.y * sampleCount;
+	for(uint i=firstSample; i<firstSample + sampleCount; ++i) {
+		vec3 halfVector = halfVectors[i].xyz;
 		vec3 incidentLightDirection = 2.0 * dot(outgoingLightDirection, halfVector) * halfVector - outgoingLightDirection;
 
 		float incidentLightAngle = incidentLightDirection.z;
 		float halfAndOutgoingDotProduct = max(dot(outgoingLightDirection, halfVector), 0.0);
+		float halfVectorAngle = max(halfVector.z, 0.0);
 
 		if(incidentLightAngle > 0.0) {
 			float geometryAttenuation = schlickGGXApproximationIBL(incidentLightAngle, outgoingLightAngle, surfaceRoughness);
-			float geometryVisibility = geometryAttenuation * halfAndOutgoingDotProduct / (incidentLightAngle * outgoingLightAngle);
+			float geometryVisibility = geometryAttenuation * halfAndOutgoingDotProduct / (halfVectorAngle * outgoingLightAngle);
 			float fresnelSchlick = pow(1.0 - halfAndOutgoingDotProduct, 5);
 
 			preIntegratedBRDF_DFG1 += (1 - fresnelSchlick) * geometryVisibility;
@@ -78,5 +55,5 @@ void main(void)
 		}
 	}
 
-	imageStore(LUT, ivec2(gl_GlobalInvocationID), vec4(preIntegratedBRDF_DFG1, preIntegratedBRDF_DFG2, 0, 0) * INV_SAMPLE_COUNT);
+	imageStore(LUT, ivec2(gl_GlobalInvocationID), vec4(preIntegratedBRDF_DFG1, preIntegratedBRDF_DFG2, 0, 0) / float(sampleCount));
 }
\ No newline at end of file
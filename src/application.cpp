@@ -154,5 +154,18 @@ void Application::keyCallback(GLFWwindow* window, int key, int scancode, int act
 		{
 			selectedLight->enabled = !selectedLight->enabled;
 		}
+
+		// Switch to the next environment, or select one by index; the renderer bakes it in the background
+		// unless it is still resident.
+		if(key == GLFW_KEY_E) 
+		{
+			self->m_sceneSettings.environment = SceneSettings::NextEnvironment;
+			++self->m_sceneSettings.environmentRequest;
+		}
+		else if(key >= GLFW_KEY_1 && key <= GLFW_KEY_9) 
+		{
+			self->m_sceneSettings.environment = key - GLFW_KEY_1;
+			++self->m_sceneSettings.environmentRequest;
+		}
 	}
 }
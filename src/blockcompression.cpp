@@ -0,0 +1,431 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+#include "blockcompression.hpp"
+#include "simd.hpp"
+#include "threading.hpp"
+
+namespace
+{
+	using BlockCompression::Format;
+
+	static_assert(16 % SIMD::Width == 0, "A block's texels must split evenly into SIMD lanes");
+
+	// Interpolation weights (out of 64) of the 4-bit BC7 indices.
+	constexpr int BC7Weights[16] = {0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64};
+
+	// Number of endpoint fitting passes per BC7 block (index assignment followed by a least squares refit).
+	constexpr int BC7RefinePasses = 3;
+
+	struct Block
+	{
+		unsigned char texels[16][4];
+	};
+
+	// Gathers a 4x4 block; texels past the right or bottom edge repeat the last column or row.
+	Block loadBlock(const unsigned char* pixels, int width, int height, int channels, int blockX, int blockY)
+	{
+		Block block;
+		for(int y=0; y<4; ++y) {
+			const int sy = std::min(blockY * 4 + y, height - 1);
+			for(int x=0; x<4; ++x) {
+				const int sx = std::min(blockX * 4 + x, width - 1);
+				const unsigned char* texel = pixels + (size_t(sy) * width + sx) * channels;
+				for(int c=0; c<4; ++c) {
+					block.texels[y * 4 + x][c] = c < channels ? texel[c] : (c == 3 ? 255 : 0);
+				}
+			}
+		}
+		return block;
+	}
+
+	void storeBlock(const Block& block, int width, int height, int channels, int blockX, int blockY, unsigned char* pixels)
+	{
+		for(int y=0; y<4 && blockY * 4 + y < height; ++y) {
+			for(int x=0; x<4 && blockX * 4 + x < width; ++x) {
+				unsigned char* texel = pixels + (size_t(blockY * 4 + y) * width + blockX * 4 + x) * channels;
+				std::memcpy(texel, block.texels[y * 4 + x], channels);
+			}
+		}
+	}
+
+	class BitWriter
+	{
+	public:
+		explicit BitWriter(unsigned char* data) : m_data(data) {}
+
+		void write(uint32_t value, int bits)
+		{
+			for(int i=0; i<bits; ++i, ++m_position) {
+				if((value >> i) & 1) {
+					m_data[m_position >> 3] |= static_cast<unsigned char>(1 << (m_position & 7));
+				}
+			}
+		}
+
+	private:
+		unsigned char* m_data;
+		int m_position = 0;
+	};
+
+	class BitReader
+	{
+	public:
+		explicit BitReader(const unsigned char* data) : m_data(data) {}
+
+		uint32_t read(int bits)
+		{
+			uint32_t value = 0;
+			for(int i=0; i<bits; ++i, ++m_position) {
+				value |= uint32_t((m_data[m_position >> 3] >> (m_position & 7)) & 1) << i;
+			}
+			return value;
+		}
+
+	private:
+		const unsigned char* m_data;
+		int m_position = 0;
+	};
+
+	// BC4: endpoints red0 > red1 select the eight-value palette, whose interpolants are spaced evenly between them.
+	void encodeBC4(const Block& block, int channel, unsigned char* output)
+	{
+		unsigned char low = 255, high = 0;
+		for(const auto& texel : block.texels) {
+			low = std::min(low, texel[channel]);
+			high = std::max(high, texel[channel]);
+		}
+
+		output[0] = high;
+		output[1] = low;
+		uint64_t indices = 0;
+		if(high > low) {
+			// Position of each value on the 7 steps from low to high; step 7 is index 0, step 0 index 1, the rest 8 - step.
+			const float scale = 7.0f / float(high - low);
+			for(int i=0; i<16; ++i) {
+				const int step = int((block.texels[i][channel] - low) * scale + 0.5f);
+				const uint64_t index = (step == 7) ? 0 : (step == 0) ? 1 : uint64_t(8 - step);
+				indices |= index << (3 * i);
+			}
+		}
+		for(int i=0; i<6; ++i) {
+			output[2 + i] = static_cast<unsigned char>(indices >> (8 * i));
+		}
+	}
+
+	void decodeBC4(const unsigned char* input, int channel, Block& block)
+	{
+		const int red0 = input[0], red1 = input[1];
+		int palette[8] = {red0, red1};
+		if(red0 > red1) {
+			for(int i=2; i<8; ++i) {
+				palette[i] = ((8 - i) * red0 + (i - 1) * red1 + 3) / 7;
+			}
+		}
+		else {
+			for(int i=2; i<6; ++i) {
+				palette[i] = ((6 - i) * red0 + (i - 1) * red1 + 2) / 5;
+			}
+			palette[6] = 0;
+			palette[7] = 255;
+		}
+
+		uint64_t indices = 0;
+		for(int i=0; i<6; ++i) {
+			indices |= uint64_t(input[2 + i]) << (8 * i);
+		}
+		for(int i=0; i<16; ++i) {
+			block.texels[i][channel] = static_cast<unsigned char>(palette[(indices >> (3 * i)) & 7]);
+		}
+	}
+
+	struct BC7Candidate
+	{
+		int endpoints[2][4];  // 7-bit values.
+		int pbits[2];
+		int indices[16];
+		float error;
+	};
+
+	void bc7Palette(const int endpoints[2][4], const int pbits[2], float palette[16][4])
+	{
+		for(int c=0; c<4; ++c) {
+			const int e0 = (endpoints[0][c] << 1) | pbits[0];
+			const int e1 = (endpoints[1][c] << 1) | pbits[1];
+			for(int k=0; k<16; ++k) {
+				palette[k][c] = float(((64 - BC7Weights[k]) * e0 + BC7Weights[k] * e1 + 32) >> 6);
+			}
+		}
+	}
+
+	// Picks the closest palette entry for every texel (texels in structure of arrays layout) and returns the total squared error.
+	float assignIndices(const float texels[4][16], const float palette[16][4], int indices[16])
+	{
+		using namespace SIMD;
+
+		float total = 0.0f;
+		for(int base=0; base<16; base+=Width) {
+			const Float r = Float::load(texels[0] + base), g = Float::load(texels[1] + base);
+			const Float b = Float::load(texels[2] + base), a = Float::load(texels[3] + base);
+
+			Float bestError = 1e30f, bestIndex = 0.0f;
+			for(int k=0; k<16; ++k) {
+				const Float dr = r - palette[k][0], dg = g - palette[k][1], db = b - palette[k][2], da = a - palette[k][3];
+				const Float error = fmadd(dr, dr, fmadd(dg, dg, fmadd(db, db, da * da)));
+				const Mask closer = error < bestError;
+				bestError = select(closer, error, bestError);
+				bestIndex = select(closer, Float(float(k)), bestIndex);
+			}
+
+			float errors[Width], laneIndices[Width];
+			bestError.store(errors);
+			bestIndex.store(laneIndices);
+			for(int lane=0; lane<Width; ++lane) {
+				indices[base + lane] = int(laneIndices[lane]);
+				total += errors[lane];
+			}
+		}
+		return total;
+	}
+
+	// Quantizes floating point endpoints with every p-bit combination and keeps the best result.
+	void quantizeBC7(const float texels[4][16], const float endpoints[2][4], BC7Candidate& best)
+	{
+		for(int p=0; p<4; ++p) {
+			BC7Candidate candidate;
+			candidate.pbits[0] = p & 1;
+			candidate.pbits[1] = p >> 1;
+			for(int e=0; e<2; ++e) {
+				for(int c=0; c<4; ++c) {
+					const float value = (endpoints[e][c] - candidate.pbits[e]) * 0.5f;
+					candidate.endpoints[e][c] = std::clamp(int(std::lround(value)), 0, 127);
+				}
+			}
+
+			float palette[16][4];
+			bc7Palette(candidate.endpoints, candidate.pbits, palette);
+			candidate.error = assignIndices(texels, palette, candidate.indices);
+			if(candidate.error < best.error) {
+				best = candidate;
+			}
+		}
+	}
+
+	void encodeBC7(const Block& block, unsigned char* output)
+	{
+		float texels[4][16];
+		float mean[4] = {};
+		for(int i=0; i<16; ++i) {
+			for(int c=0; c<4; ++c) {
+				texels[c][i] = block.texels[i][c];
+				mean[c] += texels[c][i] / 16.0f;
+			}
+		}
+
+		// Principal axis of the texel colors (power iteration on the covariance matrix).
+		float covariance[4][4] = {};
+		for(int i=0; i<16; ++i) {
+			for(int r=0; r<4; ++r) {
+				for(int c=0; c<4; ++c) {
+					covariance[r][c] += (texels[r][i] - mean[r]) * (texels[c][i] - mean[c]);
+				}
+			}
+		}
+		float axis[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+		for(int iteration=0; iteration<8; ++iteration) {
+			float next[4] = {};
+			for(int r=0; r<4; ++r) {
+				for(int c=0; c<4; ++c) {
+					next[r] += covariance[r][c] * axis[c];
+				}
+			}
+			const float length = std::sqrt(next[0] * next[0] + next[1] * next[1] + next[2] * next[2] + next[3] * next[3]);
+			if(length < 1e-6f) {
+				break;
+			}
+			for(int c=0; c<4; ++c) {
+				axis[c] = next[c] / length;
+			}
+		}
+
+		float low = 0.0f, high = 0.0f;
+		for(int i=0; i<16; ++i) {
+			float t = 0.0f;
+			for(int c=0; c<4; ++c) {
+				t += (texels[c][i] - mean[c]) * axis[c];
+			}
+			low = std::min(low, t);
+			high = std::max(high, t);
+		}
+
+		float endpoints[2][4];
+		for(int c=0; c<4; ++c) {
+			endpoints[0][c] = std::clamp(mean[c] + axis[c] * low, 0.0f, 255.0f);
+			endpoints[1][c] = std::clamp(mean[c] + axis[c] * high, 0.0f, 255.0f);
+		}
+
+		BC7Candidate best;
+		best.error = std::numeric_limits<float>::max();
+		for(int pass=0; pass<BC7RefinePasses && best.error > 0.0f; ++pass) {
+			quantizeBC7(texels, endpoints, best);
+
+			// Least squares endpoints for the current indices.
+			float a = 0.0f, b = 0.0f, c = 0.0f, rhs0[4] = {}, rhs1[4] = {};
+			for(int i=0; i<16; ++i) {
+				const float w = BC7Weights[best.indices[i]] / 64.0f;
+				a += (1.0f - w) * (1.0f - w);
+				b += (1.0f - w) * w;
+				c += w * w;
+				for(int ch=0; ch<4; ++ch) {
+					rhs0[ch] += (1.0f - w) * texels[ch][i];
+					rhs1[ch] += w * texels[ch][i];
+				}
+			}
+			const float determinant = a * c - b * b;
+			if(std::fabs(determinant) < 1e-6f) {
+				break;
+			}
+			for(int ch=0; ch<4; ++ch) {
+				endpoints[0][ch] = std::clamp((c * rhs0[ch] - b * rhs1[ch]) / determinant, 0.0f, 255.0f);
+				endpoints[1][ch] = std::clamp((a * rhs1[ch] - b * rhs0[ch]) / determinant, 0.0f, 255.0f);
+			}
+		}
+
+		// The first index is stored without its top bit, so it must be below 8.
+		if(best.indices[0] & 8) {
+			std::swap(best.endpoints[0], best.endpoints[1]);
+			std::swap(best.pbits[0], best.pbits[1]);
+			for(int& index : best.indices) {
+				index = 15 - index;
+			}
+		}
+
+		std::memset(output, 0, 16);
+		BitWriter bits{output};
+		bits.write(1 << 6, 7);
+		for(int c=0; c<4; ++c) {
+			bits.write(uint32_t(best.endpoints[0][c]), 7);
+			bits.write(uint32_t(best.endpoints[1][c]), 7);
+		}
+		bits.write(uint32_t(best.pbits[0]), 1);
+		bits.write(uint32_t(best.pbits[1]), 1);
+		for(int i=0; i<16; ++i) {
+			bits.write(uint32_t(best.indices[i]), i == 0 ? 3 : 4);
+		}
+	}
+
+	void decodeBC7(const unsigned char* input, Block& block)
+	{
+		BitReader bits{input};
+		if(bits.read(7) != (1 << 6)) {
+			throw std::runtime_error("Only BC7 mode 6 blocks can be decoded");
+		}
+
+		int endpoints[2][4], pbits[2];
+		for(int c=0; c<4; ++c) {
+			endpoints[0][c] = int(bits.read(7));
+			endpoints[1][c] = int(bits.read(7));
+		}
+		pbits[0] = int(bits.read(1));
+		pbits[1] = int(bits.read(1));
+
+		float palette[16][4];
+		bc7Palette(endpoints, pbits, palette);
+		for(int i=0; i<16; ++i) {
+			const int index = int(bits.read(i == 0 ? 3 : 4));
+			for(int c=0; c<4; ++c) {
+				block.texels[i][c] = static_cast<unsigned char>(palette[index][c]);
+			}
+		}
+	}
+}
+
+namespace BlockCompression
+{
+	int blockBytes(Format format)
+	{
+		switch(format) {
+		case Format::BC4: return 8;
+		case Format::BC5:
+		case Format::BC7: return 16;
+		default:          return 0;
+		}
+	}
+
+	size_t compressedSize(Format format, int width, int height)
+	{
+		return size_t((width + 3) / 4) * ((height + 3) / 4) * blockBytes(format);
+	}
+
+	int encodedChannels(Format format, int channels)
+	{
+		switch(format) {
+		case Format::BC4: return 1;
+		case Format::BC5: return 2;
+		default:          return std::min(channels, 4);
+		}
+	}
+
+	std::vector<unsigned char> compress(const unsigned char* pixels, int width, int height, int channels, Format format)
+	{
+		if(format == Format::None || channels < encodedChannels(format, channels)) {
+			throw std::invalid_argument("Image has too few channels for the block format");
+		}
+
+		const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		const int bytes = blockBytes(format);
+		std::vector<unsigned char> blocks(compressedSize(format, width, height));
+
+		ThreadPool::instance().parallelFor(size_t(blocksY), [&](size_t blockY) {
+			for(int blockX=0; blockX<blocksX; ++blockX) {
+				const Block block = loadBlock(pixels, width, height, channels, blockX, int(blockY));
+				unsigned char* output = blocks.data() + (blockY * blocksX + blockX) * bytes;
+				switch(format) {
+				case Format::BC4:
+					encodeBC4(block, 0, output);
+					break;
+				case Format::BC5:
+					encodeBC4(block, 0, output);
+					encodeBC4(block, 1, output + 8);
+					break;
+				default:
+					encodeBC7(block, output);
+					break;
+				}
+			}
+		});
+		return blocks;
+	}
+
+	std::vector<unsigned char> decompress(const unsigned char* blocks, int width, int height, int channels, Format format)
+	{
+		const int blocksX = (width + 3) / 4, blocksY = (height + 3) / 4;
+		const int bytes = blockBytes(format);
+		std::vector<unsigned char> pixels(size_t(width) * height * channels);
+
+		ThreadPool::instance().parallelFor(size_t(blocksY), [&](size_t blockY) {
+			for(int blockX=0; blockX<blocksX; ++blockX) {
+				const unsigned char* input = blocks + (blockY * blocksX + blockX) * bytes;
+				Block block = {};
+				switch(format) {
+				case Format::BC4:
+					decodeBC4(input, 0, block);
+					break;
+				case Format::BC5:
+					decodeBC4(input, 0, block);
+					decodeBC4(input + 8, 1, block);
+					break;
+				default:
+					decodeBC7(input, block);
+					break;
+				}
+				storeBlock(block, width, height, channels, blockX, int(blockY), pixels.data());
+			}
+		});
+		return pixels;
+	}
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Encoders for the block-compressed texture formats used by the material textures:
+// BC4 (one channel), BC5 (two channels, e.g. the x and y of a normal map) and BC7 (RGB/RGBA).
+// Every format stores 4x4 texel blocks; partial blocks at the edges repeat the last row or column.
+namespace BlockCompression
+{
+	enum class Format
+	{
+		None,
+		BC4,  // 8 bytes per block: two 8-bit endpoints and 3-bit indices.
+		BC5,  // 16 bytes per block: a BC4 block for each of the first two channels.
+		BC7,  // 16 bytes per block. Only mode 6 is written (one subset, 7-bit RGBA endpoints with p-bits, 4-bit indices).
+	};
+
+	int blockBytes(Format format);
+	size_t compressedSize(Format format, int width, int height);
+
+	/**
+	 * @brief Number of channels of the source a format stores (BC7 keeps up to four; missing alpha is opaque).
+	 */
+	int encodedChannels(Format format, int channels);
+
+	/**
+	 * @brief Encodes a tightly packed 8-bit image; block rows are spread over the thread pool.
+	 */
+	std::vector<unsigned char> compress(const unsigned char* pixels, int width, int height, int channels, Format format);
+
+	/**
+	 * @brief Decodes blocks written by compress() back into the source layout, to measure the encoding error.
+	 * Channels the format does not store are zero.
+	 */
+	std::vector<unsigned char> decompress(const unsigned char* blocks, int width, int height, int channels, Format format);
+}
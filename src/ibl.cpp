@@ -0,0 +1,659 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <stdexcept>
+
+#include <glm/gtc/packing.hpp>
+
+#include "ibl.hpp"
+#include "image.hpp"
+#include "sampletables.hpp"
+#include "simd.hpp"
+#include "threading.hpp"
+#include "utils.hpp"
+
+namespace
+{
+	// Constants as spelled in the compute shaders, so results match bit for bit where possible.
+	constexpr float PI = 3.141592f;
+	constexpr float TwoPI = 2.0f * PI;
+	constexpr float Epsilon = 0.00001f;
+	constexpr float MinCosTheta = 0.001f;
+
+	// Edge length of the square block of texels that forms one unit of parallel work.
+	constexpr int TileSize = 16;
+
+	struct Tile
+	{
+		int level, face, x, y;
+	};
+
+	// Builds the list of tiles covering the given mip levels of a cube map.
+	std::vector<Tile> cubeTiles(const IBL::Cubemap& cubemap, int firstLevel, int lastLevel)
+	{
+		std::vector<Tile> tiles;
+		for(int level=firstLevel; level<=lastLevel; ++level) {
+			const int size = cubemap.levelSize(level);
+			for(int face=0; face<6; ++face) {
+				for(int y=0; y<size; y+=TileSize) {
+					for(int x=0; x<size; x+=TileSize) {
+						tiles.push_back({level, face, x, y});
+					}
+				}
+			}
+		}
+		return tiles;
+	}
+
+	// Directions of SIMD::Width consecutive texels of one row, starting at (x, y).
+	SIMD::Float3 texelDirections(int face, int x, int y, int size)
+	{
+		using namespace SIMD;
+
+		const float invSize = 1.0f / float(size);
+		const Float u = fmadd(Float::iota(float(x)) * Float(invSize), 2.0f, -1.0f);
+		const Float v = 2.0f * (1.0f - float(y) * invSize) - 1.0f;
+
+		Float3 direction;
+		switch(face) {
+		case 0: direction = {1.0f, v, -u}; break;
+		case 1: direction = {-1.0f, v, u}; break;
+		case 2: direction = {u, 1.0f, -v}; break;
+		case 3: direction = {u, -1.0f, v}; break;
+		case 4: direction = {u, v, 1.0f}; break;
+		case 5: direction = {-u, v, -1.0f}; break;
+		default: throw std::invalid_argument("Invalid cube map face index");
+		}
+		return normalize(direction);
+	}
+
+	// Face index and face coordinates of SIMD::Width directions (OpenGL 4.5 spec, table 8.19).
+	struct CubeCoords
+	{
+		float face[SIMD::Width];
+		float s[SIMD::Width];
+		float t[SIMD::Width];
+	};
+
+	void cubeCoords(const SIMD::Float3& d, CubeCoords& coords)
+	{
+		using namespace SIMD;
+
+		const Float ax = abs(d.x), ay = abs(d.y), az = abs(d.z);
+		const Mask xMajor = (ax >= ay) & (ax >= az);
+		const Mask yMajor = andNot(ay >= az, xMajor);
+		const Mask xPositive = d.x >= 0.0f, yPositive = d.y >= 0.0f, zPositive = d.z >= 0.0f;
+
+		const Float ma = select(xMajor, ax, select(yMajor, ay, az));
+		const Float sc = select(xMajor, select(xPositive, -d.z, d.z), select(yMajor, d.x, select(zPositive, d.x, -d.x)));
+		const Float tc = select(xMajor, -d.y, select(yMajor, select(yPositive, d.z, -d.z), -d.y));
+		const Float face = select(xMajor, select(xPositive, 0.0f, 1.0f),
+			select(yMajor, select(yPositive, 2.0f, 3.0f), select(zPositive, 4.0f, 5.0f)));
+
+		const Float invMa = Float(0.5f) / ma;
+		face.store(coords.face);
+		fmadd(sc, invMa, 0.5f).store(coords.s);
+		fmadd(tc, invMa, 0.5f).store(coords.t);
+	}
+
+	int clampIndex(int i, int size)
+	{
+		return i < 0 ? 0 : (i >= size ? size - 1 : i);
+	}
+
+	// Bilinear lookup into one cube face with clamp-to-edge addressing.
+	glm::vec4 fetchBilinear(const glm::vec4* texels, int size, float s, float t)
+	{
+		const float x = s * size - 0.5f;
+		const float y = t * size - 0.5f;
+		const float x0f = std::floor(x), y0f = std::floor(y);
+		const float fx = x - x0f, fy = y - y0f;
+		const int x0 = clampIndex(int(x0f), size), x1 = clampIndex(int(x0f) + 1, size);
+		const int y0 = clampIndex(int(y0f), size), y1 = clampIndex(int(y0f) + 1, size);
+
+		const glm::vec4 top = glm::mix(texels[y0 * size + x0], texels[y0 * size + x1], fx);
+		const glm::vec4 bottom = glm::mix(texels[y1 * size + x0], texels[y1 * size + x1], fx);
+		return glm::mix(top, bottom, fy);
+	}
+
+	// Trilinear lookup for SIMD::Width directions sharing the same level of detail.
+	void sampleLanes(const IBL::Cubemap& cubemap, const SIMD::Float3& direction, float lod, glm::vec4* result)
+	{
+		CubeCoords coords;
+		cubeCoords(direction, coords);
+
+		lod = glm::clamp(lod, 0.0f, float(cubemap.levels - 1));
+		const int level0 = int(lod);
+		const int level1 = std::min(level0 + 1, cubemap.levels - 1);
+		const float fraction = lod - float(level0);
+		const int size0 = cubemap.levelSize(level0);
+		const int size1 = cubemap.levelSize(level1);
+
+		for(int lane=0; lane<SIMD::Width; ++lane) {
+			const int face = int(coords.face[lane]);
+			result[lane] = fetchBilinear(cubemap.face(level0, face), size0, coords.s[lane], coords.t[lane]);
+			if(fraction > 0.0f) {
+				const glm::vec4 next = fetchBilinear(cubemap.face(level1, face), size1, coords.s[lane], coords.t[lane]);
+				result[lane] = glm::mix(result[lane], next, fraction);
+			}
+		}
+	}
+
+	// RGB texel of a float or half float image.
+	glm::vec3 loadRGB(const Image& image, size_t index)
+	{
+		if(image.isHalfFloat()) {
+			const uint16_t* p = image.pixels<uint16_t>() + index * 3;
+			return {glm::unpackHalf1x16(p[0]), glm::unpackHalf1x16(p[1]), glm::unpackHalf1x16(p[2])};
+		}
+		const float* p = image.pixels<float>() + index * 3;
+		return {p[0], p[1], p[2]};
+	}
+
+	// Bilinear lookups into an RGB equirectangular image with GL_REPEAT addressing for SIMD::Width
+	// texture coordinates. Addressing is vectorized; the four taps of every lane are fetched individually.
+	void sampleEquirectLanes(const Image& image, const SIMD::Float& u, const SIMD::Float& v, glm::vec4* result)
+	{
+		using namespace SIMD;
+
+		const int width = image.width(), height = image.height();
+
+		const Float x = fmadd(u, float(width), -0.5f);
+		const Float y = fmadd(v, float(height), -0.5f);
+		const Float x0 = floor(x), y0 = floor(y);
+
+		float x0s[Width], y0s[Width], fxs[Width], fys[Width];
+		x0.store(x0s);
+		y0.store(y0s);
+		(x - x0).store(fxs);
+		(y - y0).store(fys);
+
+		auto wrap = [](int i, int size) { i %= size; return i < 0 ? i + size : i; };
+		for(int lane=0; lane<Width; ++lane) {
+			const int px0 = wrap(int(x0s[lane]), width), px1 = wrap(int(x0s[lane]) + 1, width);
+			const int py0 = wrap(int(y0s[lane]), height), py1 = wrap(int(y0s[lane]) + 1, height);
+
+			auto texel = [&](int px, int py) { return loadRGB(image, size_t(py) * width + px); };
+			const glm::vec3 top = glm::mix(texel(px0, py0), texel(px1, py0), fxs[lane]);
+			const glm::vec3 bottom = glm::mix(texel(px0, py1), texel(px1, py1), fxs[lane]);
+			result[lane] = glm::vec4{glm::mix(top, bottom, fys[lane]), 1.0f};
+		}
+	}
+
+	// Copies one square region of an RGB float image into a cube face, optionally rotated by 180 degrees.
+	void copyFace(const Image& image, int left, int top, int size, bool rotated, glm::vec4* face)
+	{
+		ThreadPool::instance().parallelFor(size_t(size), [&](size_t y) {
+			glm::vec4* row = face + y * size;
+			for(int x=0; x<size; ++x) {
+				const int sx = rotated ? size - 1 - x : x;
+				const int sy = rotated ? size - 1 - int(y) : int(y);
+				row[x] = glm::vec4{loadRGB(image, size_t(top + sy) * image.width() + left + sx), 1.0f};
+			}
+		});
+	}
+
+	// Face file names of a cube map directory, in GL_TEXTURE_CUBE_MAP_POSITIVE_X + face order.
+	const char* const FaceNames[6] = {"posx", "negx", "posy", "negy", "posz", "negz"};
+
+	// Normalization constants of the real SH basis functions up to band 2.
+	constexpr float SHNormalization[9] = {
+		0.282095f,
+		0.488603f, 0.488603f, 0.488603f,
+		1.092548f, 1.092548f, 0.315392f, 1.092548f, 0.546274f,
+	};
+
+	// Clamped cosine lobe convolution per band (pi, 2pi/3, pi/4) divided by pi, matching the 1/pi
+	// scale of the irradiance map written by irmap.cs.
+	constexpr float SHCosineLobe[9] = {
+		1.0f,
+		2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f,
+		0.25f, 0.25f, 0.25f, 0.25f, 0.25f,
+	};
+
+	// Polynomial part of the real SH basis functions up to band 2.
+	void shBasis(const glm::vec3& n, float basis[9])
+	{
+		basis[0] = 1.0f;
+		basis[1] = n.y;
+		basis[2] = n.z;
+		basis[3] = n.x;
+		basis[4] = n.x * n.y;
+		basis[5] = n.y * n.z;
+		basis[6] = 3.0f * n.z * n.z - 1.0f;
+		basis[7] = n.x * n.z;
+		basis[8] = n.x * n.x - n.y * n.y;
+	}
+
+	// Stores up to SIMD::Width results of one row, dropping lanes past the end of the row.
+	void storeRow(glm::vec4* row, int x, int size, const glm::vec4* values)
+	{
+		const int count = std::min(SIMD::Width, size - x);
+		for(int lane=0; lane<count; ++lane) {
+			row[x + lane] = values[lane];
+		}
+	}
+}
+
+namespace IBL
+{
+	Cubemap::Cubemap(int size, int levels)
+		: size(size)
+		, levels(levels)
+		, mips(levels)
+	{
+		for(int level=0; level<levels; ++level) {
+			const size_t levelSize = size_t(this->levelSize(level));
+			mips[level].resize(6 * levelSize * levelSize);
+		}
+	}
+
+	glm::vec4* Cubemap::face(int level, int face)
+	{
+		const size_t levelSize = size_t(this->levelSize(level));
+		return mips[level].data() + face * levelSize * levelSize;
+	}
+
+	const glm::vec4* Cubemap::face(int level, int face) const
+	{
+		const size_t levelSize = size_t(this->levelSize(level));
+		return mips[level].data() + face * levelSize * levelSize;
+	}
+
+	glm::vec4 Cubemap::sample(const glm::vec3& direction, float lod) const
+	{
+		glm::vec4 result[SIMD::Width];
+		sampleLanes(*this, {direction.x, direction.y, direction.z}, lod, result);
+		return result[0];
+	}
+
+	void Cubemap::generateMipmaps()
+	{
+		for(int level=1; level<levels; ++level) {
+			const int size = levelSize(level);
+			const int srcSize = levelSize(level - 1);
+			const int step = srcSize > 1 ? 2 : 1;
+
+			ThreadPool::instance().parallelFor(size_t(6 * size), [&](size_t index) {
+				const int face = int(index) / size;
+				const int y = int(index) % size;
+				const glm::vec4* src = this->face(level - 1, face);
+				glm::vec4* dst = this->face(level, face) + y * size;
+				const int sy0 = y * step, sy1 = std::min(sy0 + 1, srcSize - 1);
+				for(int x=0; x<size; ++x) {
+					const int sx0 = x * step, sx1 = std::min(sx0 + 1, srcSize - 1);
+					dst[x] = 0.25f * (src[sy0 * srcSize + sx0] + src[sy0 * srcSize + sx1] +
+					                  src[sy1 * srcSize + sx0] + src[sy1 * srcSize + sx1]);
+				}
+			});
+		}
+	}
+
+	glm::vec3 texelDirection(int face, int x, int y, int size)
+	{
+		float components[3][SIMD::Width];
+		const SIMD::Float3 direction = texelDirections(face, x, y, size);
+		direction.x.store(components[0]);
+		direction.y.store(components[1]);
+		direction.z.store(components[2]);
+		return {components[0][0], components[1][0], components[2][0]};
+	}
+
+	Cubemap equirectToCubemap(const Image& equirect, int size)
+	{
+		if(!equirect.isHDR() || equirect.channels() != 3) {
+			throw std::invalid_argument("Equirectangular input must be an RGB floating point image");
+		}
+
+		Cubemap cubemap{size, int(std::log2(size)) + 1};
+
+		ThreadPool::instance().parallelFor(size_t(6 * size), [&](size_t index) {
+			const int face = int(index) / size;
+			const int y = int(index) % size;
+			glm::vec4* row = cubemap.face(0, face) + y * size;
+
+			glm::vec4 values[SIMD::Width];
+			for(int x=0; x<size; x+=SIMD::Width) {
+				const SIMD::Float3 direction = texelDirections(face, x, y, size);
+				const SIMD::Float phi = SIMD::fastAtan2(direction.z, direction.x);
+				const SIMD::Float theta = SIMD::fastAcos(direction.y);
+				sampleEquirectLanes(equirect, phi * (1.0f / TwoPI), theta * (1.0f / PI), values);
+				storeRow(row, x, size, values);
+			}
+		});
+
+		cubemap.generateMipmaps();
+		return cubemap;
+	}
+
+	std::vector<std::string> environmentFiles(const std::string& path)
+	{
+		if(!std::filesystem::is_directory(path)) {
+			return {path};
+		}
+		std::vector<std::string> files;
+		for(const char* name : FaceNames) {
+			files.push_back(path + "/" + name + ".hdr");
+		}
+		return files;
+	}
+
+	EnvironmentSource loadEnvironment(const std::string& path, bool halfFloat, bool streamEquirect)
+	{
+		const std::vector<std::string> files = environmentFiles(path);
+
+		// Only the scanline index of a streamed equirectangular image is built here; crosses are split below.
+		if(streamEquirect && files.size() == 1) {
+			auto file = std::make_shared<FileUtility::MappedFile>(files[0]);
+			if(RGBEDecoder::isRGBE(file->data(), file->size())) {
+				auto decoder = std::make_shared<RGBEDecoder>(file->data(), file->size());
+				const int width = decoder->width(), height = decoder->height();
+				if(width * 3 != height * 4 && width * 4 != height * 3) {
+					std::printf("Indexed environment for streaming: %s (%dx%d)\n", files[0].c_str(), width, height);
+					EnvironmentSource source;
+					source.equirectFile = std::move(file);
+					source.equirectDecoder = std::move(decoder);
+					return source;
+				}
+			}
+		}
+
+		// Separate faces go straight into a float cube map; a single image may be kept as it is decoded.
+		std::vector<std::shared_ptr<Image>> images;
+		for(const std::string& file : files) {
+			images.push_back(Image::fromFile(file, 3, halfFloat && files.size() == 1));
+			if(!images.back()->isHDR()) {
+				throw std::runtime_error("Environment map must be a floating point image: " + file);
+			}
+		}
+
+		EnvironmentSource source;
+		if(images.size() == 6) {
+			const int size = images[0]->width();
+			source.cubemap = Cubemap{size, 1};
+			for(int face=0; face<6; ++face) {
+				if(images[face]->width() != size || images[face]->height() != size) {
+					throw std::runtime_error("Cube map faces must be square and equally sized: " + files[face]);
+				}
+				copyFace(*images[face], 0, 0, size, false, source.cubemap.face(0, face));
+			}
+			return source;
+		}
+
+		// Cross layouts, with +Z in the center:
+		//   horizontal (4:3):     vertical (3:4):
+		//      +Y                    +Y
+		//   -X +Z +X -Z           -X +Z +X
+		//      -Y                    -Y
+		//                            -Z (rotated by 180 degrees)
+		const Image& image = *images[0];
+		const bool horizontal = image.width() * 3 == image.height() * 4;
+		const bool vertical = image.width() * 4 == image.height() * 3;
+		if(!horizontal && !vertical) {
+			source.equirect = images[0];
+			return source;
+		}
+
+		const int size = image.width() / (horizontal ? 4 : 3);
+		static const int HorizontalCross[6][2] = {{2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {3, 1}};
+		static const int VerticalCross[6][2] = {{2, 1}, {0, 1}, {1, 0}, {1, 2}, {1, 1}, {1, 3}};
+		source.cubemap = Cubemap{size, 1};
+		for(int face=0; face<6; ++face) {
+			const int* cell = horizontal ? HorizontalCross[face] : VerticalCross[face];
+			copyFace(image, cell[0] * size, cell[1] * size, size, vertical && face == 5, source.cubemap.face(0, face));
+		}
+		return source;
+	}
+
+	void writeCubemapFaces(const Cubemap& cubemap, const std::string& directory)
+	{
+		std::filesystem::create_directories(directory);
+
+		std::vector<float> rgb(size_t(cubemap.size) * cubemap.size * 3);
+		for(int face=0; face<6; ++face) {
+			const glm::vec4* texels = cubemap.face(0, face);
+			for(size_t i=0; i<size_t(cubemap.size) * cubemap.size; ++i) {
+				rgb[i*3 + 0] = texels[i].r;
+				rgb[i*3 + 1] = texels[i].g;
+				rgb[i*3 + 2] = texels[i].b;
+			}
+			Image::writeHDR(directory + "/" + FaceNames[face] + ".hdr", cubemap.size, cubemap.size, 3, rgb.data());
+		}
+	}
+
+	Cubemap prefilterSpecular(const Cubemap& envMap, const KernelSettings& settings)
+	{
+		Cubemap result{envMap.size, envMap.levels};
+		result.mips[0] = envMap.mips[0];
+
+		const SpecularSampleTable table = buildSpecularSampleTable(envMap.size, envMap.levels, settings.specularSamples);
+
+		const std::vector<Tile> tiles = cubeTiles(result, 1, result.levels - 1);
+		ThreadPool::instance().parallelFor(tiles.size(), [&](size_t index) {
+			using namespace SIMD;
+
+			const Tile& tile = tiles[index];
+			const int size = result.levelSize(tile.level);
+			const SpecularSampleTable::Level& range = table.levels[tile.level];
+			const glm::vec4* samples = table.samples.data() + range.first;
+			glm::vec4* output = result.face(tile.level, tile.face);
+
+			float totalWeight = 0.0f;
+			for(unsigned int i=0; i<range.count; ++i) {
+				totalWeight += samples[i].z;
+			}
+
+			glm::vec4 color[Width], accumulated[Width];
+			for(int y=tile.y; y<std::min(tile.y + TileSize, size); ++y) {
+				for(int x=tile.x; x<std::min(tile.x + TileSize, size); x+=Width) {
+					const Float3 normal = texelDirections(tile.face, x, y, size);
+
+					// The basis of computeBasisVectors in spmap.cs: the samples are not symmetric, so S and T must match.
+					Float3 bitangent = cross(normal, {0.0f, 1.0f, 0.0f});
+					bitangent = select(dot(bitangent, bitangent) >= Float(Epsilon), bitangent, cross(normal, {1.0f, 0.0f, 0.0f}));
+					bitangent = normalize(bitangent);
+					const Float3 tangent = normalize(cross(normal, bitangent));
+
+					std::fill(accumulated, accumulated + Width, glm::vec4{0.0f});
+					for(unsigned int i=0; i<range.count; ++i) {
+						const glm::vec4& sample = samples[i];
+						const Float3 lightDir = tangent * sample.x + bitangent * sample.y + normal * sample.z;
+						sampleLanes(envMap, lightDir, sample.w, color);
+						for(int lane=0; lane<Width; ++lane) {
+							accumulated[lane] += color[lane] * sample.z;
+						}
+					}
+					for(int lane=0; lane<Width; ++lane) {
+						accumulated[lane] = glm::vec4{glm::vec3{accumulated[lane]} / totalWeight, 1.0f};
+					}
+					storeRow(output + y * size, x, size, accumulated);
+				}
+			}
+		});
+		return result;
+	}
+
+	Cubemap convolveIrradiance(const Cubemap& envMap, int size, const KernelSettings& settings)
+	{
+		const bool filtered = settings.filteredIrradiance;
+		const float invNumSamples = 1.0f / float(settings.irradianceSamples);
+		const std::vector<glm::vec4> hemisphere = filtered
+			? buildFilteredIrradianceSampleTable(settings.irradianceSamples, envMap.size)
+			: buildIrradianceSampleTable(settings.irradianceSamples);
+
+		Cubemap result{size, 1};
+		const std::vector<Tile> tiles = cubeTiles(result, 0, 0);
+		ThreadPool::instance().parallelFor(tiles.size(), [&](size_t index) {
+			using namespace SIMD;
+
+			const Tile& tile = tiles[index];
+			glm::vec4* output = result.face(0, tile.face);
+
+			glm::vec4 color[Width], accumulated[Width];
+			for(int y=tile.y; y<std::min(tile.y + TileSize, size); ++y) {
+				for(int x=tile.x; x<std::min(tile.x + TileSize, size); x+=Width) {
+					const Float3 normal = texelDirections(tile.face, x, y, size);
+
+					Float3 bitangent = select(abs(normal.y) > Float(1.0f - Epsilon),
+						cross(normal, {1.0f, 0.0f, 0.0f}), cross(normal, {0.0f, 1.0f, 0.0f}));
+					bitangent = normalize(bitangent);
+					const Float3 tangent = normalize(cross(normal, bitangent));
+
+					std::fill(accumulated, accumulated + Width, glm::vec4{0.0f});
+					for(const glm::vec4& sample : hemisphere) {
+						const Float3 direction = tangent * sample.x + bitangent * sample.y + normal * sample.z;
+						// Cosine-weighted samples average plainly; uniform ones carry twice their cosine weight.
+						sampleLanes(envMap, direction, filtered ? sample.w : 0.0f, color);
+						const float weight = filtered ? 1.0f : 2.0f * sample.w;
+						for(int lane=0; lane<Width; ++lane) {
+							accumulated[lane] += color[lane] * weight;
+						}
+					}
+					for(int lane=0; lane<Width; ++lane) {
+						accumulated[lane] = glm::vec4{glm::vec3{accumulated[lane]} * invNumSamples, 1.0f};
+					}
+					storeRow(output + y * size, x, size, accumulated);
+				}
+			}
+		});
+		return result;
+	}
+
+	std::vector<glm::vec2> integrateBRDF(int size, const KernelSettings& settings)
+	{
+		const unsigned int numSamples = settings.brdfSamples;
+		const float invNumSamples = 1.0f / float(numSamples);
+
+		const std::vector<glm::vec4> halfVectors = buildBRDFSampleTable(size, numSamples);
+
+		std::vector<glm::vec2> lut(size_t(size) * size);
+		ThreadPool::instance().parallelFor(size_t(size), [&](size_t y) {
+			using namespace SIMD;
+
+			const float roughness = float(y) / float(size);
+			const float k = (roughness * roughness) / 2.0f;
+
+			const glm::vec4* rowSamples = halfVectors.data() + y * numSamples;
+
+			float scale[Width], bias[Width];
+			for(int x=0; x<size; x+=Width) {
+				const Float cosLo = max(Float::iota(float(x)) * Float(1.0f / float(size)), MinCosTheta);
+				const Float sinLo = sqrt(Float(1.0f) - cosLo * cosLo);
+				const Float g1Lo = cosLo / fmadd(cosLo, 1.0f - k, k);
+
+				Float dfg1 = 0.0f, dfg2 = 0.0f;
+				for(unsigned int i=0; i<numSamples; ++i) {
+					const glm::vec4& h = rowSamples[i];
+					const Float cosLoH = fmadd(sinLo, h.x, cosLo * h.z);
+					const Float cosLi = fmadd(cosLoH * 2.0f, h.z, -cosLo);
+					const Mask valid = cosLi > Float(0.0f);
+					if(!any(valid)) {
+						continue;
+					}
+
+					const Float clampedLoH = max(cosLoH, 0.0f);
+					const Float safeCosLi = select(valid, cosLi, 1.0f);
+					const Float g1Li = safeCosLi / fmadd(safeCosLi, 1.0f - k, k);
+					const Float gv = g1Li * g1Lo * clampedLoH / (Float(std::max(h.z, 0.0f)) * cosLo);
+					const Float oneMinus = Float(1.0f) - clampedLoH;
+					const Float oneMinusSq = oneMinus * oneMinus;
+					const Float fc = oneMinusSq * oneMinusSq * oneMinus;
+
+					dfg1 += select(valid, (Float(1.0f) - fc) * gv, 0.0f);
+					dfg2 += select(valid, fc * gv, 0.0f);
+				}
+
+				(dfg1 * invNumSamples).store(scale);
+				(dfg2 * invNumSamples).store(bias);
+				for(int lane=0; lane<std::min(Width, size - x); ++lane) {
+					lut[y * size + x + lane] = {scale[lane], bias[lane]};
+				}
+			}
+		});
+		return lut;
+	}
+
+	IrradianceSH projectIrradianceSH(const Cubemap& envMap, int level)
+	{
+		const int size = envMap.levelSize(level);
+		const float invSize = 1.0f / float(size);
+
+		// One partial sum per face row keeps the reduction deterministic regardless of the thread count.
+		std::vector<IrradianceSH> partials(size_t(6 * size));
+		ThreadPool::instance().parallelFor(partials.size(), [&](size_t index) {
+			const int face = int(index) / size;
+			const int y = int(index) % size;
+			const glm::vec4* row = envMap.face(level, face) + y * size;
+
+			IrradianceSH sum{};
+			float basis[9];
+			for(int x=0; x<size; ++x) {
+				// Texel centre in [-1, 1] face coordinates and its solid angle on the unit sphere.
+				const float u = 2.0f * (float(x) + 0.5f) * invSize - 1.0f;
+				const float v = 2.0f * (float(y) + 0.5f) * invSize - 1.0f;
+				const float d = 1.0f + u*u + v*v;
+				const float solidAngle = 4.0f * invSize * invSize / (d * std::sqrt(d));
+
+				glm::vec3 direction{0.0f};
+				switch(face) {
+				case 0: direction = {1.0f, -v, -u}; break;
+				case 1: direction = {-1.0f, -v, u}; break;
+				case 2: direction = {u, 1.0f, v}; break;
+				case 3: direction = {u, -1.0f, -v}; break;
+				case 4: direction = {u, -v, 1.0f}; break;
+				case 5: direction = {-u, -v, -1.0f}; break;
+				}
+				shBasis(glm::normalize(direction), basis);
+
+				const glm::vec3 radiance = glm::vec3{row[x]} * solidAngle;
+				for(int k=0; k<9; ++k) {
+					sum[k] += radiance * basis[k];
+				}
+			}
+			partials[index] = sum;
+		});
+
+		IrradianceSH result{};
+		for(const IrradianceSH& partial : partials) {
+			for(int k=0; k<9; ++k) {
+				result[k] += partial[k];
+			}
+		}
+		for(int k=0; k<9; ++k) {
+			result[k] *= SHCosineLobe[k] * SHNormalization[k] * SHNormalization[k];
+		}
+		return result;
+	}
+
+	glm::vec3 evaluateIrradianceSH(const IrradianceSH& sh, const glm::vec3& normal)
+	{
+		float basis[9];
+		shBasis(normal, basis);
+
+		glm::vec3 result{0.0f};
+		for(int k=0; k<9; ++k) {
+			result += sh[k] * basis[k];
+		}
+		return result;
+	}
+
+	ErrorStats compare(const float* computed, const float* reference, size_t count)
+	{
+		ErrorStats stats;
+		double sumSquaredError = 0.0, sumSquaredReference = 0.0;
+		for(size_t i=0; i<count; ++i) {
+			const double error = double(computed[i]) - double(reference[i]);
+			stats.maxAbsolute = std::max(stats.maxAbsolute, std::abs(error));
+			sumSquaredError += error * error;
+			sumSquaredReference += double(reference[i]) * double(reference[i]);
+		}
+		stats.count = count;
+		if(count > 0) {
+			stats.rmse = std::sqrt(sumSquaredError / double(count));
+			const double referenceRMS = std::sqrt(sumSquaredReference / double(count));
+			stats.relativeRMSE = referenceRMS > 0.0 ? stats.rmse / referenceRMS : 0.0;
+		}
+		return stats;
+	}
+}
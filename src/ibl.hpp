@@ -0,0 +1,169 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+class Image;
+class RGBEDecoder;
+namespace FileUtility { class MappedFile; }
+
+// CPU implementation of the image-based lighting precompute kernels.
+// Mirrors equirect2cube.cs, spmap.cs, irmap.cs and spbrdf.cs so that the IBL resources
+// can be baked and validated on machines without an OpenGL 4.5 capable GPU.
+namespace IBL
+{
+	/**
+	 * @brief RGBA floating point cube map with a full or partial mip chain.
+	 *
+	 * Faces are stored in GL_TEXTURE_CUBE_MAP_POSITIVE_X + face order, rows top to bottom
+	 * in the same orientation the compute shaders use for imageStore.
+	 */
+	struct Cubemap
+	{
+		Cubemap() = default;
+		Cubemap(int size, int levels);
+
+		int levelSize(int level) const { return std::max(size >> level, 1); }
+
+		glm::vec4* face(int level, int face);
+		const glm::vec4* face(int level, int face) const;
+
+		/**
+		 * @brief Trilinearly filtered lookup, equivalent to textureLod() on a cube sampler.
+		 *
+		 * Bilinear footprints are clamped to the face edge instead of being blended
+		 * across faces as GL_TEXTURE_CUBE_MAP_SEAMLESS does.
+		 */
+		glm::vec4 sample(const glm::vec3& direction, float lod) const;
+
+		/**
+		 * @brief Rebuilds levels 1..levels-1 from level 0 with a 2x2 box filter (glGenerateTextureMipmap).
+		 */
+		void generateMipmaps();
+
+		int size = 0;
+		int levels = 0;
+		std::vector<std::vector<glm::vec4>> mips;
+	};
+
+	/**
+	 * @brief Sample counts used by the kernels; the defaults match the compute shaders.
+	 */
+	struct KernelSettings
+	{
+		unsigned int specularSamples = 1024;       // Base count, reduced on rough levels (see specularSampleCount).
+		unsigned int irradianceSamples = 64 * 1024;
+		bool filteredIrradiance = false;           // Filtered importance sampling (see buildFilteredIrradianceSampleTable).
+		unsigned int brdfSamples = 1024;
+	};
+
+	/**
+	 * @brief Direction of texel (x, y) of the given cube face, as computed by the bake shaders.
+	 */
+	glm::vec3 texelDirection(int face, int x, int y, int size);
+
+	/**
+	 * @brief Converts an RGB float equirectangular image into a cube map with a full mip chain (equirect2cube.cs).
+	 *
+	 * Rows are processed in parallel and SIMD::Width texels at a time, using polynomial atan2/acos
+	 * approximations and bilinear filtering.
+	 */
+	Cubemap equirectToCubemap(const Image& equirect, int size);
+
+	/**
+	 * @brief Environment map as stored on disk: an equirectangular image or the faces of a cube map.
+	 */
+	struct EnvironmentSource
+	{
+		std::shared_ptr<Image> equirect;  // RGB float equirectangular image, null for cube map and streamed inputs.
+		Cubemap cubemap;                  // Level 0 of a cube map input, faces copied without resampling.
+
+		// Streamed equirectangular RGBE input: the file stays mapped with only its scanlines indexed, so blocks
+		// of rows can be decoded as they are uploaded.
+		std::shared_ptr<const FileUtility::MappedFile> equirectFile;
+		std::shared_ptr<const RGBEDecoder> equirectDecoder;
+	};
+
+	/**
+	 * @brief Files an environment is read from: for a directory its six faces
+	 * (posx, negx, posy, negy, posz, negz .hdr in GL face order), otherwise the path itself.
+	 */
+	std::vector<std::string> environmentFiles(const std::string& path);
+
+	/**
+	 * @brief Loads an environment map from a directory of faces, a horizontal (4:3) or vertical (3:4)
+	 * cross image, or an equirectangular image (any other aspect ratio).
+	 * With halfFloat, an equirectangular image is kept as half floats, ready for upload. With streamEquirect,
+	 * an equirectangular .hdr file is not decoded at all but returned as equirectFile and equirectDecoder.
+	 */
+	EnvironmentSource loadEnvironment(const std::string& path, bool halfFloat=false, bool streamEquirect=false);
+
+	/**
+	 * @brief Writes level 0 of a cube map as a directory of faces readable by loadEnvironment().
+	 */
+	void writeCubemapFaces(const Cubemap& cubemap, const std::string& directory);
+
+	/**
+	 * @brief Pre-filters the specular environment map mip chain with GGX importance sampling (spmap.cs).
+	 *
+	 * Level 0 is copied from the input; every further level uses roughness level / (levels - 1).
+	 * The input must carry a full mip chain which is used for filtered importance sampling.
+	 */
+	Cubemap prefilterSpecular(const Cubemap& envMap, const KernelSettings& settings = KernelSettings{});
+
+	/**
+	 * @brief Computes the diffuse irradiance cube map by hemisphere integration (irmap.cs).
+	 *
+	 * Uniform sampling reads level 0 of the input; filtered importance sampling needs its full
+	 * unfiltered mip chain.
+	 */
+	Cubemap convolveIrradiance(const Cubemap& envMap, int size, const KernelSettings& settings = KernelSettings{});
+
+	/**
+	 * @brief Computes the split-sum Cook-Torrance BRDF lookup table (spbrdf.cs).
+	 *
+	 * @return size x size (scale, bias) pairs; x is cos(theta_o), y is roughness.
+	 */
+	std::vector<glm::vec2> integrateBRDF(int size, const KernelSettings& settings = KernelSettings{});
+
+	/**
+	 * @brief Order-2 spherical harmonics (9 RGB coefficients) of the diffuse irradiance.
+	 *
+	 * Coefficients are pre-scaled by the clamped cosine lobe, 1/pi and the basis normalization, so the
+	 * value stored by irmap.cs is a plain polynomial in the normal (see evaluateIrradianceSH and pbr.fs).
+	 */
+	using IrradianceSH = std::array<glm::vec3, 9>;
+
+	/**
+	 * @brief Projects the given mip level of an environment map onto the irradiance SH basis.
+	 *
+	 * Rows of all faces are reduced in parallel; texels are weighted by their exact solid angle.
+	 */
+	IrradianceSH projectIrradianceSH(const Cubemap& envMap, int level);
+
+	/**
+	 * @brief Evaluates irradiance SH coefficients for the given unit normal.
+	 */
+	glm::vec3 evaluateIrradianceSH(const IrradianceSH& sh, const glm::vec3& normal);
+
+	/**
+	 * @brief Difference between a computed result and a reference.
+	 */
+	struct ErrorStats
+	{
+		double maxAbsolute = 0.0;
+		double rmse = 0.0;
+		double relativeRMSE = 0.0;  // RMSE divided by the RMS of the reference.
+		size_t count = 0;
+	};
+
+	/**
+	 * @brief Compares count floats of a computed result against a reference.
+	 */
+	ErrorStats compare(const float* computed, const float* reference, size_t count);
+}
@@ -0,0 +1,179 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "iblcache.hpp"
+#include "utils.hpp"
+
+namespace
+{
+	const char Magic[8] = {'P', 'B', 'R', 'I', 'B', 'L', 'C', 'H'};
+	constexpr uint32_t Version = 1;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t numTextures;
+		uint64_t key;
+		uint32_t numSHCoefficients;
+		uint32_t reserved;
+	};
+
+	struct TextureHeader
+	{
+		char name[16];
+		uint32_t internalFormat, format, type;
+		int32_t width, height, depth, levels;
+		uint32_t reserved;
+	};
+
+	template<typename T>
+	void write(std::ofstream& file, const T& value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template<typename T>
+	bool read(std::ifstream& file, T& value)
+	{
+		return bool(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+
+	// Bytes left after the read position; sizes from the headers are checked against it before any allocation.
+	uint64_t remaining(std::ifstream& file, uint64_t fileSize)
+	{
+		const std::streamoff position = file.tellg();
+		return position < 0 || uint64_t(position) > fileSize ? 0 : fileSize - uint64_t(position);
+	}
+}
+
+const IBLCache::Texture* IBLCache::Contents::find(const std::string& name) const
+{
+	for(const Texture& texture : textures) {
+		if(texture.name == name) {
+			return &texture;
+		}
+	}
+	return nullptr;
+}
+
+IBLCache::IBLCache(std::string directory)
+	: m_directory(std::move(directory))
+{}
+
+std::string IBLCache::path(uint64_t key) const
+{
+	return m_directory + "/ibl-" + Utility::toHex(key) + ".bin";
+}
+
+bool IBLCache::load(uint64_t key, Contents& contents) const
+{
+	std::ifstream file{path(key), std::ios::binary | std::ios::ate};
+	if(!file.is_open()) {
+		return false;
+	}
+	const uint64_t fileSize = uint64_t(file.tellg());
+	file.seekg(0);
+
+	FileHeader header;
+	if(!read(file, header) || std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version || header.key != key) {
+		std::fprintf(stderr, "Ignoring invalid IBL cache entry: %s\n", path(key).c_str());
+		return false;
+	}
+	const uint64_t headersSize = uint64_t(header.numSHCoefficients) * sizeof(glm::vec4) + uint64_t(header.numTextures) * sizeof(TextureHeader);
+	if(headersSize > remaining(file, fileSize)) {
+		std::fprintf(stderr, "Ignoring invalid IBL cache entry: %s\n", path(key).c_str());
+		return false;
+	}
+
+	contents.irradianceSH.resize(header.numSHCoefficients);
+	if(!file.read(reinterpret_cast<char*>(contents.irradianceSH.data()), contents.irradianceSH.size() * sizeof(glm::vec4))) {
+		return false;
+	}
+
+	contents.textures.resize(header.numTextures);
+	for(Texture& texture : contents.textures) {
+		TextureHeader textureHeader;
+		if(!read(file, textureHeader)) {
+			return false;
+		}
+		if(textureHeader.levels < 0 || uint64_t(textureHeader.levels) * sizeof(uint64_t) > remaining(file, fileSize)) {
+			std::fprintf(stderr, "Ignoring invalid IBL cache entry: %s\n", path(key).c_str());
+			return false;
+		}
+		texture.name.assign(textureHeader.name, strnlen(textureHeader.name, sizeof(textureHeader.name)));
+		texture.internalFormat = textureHeader.internalFormat;
+		texture.format = textureHeader.format;
+		texture.type = textureHeader.type;
+		texture.width = textureHeader.width;
+		texture.height = textureHeader.height;
+		texture.depth = textureHeader.depth;
+		texture.levels = textureHeader.levels;
+
+		texture.mipData.resize(texture.levels);
+		for(std::vector<unsigned char>& data : texture.mipData) {
+			uint64_t size;
+			if(!read(file, size)) {
+				return false;
+			}
+			if(size > remaining(file, fileSize)) {
+				std::fprintf(stderr, "Ignoring invalid IBL cache entry: %s\n", path(key).c_str());
+				return false;
+			}
+			data.resize(size);
+			if(!file.read(reinterpret_cast<char*>(data.data()), std::streamsize(size))) {
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+void IBLCache::store(uint64_t key, const Contents& contents) const
+{
+	std::filesystem::create_directories(m_directory);
+
+	const std::string filename = path(key);
+	const std::string temporaryFilename = filename + ".tmp";
+	{
+		std::ofstream file{temporaryFilename, std::ios::binary | std::ios::trunc};
+		if(!file.is_open()) {
+			throw std::runtime_error("Could not open file for writing: " + temporaryFilename);
+		}
+
+		FileHeader header = {};
+		std::memcpy(header.magic, Magic, sizeof(Magic));
+		header.version = Version;
+		header.numTextures = uint32_t(contents.textures.size());
+		header.key = key;
+		header.numSHCoefficients = uint32_t(contents.irradianceSH.size());
+		write(file, header);
+		file.write(reinterpret_cast<const char*>(contents.irradianceSH.data()), contents.irradianceSH.size() * sizeof(glm::vec4));
+
+		for(const Texture& texture : contents.textures) {
+			TextureHeader textureHeader = {};
+			std::strncpy(textureHeader.name, texture.name.c_str(), sizeof(textureHeader.name) - 1);
+			textureHeader.internalFormat = texture.internalFormat;
+			textureHeader.format = texture.format;
+			textureHeader.type = texture.type;
+			textureHeader.width = texture.width;
+			textureHeader.height = texture.height;
+			textureHeader.depth = texture.depth;
+			textureHeader.levels = texture.levels;
+			write(file, textureHeader);
+
+			for(const std::vector<unsigned char>& data : texture.mipData) {
+				write(file, uint64_t(data.size()));
+				file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+			}
+		}
+
+		if(!file) {
+			throw std::runtime_error("Failed to write IBL cache entry: " + temporaryFilename);
+		}
+	}
+	std::filesystem::rename(temporaryFilename, filename);
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <glm/vec4.hpp>
+
+/**
+ * @brief Content-addressed on-disk cache for baked image-based lighting resources.
+ *
+ * Entries are keyed by a hash of everything that influences the bake (environment bytes, kernel
+ * sources and bake parameters), so a stale entry is never found rather than having to be invalidated.
+ */
+class IBLCache
+{
+public:
+	/**
+	 * @brief One texture with its complete mip chain, stored exactly as read back from the GPU.
+	 */
+	struct Texture
+	{
+		std::string name;
+		uint32_t internalFormat = 0;  // GL internal format used to recreate the storage.
+		uint32_t format = 0;          // GL pixel format of the stored data.
+		uint32_t type = 0;            // GL pixel type of the stored data.
+		int width = 0, height = 0;
+		int depth = 1;                // 6 for cube maps.
+		int levels = 0;
+		std::vector<std::vector<unsigned char>> mipData;
+	};
+
+	struct Contents
+	{
+		std::vector<Texture> textures;
+		std::vector<glm::vec4> irradianceSH;
+
+		const Texture* find(const std::string& name) const;
+	};
+
+	explicit IBLCache(std::string directory);
+
+	/**
+	 * @brief Loads the entry for the given key; returns false if it does not exist or cannot be read.
+	 */
+	bool load(uint64_t key, Contents& contents) const;
+
+	/**
+	 * @brief Stores an entry, replacing the file atomically so readers never see partial data.
+	 */
+	void store(uint64_t key, const Contents& contents) const;
+
+	std::string path(uint64_t key) const;
+
+private:
+	std::string m_directory;
+};
@@ -1,42 +1,540 @@
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <limits>
 #include <stdexcept>
+#include <vector>
 #include <stb_image.h>
 #include "image.hpp"
+#include "simd.hpp"
+#include "threading.hpp"
+#include "utils.hpp"
 
-Image::Image() : m_width(0), m_height(0), m_channels(0), m_hdr(false) {}
+namespace {
 
-std::shared_ptr<Image> Image::fromFile(const std::string& filename, int channels)
+// Parses the header of a binary PGM (P5) or PPM (P6) file with 8-bit samples and returns the offset of
+// its pixel data, which is stored top to bottom exactly as Image expects it; returns 0 for anything else.
+size_t parseRawPNMHeader(const unsigned char* data, size_t size, int& width, int& height, int& channels)
+{
+    if (size < 3 || data[0] != 'P' || (data[1] != '5' && data[1] != '6')) {
+        return 0;
+    }
+    channels = (data[1] == '5') ? 1 : 3;
+
+    size_t offset = 2;
+    auto readValue = [&](int& value) -> bool
+    {
+        while (offset < size) {
+            if (data[offset] == '#') {
+                while (offset < size && data[offset] != '\n') {
+                    ++offset;
+                }
+            }
+            else if (std::isspace(data[offset])) {
+                ++offset;
+            }
+            else {
+                break;
+            }
+        }
+        if (offset >= size || !std::isdigit(data[offset])) {
+            return false;
+        }
+        value = 0;
+        while (offset < size && std::isdigit(data[offset]) && value < (1 << 24)) {
+            value = value * 10 + (data[offset++] - '0');
+        }
+        return true;
+    };
+
+    int maxValue = 0;
+    if (!readValue(width) || !readValue(height) || !readValue(maxValue)) {
+        return 0;
+    }
+    // Exactly one whitespace character separates the header from the samples.
+    if (offset >= size || !std::isspace(data[offset]) || width <= 0 || height <= 0 || maxValue <= 0 || maxValue > 255) {
+        return 0;
+    }
+    ++offset;
+
+    if (size - offset < size_t(width) * height * channels) {
+        return 0;
+    }
+    return offset;
+}
+
+// Rounds count floats to IEEE half floats, SIMD::Width per instruction (F16C where the build has it).
+void convertToHalf(const float* source, uint16_t* destination, size_t count)
+{
+    size_t i = 0;
+    for (; i + SIMD::Width <= count; i += SIMD::Width) {
+        SIMD::storeHalf(SIMD::Float::load(source + i), destination + i);
+    }
+    for (; i < count; ++i) {
+        destination[i] = SIMD::toHalf(source[i]);
+    }
+}
+
+// Reads one RGBE scanline, either run-length encoded per component or flat, into planar R, G, B and E rows
+// of width bytes each, and returns the position after it. With a null destination it is only skipped.
+const unsigned char* readScanline(const unsigned char* p, const unsigned char* end, int width, unsigned char* planar)
+{
+    const bool encoded = width >= 8 && width < 32768 && end - p >= 4 && p[0] == 2 && p[1] == 2 && (p[2] & 0x80) == 0;
+    if (!encoded) {
+        if (size_t(end - p) < size_t(width) * 4) {
+            throw std::runtime_error("Truncated RGBE scanline");
+        }
+        if (planar) {
+            for (int x = 0; x < width; ++x) {
+                for (int c = 0; c < 4; ++c) {
+                    planar[size_t(c) * width + x] = p[size_t(x) * 4 + c];
+                }
+            }
+        }
+        return p + size_t(width) * 4;
+    }
+
+    if (((p[2] << 8) | p[3]) != width) {
+        throw std::runtime_error("Invalid RGBE scanline width");
+    }
+    p += 4;
+    for (int c = 0; c < 4; ++c) {
+        unsigned char* row = planar ? planar + size_t(c) * width : nullptr;
+        for (int x = 0; x < width; ) {
+            if (p >= end) {
+                throw std::runtime_error("Truncated RGBE scanline");
+            }
+            int count = *p++;
+            if (count > 128) {
+                // Run of one value.
+                count -= 128;
+                if (count > width - x || p >= end) {
+                    throw std::runtime_error("Invalid RGBE run");
+                }
+                if (row) {
+                    std::memset(row + x, *p, size_t(count));
+                }
+                ++p;
+            }
+            else {
+                // Literal values.
+                if (count == 0 || count > width - x || end - p < count) {
+                    throw std::runtime_error("Invalid RGBE run");
+                }
+                if (row) {
+                    std::memcpy(row + x, p, size_t(count));
+                }
+                p += count;
+            }
+            x += count;
+        }
+    }
+    return p;
+}
+
+// 2^(e - 136) for every RGBE exponent byte (0 for e = 0), as stb_image computes it.
+struct ExponentTable
+{
+    float scale[256];
+
+    ExponentTable()
+    {
+        scale[0] = 0.0f;
+        for (int e = 1; e < 256; ++e) {
+            scale[e] = static_cast<float>(std::ldexp(1.0f, e - 136));
+        }
+    }
+};
+
+const ExponentTable Exponents;
+
+// RGB9E5 stores m9 * 2^(e5 - 24). With m9 = 2 * m8 the RGBE exponent maps to e5 = e - 113; exponents
+// outside [0, 31] shift the mantissas (rounded) or saturate them.
+uint32_t toRGB9E5(unsigned r, unsigned g, unsigned b, int e)
+{
+    if (e == 0) {
+        return 0;
+    }
+    int sharedExponent = e - 113;
+    unsigned m[3] = {r << 1, g << 1, b << 1};
+    if (sharedExponent < 0) {
+        const int shift = -sharedExponent;
+        for (unsigned& value : m) {
+            value = shift > 9 ? 0 : std::min((value + (1u << (shift - 1))) >> shift, 511u);
+        }
+        sharedExponent = 0;
+    }
+    else if (sharedExponent > 31) {
+        for (unsigned& value : m) {
+            value = value ? 511u : 0u;
+        }
+        sharedExponent = 31;
+    }
+    return m[0] | (m[1] << 9) | (m[2] << 18) | (uint32_t(sharedExponent) << 27);
+}
+
+// Converts one planar scanline to interleaved pixels of the requested format.
+void convertScanline(const unsigned char* planar, int width, RGBEDecoder::Format format, int channels, unsigned char* destination)
+{
+    const unsigned char* R = planar;
+    const unsigned char* G = planar + width;
+    const unsigned char* B = planar + 2 * size_t(width);
+    const unsigned char* E = planar + 3 * size_t(width);
+
+    if (format == RGBEDecoder::Format::RGB9E5) {
+        uint32_t* out = reinterpret_cast<uint32_t*>(destination);
+        for (int x = 0; x < width; ++x) {
+            out[x] = toRGB9E5(R[x], G[x], B[x], E[x]);
+        }
+        return;
+    }
+
+    int x = 0;
+    float* outFloat = reinterpret_cast<float*>(destination);
+    uint16_t* outHalf = reinterpret_cast<uint16_t*>(destination);
+    // SIMD::Width pixels at a time: widen the mantissas, look up the exponent scales (one gather with AVX2),
+    // multiply, then interleave.
+    alignas(32) float rgb[3][SIMD::Width];
+    alignas(16) uint16_t halves[3][SIMD::Width];
+    for (; x + SIMD::Width <= width; x += SIMD::Width) {
+#if defined(__AVX2__)
+        const SIMD::Float scale = _mm256_i32gather_ps(Exponents.scale, _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(E + x))), 4);
+#else
+        alignas(32) float scales[SIMD::Width];
+        for (int i = 0; i < SIMD::Width; ++i) {
+            scales[i] = Exponents.scale[E[x + i]];
+        }
+        const SIMD::Float scale = SIMD::Float::load(scales);
+#endif
+        const unsigned char* components[3] = {R + x, G + x, B + x};
+        for (int c = 0; c < 3; ++c) {
+            const SIMD::Float value = SIMD::Float::loadBytes(components[c]) * scale;
+            if (format == RGBEDecoder::Format::Half) {
+                SIMD::storeHalf(value, halves[c]);
+            }
+            else {
+                value.store(rgb[c]);
+            }
+        }
+        for (int i = 0; i < SIMD::Width; ++i) {
+            const size_t index = size_t(x + i) * channels;
+            if (format == RGBEDecoder::Format::Half) {
+                outHalf[index + 0] = halves[0][i];
+                outHalf[index + 1] = halves[1][i];
+                outHalf[index + 2] = halves[2][i];
+                if (channels == 4) {
+                    outHalf[index + 3] = 0x3C00;
+                }
+            }
+            else {
+                outFloat[index + 0] = rgb[0][i];
+                outFloat[index + 1] = rgb[1][i];
+                outFloat[index + 2] = rgb[2][i];
+                if (channels == 4) {
+                    outFloat[index + 3] = 1.0f;
+                }
+            }
+        }
+    }
+    for (; x < width; ++x) {
+        const float scale = Exponents.scale[E[x]];
+        const float value[4] = {R[x] * scale, G[x] * scale, B[x] * scale, 1.0f};
+        for (int c = 0; c < channels; ++c) {
+            if (format == RGBEDecoder::Format::Half) {
+                convertToHalf(&value[c], &outHalf[size_t(x) * channels + c], 1);
+            }
+            else {
+                outFloat[size_t(x) * channels + c] = value[c];
+            }
+        }
+    }
+}
+
+} // namespace
+
+Image::Image() : m_width(0), m_height(0), m_channels(0), m_hdr(false), m_halfFloat(false), m_borrowed(false), m_pixels(nullptr) {}
+
+std::shared_ptr<Image> Image::fromFile(const std::string& filename, int channels, bool halfFloat)
 {
     std::printf("Loading image: %s\n", filename.c_str());
 
+    std::shared_ptr<FileUtility::MappedFile> file = std::make_shared<FileUtility::MappedFile>(filename);
+
+    // Already raw: hand out the mapped samples directly, the pages are only read when they are touched.
+    int width, height, fileChannels;
+    const size_t dataOffset = parseRawPNMHeader(file->data(), file->size(), width, height, fileChannels);
+    if (dataOffset > 0 && (channels == 0 || channels == fileChannels)) {
+        std::shared_ptr<Image> image = std::make_shared<Image>();
+        image->m_width = width;
+        image->m_height = height;
+        image->m_channels = fileChannels;
+        image->m_borrowed = true;
+        image->m_pixels = file->data() + dataOffset;
+        image->m_storage = file;
+        return image;
+    }
+
+    std::shared_ptr<Image> image = fromMemory(file->data(), file->size(), channels, halfFloat);
+    if (!image) {
+        throw std::runtime_error("Failed to load image file: " + filename);
+    }
+    return image;
+}
+
+std::shared_ptr<Image> Image::fromMemory(const unsigned char* data, size_t size, int channels, bool halfFloat)
+{
+    if (size > size_t(std::numeric_limits<int>::max())) {
+        return nullptr;
+    }
+    const int length = static_cast<int>(size);
+
     std::shared_ptr<Image> image = std::make_shared<Image>();
 
-    // Check if the image is HDR
-    if (stbi_is_hdr(filename.c_str())) {
-        // Load HDR image using stbi_loadf
-        float* pixels = stbi_loadf(filename.c_str(), &image->m_width, &image->m_height, &image->m_channels, channels);
-        if (pixels) {
-            image->m_pixels.reset(reinterpret_cast<unsigned char*>(pixels));
-            image->m_hdr = true;
-        }
-    } 
+    // Radiance files are decoded by RGBEDecoder straight into the final float or half pixels, on all cores.
+    const int hdrChannels = channels > 0 ? channels : 3;
+    if (RGBEDecoder::isRGBE(data, size) && (hdrChannels == 3 || hdrChannels == 4)) {
+        const RGBEDecoder decoder{data, size};
+        const RGBEDecoder::Format format = halfFloat ? RGBEDecoder::Format::Half : RGBEDecoder::Format::Float;
+        std::shared_ptr<unsigned char> pixels{new unsigned char[size_t(decoder.width()) * decoder.height() * RGBEDecoder::bytesPerPixel(format, hdrChannels)],
+                                              std::default_delete<unsigned char[]>()};
+        decoder.decode(format, hdrChannels, pixels.get());
+
+        image->m_width = decoder.width();
+        image->m_height = decoder.height();
+        image->m_channels = hdrChannels;
+        image->m_hdr = true;
+        image->m_halfFloat = halfFloat;
+        image->m_pixels = pixels.get();
+        image->m_storage = pixels;
+        return image;
+    }
+
+    void* pixels = nullptr;
+    if (stbi_is_hdr_from_memory(data, length)) {
+        pixels = stbi_loadf_from_memory(data, length, &image->m_width, &image->m_height, &image->m_channels, channels);
+        image->m_hdr = true;
+    }
     else {
-        // Load regular image using stbi_load
-        unsigned char* pixels = stbi_load(filename.c_str(), &image->m_width, &image->m_height, &image->m_channels, channels);
-        if (pixels) {
-            image->m_pixels.reset(pixels);
-            image->m_hdr = false;
-        }
+        pixels = stbi_load_from_memory(data, length, &image->m_width, &image->m_height, &image->m_channels, channels);
+        image->m_hdr = false;
     }
+    if (!pixels) {
+        return nullptr;
+    }
+    image->m_pixels = static_cast<const unsigned char*>(pixels);
+    image->m_storage = std::shared_ptr<void>(pixels, stbi_image_free);
 
     // Override channel count if channels argument is provided
     if (channels > 0) {
         image->m_channels = channels;
     }
 
-    // Check if the image has been successfully loaded
-    if (!image->m_pixels) {
-        throw std::runtime_error("Failed to load image file: " + filename);
+    // Convert the decoded floats in row bands across the pool; the float buffer is released right after.
+    if (image->m_hdr && halfFloat) {
+        const size_t rowLength = size_t(image->m_width) * image->m_channels;
+        std::shared_ptr<uint16_t> halves{new uint16_t[rowLength * image->m_height], std::default_delete<uint16_t[]>()};
+        const float* source = image->pixels<float>();
+        ThreadPool::instance().parallelFor(size_t(image->m_height), [&](size_t y) {
+            convertToHalf(source + y * rowLength, halves.get() + y * rowLength, rowLength);
+        });
+        image->m_pixels = reinterpret_cast<const unsigned char*>(halves.get());
+        image->m_storage = halves;
+        image->m_halfFloat = true;
     }
-
     return image;
 }
+
+void Image::writePNM(const std::string& filename, int width, int height, int channels, const unsigned char* pixels)
+{
+    if (channels != 1 && channels != 3) {
+        throw std::invalid_argument("PNM files hold 1 or 3 channels");
+    }
+
+    std::unique_ptr<std::FILE, int(*)(std::FILE*)> file{std::fopen(filename.c_str(), "wb"), std::fclose};
+    if (!file) {
+        throw std::runtime_error("Could not open file for writing: " + filename);
+    }
+
+    std::fprintf(file.get(), "P%d\n%d %d\n255\n", channels == 1 ? 5 : 6, width, height);
+    const size_t size = size_t(width) * height * channels;
+    if (std::fwrite(pixels, 1, size, file.get()) != size) {
+        throw std::runtime_error("Failed to write file: " + filename);
+    }
+}
+
+void Image::writeHDR(const std::string& filename, int width, int height, int channels, const float* pixels)
+{
+    std::unique_ptr<std::FILE, int(*)(std::FILE*)> file{std::fopen(filename.c_str(), "wb"), std::fclose};
+    if (!file) {
+        throw std::runtime_error("Could not open file for writing: " + filename);
+    }
+
+    std::fprintf(file.get(), "#?RADIANCE\nFORMAT=32-bit_rle_rgbe\n\n-Y %d +X %d\n", height, width);
+
+    // Scanlines are run-length encoded (as literal runs only) whenever the format allows it,
+    // since a flat scanline starting with bytes 2,2 would be misread as an RLE header.
+    const bool encodeRLE = width >= 8 && width < 32768;
+
+    std::vector<unsigned char> rgbe(size_t(width) * 4);
+    for (int y = 0; y < height; ++y) {
+        for (int x = 0; x < width; ++x) {
+            const float* p = pixels + (size_t(y) * width + x) * channels;
+            const float r = p[0];
+            const float g = channels > 1 ? p[1] : r;
+            const float b = channels > 2 ? p[2] : (channels > 1 ? 0.0f : r);
+            const float v = std::fmax(r, std::fmax(g, b));
+
+            unsigned char* texel = &rgbe[size_t(x) * 4];
+            if (v < 1e-32f) {
+                texel[0] = texel[1] = texel[2] = texel[3] = 0;
+            }
+            else {
+                int exponent;
+                const float scale = std::frexp(v, &exponent) * 256.0f / v;
+                texel[0] = static_cast<unsigned char>(std::fmax(r, 0.0f) * scale);
+                texel[1] = static_cast<unsigned char>(std::fmax(g, 0.0f) * scale);
+                texel[2] = static_cast<unsigned char>(std::fmax(b, 0.0f) * scale);
+                texel[3] = static_cast<unsigned char>(exponent + 128);
+            }
+        }
+
+        if (!encodeRLE) {
+            std::fwrite(rgbe.data(), 1, rgbe.size(), file.get());
+            continue;
+        }
+
+        const unsigned char header[4] = {2, 2, static_cast<unsigned char>(width >> 8), static_cast<unsigned char>(width & 0xFF)};
+        std::fwrite(header, 1, 4, file.get());
+        for (int component = 0; component < 4; ++component) {
+            for (int x = 0; x < width; ) {
+                const int count = std::min(width - x, 128);
+                std::fputc(count, file.get());
+                for (int i = 0; i < count; ++i) {
+                    std::fputc(rgbe[size_t(x + i) * 4 + component], file.get());
+                }
+                x += count;
+            }
+        }
+    }
+}
+
+RGBEDecoder::RGBEDecoder(const unsigned char* data, size_t size) : m_data(data), m_size(size)
+{
+    if (!isRGBE(data, size)) {
+        throw std::runtime_error("Not a Radiance RGBE file");
+    }
+
+    // Header lines up to an empty line, then the resolution; only the usual top-down orientation is supported.
+    size_t offset = 0;
+    auto readLine = [&]() -> std::string {
+        const size_t begin = offset;
+        while (offset < size && data[offset] != '\n') {
+            ++offset;
+        }
+        if (offset >= size) {
+            throw std::runtime_error("Truncated RGBE header");
+        }
+        return std::string(reinterpret_cast<const char*>(data) + begin, offset++ - begin);
+    };
+
+    bool validFormat = false;
+    for (std::string line = readLine(); !line.empty(); line = readLine()) {
+        if (line == "FORMAT=32-bit_rle_rgbe") {
+            validFormat = true;
+        }
+        else if (line.compare(0, 7, "FORMAT=") == 0) {
+            throw std::runtime_error("Unsupported RGBE format: " + line.substr(7));
+        }
+    }
+    if (!validFormat) {
+        throw std::runtime_error("Unsupported RGBE format");
+    }
+    const std::string resolution = readLine();
+    if (std::sscanf(resolution.c_str(), "-Y %d +X %d", &m_height, &m_width) != 2 || m_width <= 0 || m_height <= 0 ||
+        m_width > (1 << 24) || m_height > (1 << 24)) {
+        throw std::runtime_error("Unsupported RGBE resolution: " + resolution);
+    }
+
+    // Scanlines vary in length, so locate all of them once; skipping only reads the run headers.
+    m_rowOffsets.resize(size_t(m_height) + 1);
+    const unsigned char* p = data + offset;
+    for (int y = 0; y < m_height; ++y) {
+        m_rowOffsets[y] = size_t(p - data);
+        p = readScanline(p, data + size, m_width, nullptr);
+    }
+    m_rowOffsets[m_height] = size_t(p - data);
+}
+
+bool RGBEDecoder::isRGBE(const unsigned char* data, size_t size)
+{
+    static const char* const Signatures[] = {"#?RADIANCE\n", "#?RGBE\n"};
+    for (const char* signature : Signatures) {
+        const size_t length = std::strlen(signature);
+        if (size >= length && std::memcmp(data, signature, length) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+size_t RGBEDecoder::bytesPerPixel(Format format, int channels)
+{
+    switch (format) {
+    case Format::Float:
+        return sizeof(float) * channels;
+    case Format::Half:
+        return sizeof(uint16_t) * channels;
+    default:
+        return sizeof(uint32_t);
+    }
+}
+
+void RGBEDecoder::decodeRows(int firstRow, int numRows, Format format, int channels, void* destination) const
+{
+    if (format == Format::RGB9E5 ? channels != 3 : (channels != 3 && channels != 4)) {
+        throw std::invalid_argument("Unsupported channel count for RGBE decoding");
+    }
+
+    const size_t pitch = size_t(m_width) * bytesPerPixel(format, channels);
+    std::vector<unsigned char> planar(size_t(m_width) * 4);
+    for (int y = firstRow; y < firstRow + numRows; ++y) {
+        readScanline(m_data + m_rowOffsets[y], m_data + m_size, m_width, planar.data());
+        convertScanline(planar.data(), m_width, format, channels, static_cast<unsigned char*>(destination) + size_t(y - firstRow) * pitch);
+    }
+}
+
+void RGBEDecoder::decode(Format format, int channels, void* destination) const
+{
+    constexpr int RowsPerBlock = 16;
+    const size_t pitch = size_t(m_width) * bytesPerPixel(format, channels);
+    const size_t numBlocks = (size_t(m_height) + RowsPerBlock - 1) / RowsPerBlock;
+    ThreadPool::instance().parallelFor(numBlocks, [&](size_t block) {
+        const int firstRow = int(block) * RowsPerBlock;
+        decodeRows(firstRow, std::min(RowsPerBlock, m_height - firstRow), format, channels,
+                   static_cast<unsigned char*>(destination) + size_t(firstRow) * pitch);
+    });
+}
+
+void RGBEDecoder::stream(Format format, int channels, int rowsPerBlock,
+                         const std::function<void(int firstRow, int numRows, const void* pixels)>& sink) const
+{
+    ThreadPool& pool = ThreadPool::instance();
+    rowsPerBlock = std::max(rowsPerBlock, 1);
+    const size_t blockBytes = size_t(rowsPerBlock) * m_width * bytesPerPixel(format, channels);
+
+    // One buffer per thread: a group of blocks is decoded in parallel, then handed to the sink in order.
+    std::vector<std::vector<unsigned char>> buffers(pool.concurrency(), std::vector<unsigned char>(blockBytes));
+    for (int groupRow = 0; groupRow < m_height; groupRow += rowsPerBlock * int(buffers.size())) {
+        const size_t numBlocks = std::min(buffers.size(), size_t((m_height - groupRow + rowsPerBlock - 1) / rowsPerBlock));
+        pool.parallelFor(numBlocks, [&](size_t block) {
+            const int firstRow = groupRow + int(block) * rowsPerBlock;
+            decodeRows(firstRow, std::min(rowsPerBlock, m_height - firstRow), format, channels, buffers[block].data());
+        });
+        for (size_t block = 0; block < numBlocks; ++block) {
+            const int firstRow = groupRow + int(block) * rowsPerBlock;
+            sink(firstRow, std::min(rowsPerBlock, m_height - firstRow), buffers[block].data());
+        }
+    }
+}
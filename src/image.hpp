@@ -1,27 +1,45 @@
 #pragma once
 
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
+#include <type_traits>
+#include <vector>
 
 class Image
 {
 public:
-	static std::shared_ptr<Image> fromFile(const std::string& filename, int channels=4);
+	// Decodes from a memory mapping of the file. Binary PGM/PPM files whose samples already match the
+	// requested layout are not decoded at all: the image borrows its pixels from the mapping.
+	// With halfFloat, HDR pixels are converted to 16-bit floats as part of the decode.
+	static std::shared_ptr<Image> fromFile(const std::string& filename, int channels=4, bool halfFloat=false);
+	static std::shared_ptr<Image> fromMemory(const unsigned char* data, size_t size, int channels=4, bool halfFloat=false);
+
+	// Writes floating point pixels (1 to 4 channels, only RGB is stored) as a Radiance RGBE file.
+	static void writeHDR(const std::string& filename, int width, int height, int channels, const float* pixels);
+
+	// Writes 8-bit grayscale (1 channel) or RGB (3 channels) pixels as a binary PGM/PPM file, which fromFile maps without decoding.
+	static void writePNM(const std::string& filename, int width, int height, int channels, const unsigned char* pixels);
 
 	int width() const { return m_width; }
 	int height() const { return m_height; }
 	int channels() const { return m_channels; }
-	int bytesPerPixel() const { return m_channels * (m_hdr ? sizeof(float) : sizeof(unsigned char)); }
+	int bytesPerPixel() const { return m_channels * (m_hdr ? (m_halfFloat ? sizeof(uint16_t) : sizeof(float)) : sizeof(unsigned char)); }
 	int pitch() const { return m_width * bytesPerPixel(); }
 
 	bool isHDR() const { return m_hdr; }
+	// HDR pixels stored as IEEE half floats (read them as uint16_t).
+	bool isHalfFloat() const { return m_halfFloat; }
+	// True when the pixels point into a mapped file rather than a decoded copy.
+	bool isBorrowed() const { return m_borrowed; }
 
 	template<typename T>
 	const T* pixels() const
 	{
-		static_assert(std::is_same<T, unsigned char>::value || std::is_same<T, float>::value, 
-                      "Image::pixels can only return unsigned char or float");
-		return reinterpret_cast<const T*>(m_pixels.get());
+		static_assert(std::is_same<T, unsigned char>::value || std::is_same<T, float>::value || std::is_same<T, uint16_t>::value,
+                      "Image::pixels can only return unsigned char, float or uint16_t (half float)");
+		return reinterpret_cast<const T*>(m_pixels);
 	}
 
 	Image();
@@ -31,5 +49,50 @@ private:
 	int m_height;
 	int m_channels;
 	bool m_hdr;
-	std::unique_ptr<unsigned char[]> m_pixels;  // Changed to unique_ptr to an array
+	bool m_halfFloat;
+	bool m_borrowed;
+	const unsigned char* m_pixels;
+	std::shared_ptr<const void> m_storage;  // Keeps m_pixels alive: the decoder's allocation or the mapped file.
+};
+
+// Decoder for Radiance RGBE (.hdr) files, independent of stb_image: decodes run-length encoded scanlines
+// straight into 32-bit float, half float or RGB9E5 pixels, without a full-size float intermediate.
+// Scanlines are located once when the decoder is created, so any block of rows can be decoded on its own,
+// in parallel or streamed through a few rows of memory.
+class RGBEDecoder
+{
+public:
+	enum class Format
+	{
+		Float,   // 32-bit floats, 3 or 4 channels (alpha 1), bit-identical to stbi_loadf.
+		Half,    // IEEE half floats, 3 or 4 channels.
+		RGB9E5,  // One uint32 per pixel in the GL_UNSIGNED_INT_5_9_9_9_REV layout, converted without floats.
+	};
+
+	// Parses the header and indexes the scanlines; the data must stay valid while the decoder is used.
+	RGBEDecoder(const unsigned char* data, size_t size);
+
+	static bool isRGBE(const unsigned char* data, size_t size);
+	static size_t bytesPerPixel(Format format, int channels);
+
+	int width() const { return m_width; }
+	int height() const { return m_height; }
+
+	// Decodes rows [firstRow, firstRow + numRows) into tightly packed pixels; safe to call concurrently.
+	void decodeRows(int firstRow, int numRows, Format format, int channels, void* destination) const;
+
+	// Decodes the whole image into tightly packed pixels, in blocks of rows across the thread pool.
+	void decode(Format format, int channels, void* destination) const;
+
+	// Decodes blocks of rowsPerBlock rows in parallel and passes them to sink in order on the calling thread,
+	// so at most one block per thread is held in memory.
+	void stream(Format format, int channels, int rowsPerBlock,
+				const std::function<void(int firstRow, int numRows, const void* pixels)>& sink) const;
+
+private:
+	const unsigned char* m_data;
+	size_t m_size;
+	int m_width = 0;
+	int m_height = 0;
+	std::vector<size_t> m_rowOffsets;  // Start of every scanline, plus the end of the last one.
 };
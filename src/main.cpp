@@ -1,4 +1,6 @@
 #include <cstdio>
+#include <cstdlib>
+#include <cstring>
 #include <string>
 #include <memory>
 
@@ -7,9 +9,100 @@
 #include "openglUtility.hpp"
 
 
+static RendererSettings parseSettings(int argc, char* argv[])
+{
+    RendererSettings settings;
+    std::vector<std::string> environments;
+    for(int i=1; i<argc; ++i) {
+        if(std::strcmp(argv[i], "--dump-ibl") == 0 && i + 1 < argc) {
+            settings.iblDumpDirectory = argv[++i];
+        }
+        else if(std::strcmp(argv[i], "--no-ibl-cache") == 0) {
+            settings.iblCache = false;
+        }
+        else if(std::strcmp(argv[i], "--irradiance") == 0 && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if(mode == "cubemap")     settings.irradianceMode = IrradianceMode::Cubemap;
+            else if(mode == "sh")     settings.irradianceMode = IrradianceMode::SHCompute;
+            else if(mode == "sh-cpu") settings.irradianceMode = IrradianceMode::SHCPU;
+            else std::fprintf(stderr, "Unknown irradiance mode: %s\n", mode.c_str());
+        }
+        else if(std::strcmp(argv[i], "--irradiance-sampling") == 0 && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if(mode == "filtered")     settings.filteredIrradiance = true;
+            else if(mode == "uniform") settings.filteredIrradiance = false;
+            else std::fprintf(stderr, "Unknown irradiance sampling mode: %s\n", mode.c_str());
+        }
+        else if(std::strcmp(argv[i], "--brdf") == 0 && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if(mode == "embedded")      settings.brdfMode = BRDFMode::Embedded;
+            else if(mode == "compute")  settings.brdfMode = BRDFMode::Compute;
+            else if(mode == "analytic") settings.brdfMode = BRDFMode::Analytic;
+            else std::fprintf(stderr, "Unknown BRDF mode: %s\n", mode.c_str());
+        }
+        else if(std::strcmp(argv[i], "--spmap") == 0 && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if(mode == "tiled")       settings.prefilterMode = SpecularPrefilterMode::Tiled;
+            else if(mode == "single") settings.prefilterMode = SpecularPrefilterMode::SingleDispatch;
+            else std::fprintf(stderr, "Unknown spmap mode: %s\n", mode.c_str());
+        }
+        else if(std::strcmp(argv[i], "--texture-mips") == 0 && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if(mode == "driver")       settings.textureMipmaps = TextureMipmapMode::Driver;
+            else if(mode == "box")     settings.textureMipmaps = TextureMipmapMode::Box;
+            else if(mode == "kaiser")  settings.textureMipmaps = TextureMipmapMode::Kaiser;
+            else if(mode == "lanczos") settings.textureMipmaps = TextureMipmapMode::Lanczos;
+            else std::fprintf(stderr, "Unknown texture mipmap mode: %s\n", mode.c_str());
+        }
+        else if(std::strcmp(argv[i], "--texture-compression") == 0 && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if(mode == "bc")        settings.compressTextures = true;
+            else if(mode == "none") settings.compressTextures = false;
+            else std::fprintf(stderr, "Unknown texture compression mode: %s\n", mode.c_str());
+        }
+        else if(std::strcmp(argv[i], "--texture-upload-budget") == 0 && i + 1 < argc) {
+            settings.textureUploadBudgetMB = std::atof(argv[++i]);
+        }
+        else if(std::strcmp(argv[i], "--upload-ring") == 0 && i + 1 < argc) {
+            settings.uploadRingMB = size_t(std::atoll(argv[++i]));
+        }
+        else if(std::strcmp(argv[i], "--vertex-format") == 0 && i + 1 < argc) {
+            const std::string mode = argv[++i];
+            if(mode == "packed")     settings.packedVertices = true;
+            else if(mode == "float") settings.packedVertices = false;
+            else std::fprintf(stderr, "Unknown vertex format: %s\n", mode.c_str());
+        }
+        else if(std::strcmp(argv[i], "--lod-error") == 0 && i + 1 < argc) {
+            settings.lodErrorPixels = std::atof(argv[++i]);
+        }
+        else if(std::strcmp(argv[i], "--environment") == 0 && i + 1 < argc) {
+            environments.push_back(argv[++i]);
+        }
+        else if(std::strcmp(argv[i], "--bake-budget") == 0 && i + 1 < argc) {
+            settings.bakeBudgetMilliseconds = std::atof(argv[++i]);
+        }
+        else if(std::strcmp(argv[i], "--rotate-environments") == 0 && i + 1 < argc) {
+            settings.environmentRotationSeconds = std::atof(argv[++i]);
+        }
+        else if(std::strcmp(argv[i], "--environment-budget") == 0 && i + 1 < argc) {
+            settings.environmentBudgetMB = size_t(std::atoll(argv[++i]));
+        }
+        else if(std::strcmp(argv[i], "--preload-environments") == 0) {
+            settings.preloadEnvironments = true;
+        }
+        else {
+            std::fprintf(stderr, "Ignoring unknown argument: %s\n", argv[i]);
+        }
+    }
+    if(!environments.empty()) {
+        settings.environments = environments;
+    }
+    return settings;
+}
+
 int main(int argc, char* argv[])
 {
-    RendererInterface* renderer = new Renderer;
+    RendererInterface* renderer = new Renderer{parseSettings(argc, argv)};
 
     try {
         Application().run(std::unique_ptr<RendererInterface>{renderer});
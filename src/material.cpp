@@ -0,0 +1,143 @@
+#include <cctype>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "image.hpp"
+#include "material.hpp"
+
+namespace
+{
+	// Suffixes tried in order for every map, as exported by the common texturing tools.
+	const char* const PackedSuffixes[] = {"ORM.png", "OcclusionRoughnessMetallic.png"};
+	const char* const OcclusionSuffixes[] = {"AmbientOcclusion.png", "Occlusion.png", "AO.png"};
+	const char* const RoughnessSuffixes[] = {"Roughness.png"};
+	const char* const MetalnessSuffixes[] = {"Metallic.png", "Metalness.png"};
+
+	// Map names as they end the file name (lower case), checked in order. A name must be the whole stem or start a
+	// word, after a separator or at a lower-to-upper case change, so "ao" does not match "Cacao" nor "orm" "Storm".
+	const char* const NormalMapNames[] = {"normal"};
+	const char* const PackedNames[] = {"occlusionroughnessmetallic", "orm"};
+	const char* const ScalarNames[] = {"roughness", "metallic", "metalness", "occlusion", "ao", "height", "displacement"};
+
+	template<size_t N>
+	std::string findFile(const std::string& prefix, const char* const (&suffixes)[N])
+	{
+		for(const char* suffix : suffixes) {
+			if(std::filesystem::exists(prefix + suffix)) {
+				return prefix + suffix;
+			}
+		}
+		return {};
+	}
+
+	template<size_t N>
+	bool endsWithName(const std::string& stem, const char* const (&names)[N])
+	{
+		for(const std::string name : names) {
+			if(stem.size() < name.size()) {
+				continue;
+			}
+			const unsigned char* tail = reinterpret_cast<const unsigned char*>(stem.data()) + stem.size() - name.size();
+			bool matches = true;
+			for(size_t i=0; i<name.size(); ++i) {
+				matches = matches && std::tolower(tail[i]) == name[i];
+			}
+			const bool separated = tail == reinterpret_cast<const unsigned char*>(stem.data()) || !std::isalnum(tail[-1]);
+			const bool caseChange = !separated && std::isupper(tail[0]) && !std::isupper(tail[-1]);
+			if(matches && (separated || caseChange)) {
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+namespace Material
+{
+	std::string packORM(const std::string& prefix)
+	{
+		const std::string packedFile = findFile(prefix, PackedSuffixes);
+		if(!packedFile.empty()) {
+			return packedFile;
+		}
+
+		const std::string occlusionFile = findFile(prefix, OcclusionSuffixes);
+		const std::string roughnessFile = findFile(prefix, RoughnessSuffixes);
+		const std::string metalnessFile = findFile(prefix, MetalnessSuffixes);
+		if(roughnessFile.empty() || metalnessFile.empty()) {
+			throw std::runtime_error("Material has no roughness or metalness map: " + prefix);
+		}
+
+		const std::string outputFile = prefix + "ORM.ppm";
+		if(std::filesystem::exists(outputFile)) {
+			const auto packedTime = std::filesystem::last_write_time(outputFile);
+			bool upToDate = true;
+			for(const std::string& source : {occlusionFile, roughnessFile, metalnessFile}) {
+				if(!source.empty() && std::filesystem::last_write_time(source) > packedTime) {
+					upToDate = false;
+				}
+			}
+			if(upToDate) {
+				return outputFile;
+			}
+		}
+
+		const std::shared_ptr<Image> roughness = Image::fromFile(roughnessFile, 1);
+		const std::shared_ptr<Image> metalness = Image::fromFile(metalnessFile, 1);
+		const std::shared_ptr<Image> occlusion = occlusionFile.empty() ? nullptr : Image::fromFile(occlusionFile, 1);
+
+		const int width = roughness->width(), height = roughness->height();
+		for(const std::shared_ptr<Image>& map : {metalness, occlusion}) {
+			if(map && (map->width() != width || map->height() != height)) {
+				throw std::runtime_error("Material maps must have the same size: " + prefix);
+			}
+		}
+
+		const size_t numPixels = size_t(width) * height;
+		std::vector<unsigned char> packed(numPixels * 3);
+		for(size_t i=0; i<numPixels; ++i) {
+			packed[i * 3 + 0] = occlusion ? occlusion->pixels<unsigned char>()[i] : 255;
+			packed[i * 3 + 1] = roughness->pixels<unsigned char>()[i];
+			packed[i * 3 + 2] = metalness->pixels<unsigned char>()[i];
+		}
+
+		// Written under a temporary name and renamed into place: a partial file would otherwise pass the timestamp check.
+		const std::string temporaryFile = outputFile + ".tmp";
+		Image::writePNM(temporaryFile, width, height, 3, packed.data());
+		std::filesystem::rename(temporaryFile, outputFile);
+		std::printf("Packed material texture: %s\n", outputFile.c_str());
+		return outputFile;
+	}
+
+	TextureSettings textureSettings(const std::string& filename, Mipmaps::Filter filter, bool compress)
+	{
+		const std::string stem = std::filesystem::path(filename).stem().string();
+
+		TextureSettings settings;
+		settings.mipmaps.filter = filter;
+		if(endsWithName(stem, NormalMapNames)) {
+			settings.mipmaps.content = Mipmaps::Content::NormalMap;
+			settings.mipmaps.compression = BlockCompression::Format::BC5;
+		}
+		else if(endsWithName(stem, PackedNames)) {
+			settings.mipmaps.content = Mipmaps::Content::Linear;
+			settings.mipmaps.compression = BlockCompression::Format::BC7;
+		}
+		else if(endsWithName(stem, ScalarNames)) {
+			settings.channels = 1;
+			settings.mipmaps.content = Mipmaps::Content::Linear;
+			settings.mipmaps.compression = BlockCompression::Format::BC4;
+		}
+		else {
+			settings.mipmaps.content = Mipmaps::Content::SRGB;
+			settings.mipmaps.compression = BlockCompression::Format::BC7;
+		}
+		if(!compress) {
+			settings.mipmaps.compression = BlockCompression::Format::None;
+		}
+		return settings;
+	}
+}
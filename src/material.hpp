@@ -0,0 +1,36 @@
+#pragma once
+
+#include <string>
+
+#include "mipmaps.hpp"
+
+// Asset pipeline steps for the material textures.
+namespace Material
+{
+	/**
+	 * @brief Returns the texture holding ambient occlusion (R), roughness (G) and metalness (B) of a material,
+	 * the glTF channel layout, so the shader reads all three with one fetch.
+	 *
+	 * Textures are looked up by the material's file name prefix. A packed texture that comes with the material
+	 * (<prefix>ORM.png or <prefix>OcclusionRoughnessMetallic.png) is used as it is. Otherwise the separate
+	 * <prefix>Roughness.png, <prefix>Metallic.png and, if present, <prefix>AmbientOcclusion.png maps are packed
+	 * into <prefix>ORM.ppm, which is rebuilt whenever one of them is newer. Missing occlusion is white.
+	 */
+	std::string packORM(const std::string& prefix);
+
+	/**
+	 * @brief How a material texture is converted for the GPU.
+	 */
+	struct TextureSettings
+	{
+		int channels = 3;
+		Mipmaps::Settings mipmaps;
+	};
+
+	/**
+	 * @brief Chooses the settings of a texture from the map name at the end of its file name: normal maps are BC5,
+	 * packed ORM textures linear BC7, single scalar maps (roughness, metalness, occlusion, height) BC4, and anything
+	 * else is treated as sRGB color and encoded as BC7. Without compression the same maps stay uncompressed.
+	 */
+	TextureSettings textureSettings(const std::string& filename, Mipmaps::Filter filter, bool compress);
+}
@@ -1,4 +1,16 @@
+#include <chrono>
 #include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <algorithm>
+#include <cmath>
+#include <glm/gtc/packing.hpp>
+#include <glm/gtc/quaternion.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 #include <assimp/Importer.hpp>
@@ -6,6 +18,9 @@
 #include <assimp/LogStream.hpp>
 
 #include "mesh.hpp"
+#include "meshoptimizer.hpp"
+#include "threading.hpp"
+#include "utils.hpp"
 
 namespace 
 {
@@ -19,6 +34,137 @@ namespace
         aiProcess_OptimizeMeshes |
         aiProcess_Debone |
         aiProcess_ValidateDataStructure;
+
+    // Mesh cache file: the header, the vertex, face and submesh arrays exactly as they are uploaded, then the
+    // materials as a count followed by length-prefixed strings.
+    const char CacheMagic[8] = {'P', 'B', 'R', 'M', 'E', 'S', 'H', '\0'};
+    constexpr uint32_t CacheVersion = 5;  // 2: arrays are optimized (MeshOptimizer). 3: every submesh and material. 4: LODs. 5: LOD errors as distances.
+
+    // Submeshes with fewer triangles are not simplified; a level must have at most this share of the previous one.
+    constexpr uint32_t MinLodFaces = 256;
+    constexpr double MaxLodRatio = 0.8;
+
+    struct CacheHeader
+    {
+        char magic[8];
+        uint32_t version;
+        uint32_t vertexSize;       // sizeof(Mesh::Vertex) when written, so a layout change is never misread.
+        uint64_t key;
+        uint64_t numVertices, numFaces, numSubmeshes;
+        uint64_t materialBytes;
+        uint64_t vertexOffset, faceOffset, submeshOffset, materialOffset;
+        uint64_t reserved;
+    };
+    static_assert(sizeof(CacheHeader) == 96, "Mesh cache header layout changed");
+
+    void writeString(std::ostream& stream, const std::string& text)
+    {
+        const uint32_t length = static_cast<uint32_t>(text.size());
+        stream.write(reinterpret_cast<const char*>(&length), sizeof(length));
+        stream.write(text.data(), std::streamsize(length));
+    }
+
+    std::string readString(const unsigned char*& data, const unsigned char* end)
+    {
+        uint32_t length;
+        if (size_t(end - data) < sizeof(length))
+        {
+            throw std::runtime_error("Truncated mesh cache materials");
+        }
+        std::memcpy(&length, data, sizeof(length));
+        data += sizeof(length);
+        if (size_t(end - data) < length)
+        {
+            throw std::runtime_error("Truncated mesh cache materials");
+        }
+        std::string text{reinterpret_cast<const char*>(data), length};
+        data += length;
+        return text;
+    }
+
+    std::string texturePath(const aiMaterial* material, std::initializer_list<aiTextureType> types)
+    {
+        for (aiTextureType type : types)
+        {
+            aiString path;
+            if (material->GetTextureCount(type) > 0 && material->GetTexture(type, 0, &path) == AI_SUCCESS)
+            {
+                return path.C_Str();
+            }
+        }
+        return {};
+    }
+
+    uint64_t cacheKey(const std::string& filename)
+    {
+        const FileUtility::MappedFile file{filename};
+
+        Utility::Hash64 hash;
+        hash.update(file.data(), file.size());
+        hash.update(CacheVersion);
+        hash.update(ImportFlags);
+        hash.update(sizeof(Mesh::Vertex));
+        return hash.value();
+    }
+}
+
+namespace
+{
+    // Smallest |w| of a packed QTangent, so its sign (the bitangent handedness) survives snorm16 quantization.
+    constexpr float QTangentBias = 1.0f / 32767.0f;
+
+    int16_t toSnorm16(float value)
+    {
+        return static_cast<int16_t>(std::round(glm::clamp(value, -1.0f, 1.0f) * 32767.0f));
+    }
+
+    float fromSnorm16(int16_t value)
+    {
+        return std::max(value / 32767.0f, -1.0f);
+    }
+
+    float angleDegrees(const glm::vec3& a, const glm::vec3& b)
+    {
+        return glm::degrees(std::acos(glm::clamp(glm::dot(a, b), -1.0f, 1.0f)));
+    }
+
+    glm::vec4 encodeQTangent(const glm::vec3& normal, const glm::vec3& tangent, const glm::vec3& bitangent)
+    {
+        // Orthonormalize the frame; vertices without a usable tangent get an arbitrary one.
+        const glm::vec3 n = glm::normalize(normal);
+        glm::vec3 t = tangent - n * glm::dot(n, tangent);
+        if (glm::dot(t, t) < 1e-12f)
+        {
+            t = glm::cross(std::fabs(n.x) > 0.9f ? glm::vec3{0.0f, 1.0f, 0.0f} : glm::vec3{1.0f, 0.0f, 0.0f}, n);
+        }
+        t = glm::normalize(t);
+        const glm::vec3 b = glm::cross(n, t);
+
+        glm::quat q = glm::normalize(glm::quat_cast(glm::mat3{t, b, n}));
+        if (q.w < 0.0f)
+        {
+            q = -q;
+        }
+        if (q.w < QTangentBias)
+        {
+            const float xyzScale = std::sqrt(1.0f - QTangentBias * QTangentBias) / std::max(glm::length(glm::vec3{q.x, q.y, q.z}), 1e-20f);
+            q = glm::quat{QTangentBias, q.x * xyzScale, q.y * xyzScale, q.z * xyzScale};
+        }
+        // A mirrored tangent frame is stored as the negated quaternion.
+        const float handedness = glm::dot(b, bitangent) < 0.0f ? -1.0f : 1.0f;
+        return glm::vec4{q.x, q.y, q.z, q.w} * handedness;
+    }
+
+    // The decoding of pbr.vs: rotates the tangent and normal axes by q, the bitangent follows from the w sign.
+    void decodeQTangent(const glm::vec4& packed, glm::vec3& normal, glm::vec3& tangent, glm::vec3& bitangent)
+    {
+        const glm::vec4 q = glm::normalize(packed);
+        const glm::vec3 u{q.x, q.y, q.z};
+        auto rotate = [&](const glm::vec3& v) { return v + 2.0f * glm::cross(u, glm::cross(u, v) + q.w * v); };
+        tangent = rotate({1.0f, 0.0f, 0.0f});
+        normal = rotate({0.0f, 0.0f, 1.0f});
+        bitangent = glm::cross(normal, tangent) * (q.w < 0.0f ? -1.0f : 1.0f);
+    }
 }
 
 class LogStream : public Assimp::LogStream
@@ -26,11 +172,16 @@ class LogStream : public Assimp::LogStream
 public:
     static void initialize()
     {
-        if(Assimp::DefaultLogger::isNullLogger()) 
+        // Meshes are imported on worker threads; the logger must only be created once.
+        static std::once_flag once;
+        std::call_once(once, []()
         {
-            Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
-            Assimp::DefaultLogger::get()->attachStream(new LogStream, Assimp::Logger::Err | Assimp::Logger::Warn);
-        }
+            if(Assimp::DefaultLogger::isNullLogger()) 
+            {
+                Assimp::DefaultLogger::create("", Assimp::Logger::VERBOSE);
+                Assimp::DefaultLogger::get()->attachStream(new LogStream, Assimp::Logger::Err | Assimp::Logger::Warn);
+            }
+        });
     }
     
     void write(const char* message) override
@@ -39,41 +190,97 @@ public:
     }
 };
 
-Mesh::Mesh(const aiMesh* mesh)
+Mesh::Mesh(const aiScene* scene)
 {
-    assert(mesh->HasPositions());
-    assert(mesh->HasNormals());
-
-    m_vertices.reserve(mesh->mNumVertices);
-    for(size_t i=0; i<m_vertices.capacity(); ++i) 
+    for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
     {
-        Vertex vertex;
-        vertex.position = {mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z};
-        vertex.normal = {mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z};
-        
-        if(mesh->HasTangentsAndBitangents()) 
+        const aiMesh* mesh = scene->mMeshes[m];
+        // Points and lines are split into meshes of their own (aiProcess_SortByPType) and are not drawn.
+        if (!(mesh->mPrimitiveTypes & aiPrimitiveType_TRIANGLE) || !mesh->HasNormals())
         {
-            vertex.tangent = {mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z};
-            vertex.bitangent = {mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z};
+            continue;
         }
-        if(mesh->HasTextureCoords(0)) 
+
+        Submesh submesh = {};
+        submesh.numLods = 1;
+        submesh.lods[0] = {static_cast<uint32_t>(m_faceStorage.size()), mesh->mNumFaces, 0.0f};
+        submesh.firstVertex = static_cast<uint32_t>(m_vertexStorage.size());
+        submesh.numVertices = mesh->mNumVertices;
+        submesh.material = mesh->mMaterialIndex;
+
+        m_vertexStorage.resize(m_vertexStorage.size() + mesh->mNumVertices);
+        for(size_t i=0; i<mesh->mNumVertices; ++i) 
         {
-            vertex.texcoord = {mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y};
+            Vertex& vertex = m_vertexStorage[submesh.firstVertex + i];
+            vertex.position = {mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z};
+            vertex.normal = {mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z};
+            
+            if(mesh->HasTangentsAndBitangents()) 
+            {
+                vertex.tangent = {mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z};
+                vertex.bitangent = {mesh->mBitangents[i].x, mesh->mBitangents[i].y, mesh->mBitangents[i].z};
+            }
+            else
+            {
+                vertex.tangent = vertex.bitangent = glm::vec3{0.0f};
+            }
+            vertex.texcoord = mesh->HasTextureCoords(0) ? glm::vec2{mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y} : glm::vec2{0.0f};
         }
         
-        m_vertices.push_back(vertex);
+        m_faceStorage.resize(m_faceStorage.size() + mesh->mNumFaces);
+        for(size_t i=0; i<mesh->mNumFaces; ++i) 
+        {
+            assert(mesh->mFaces[i].mNumIndices == 3);
+            m_faceStorage[submesh.lods[0].firstFace + i] = {mesh->mFaces[i].mIndices[0], mesh->mFaces[i].mIndices[1], mesh->mFaces[i].mIndices[2]};
+        }
+        m_submeshStorage.push_back(submesh);
     }
-    
-    m_faces.reserve(mesh->mNumFaces);
-    for(size_t i=0; i<m_faces.capacity(); ++i) 
+    if (m_submeshStorage.empty())
     {
-        assert(mesh->mFaces[i].mNumIndices == 3);
-        m_faces.push_back({mesh->mFaces[i].mIndices[0], mesh->mFaces[i].mIndices[1], mesh->mFaces[i].mIndices[2]});
+        throw std::runtime_error("Mesh has no triangles");
     }
+
+    for (unsigned int m = 0; m < scene->mNumMaterials; ++m)
+    {
+        const aiMaterial* material = scene->mMaterials[m];
+        aiString name;
+        material->Get(AI_MATKEY_NAME, name);
+
+        Material result;
+        result.name = name.C_Str();
+        result.baseColorTexture = texturePath(material, {aiTextureType_DIFFUSE});
+        result.normalTexture = texturePath(material, {aiTextureType_NORMALS, aiTextureType_HEIGHT});
+        result.metallicRoughnessTexture = texturePath(material, {aiTextureType_UNKNOWN});
+        m_materials.push_back(std::move(result));
+    }
+
+    m_vertices = m_vertexStorage.data();
+    m_numVertices = m_vertexStorage.size();
+    m_faces = m_faceStorage.data();
+    m_numFaces = m_faceStorage.size();
+    m_submeshes = m_submeshStorage.data();
+    m_numSubmeshes = m_submeshStorage.size();
 }
 
 std::shared_ptr<Mesh> Mesh::fromFile(const std::string& filename)
 {
+    const uint64_t key = cacheKey(filename);
+    const std::string cacheFile = filename + ".pmesh";
+    if (std::filesystem::exists(cacheFile))
+    {
+        try
+        {
+            if (std::shared_ptr<Mesh> mesh = fromCache(cacheFile, key))
+            {
+                return mesh;
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::fprintf(stderr, "Ignoring invalid mesh cache: %s\n", e.what());
+        }
+    }
+
     LogStream::initialize();
     std::printf("Loading mesh: %s\n", filename.c_str());
 
@@ -85,7 +292,20 @@ std::shared_ptr<Mesh> Mesh::fromFile(const std::string& filename)
         throw std::runtime_error("Failed to load mesh file: " + filename);
     }
 
-    return std::make_shared<Mesh>(scene->mMeshes[0]);
+    std::shared_ptr<Mesh> mesh = std::make_shared<Mesh>(scene);
+    std::printf("Imported scene %s: %zu submeshes, %zu materials\n", filename.c_str(), mesh->m_numSubmeshes, mesh->m_materials.size());
+    mesh->optimize(filename);
+    mesh->buildLods(filename);
+    try
+    {
+        mesh->writeCache(cacheFile, key);
+        std::printf("Stored mesh cache: %s\n", cacheFile.c_str());
+    }
+    catch (const std::exception& e)
+    {
+        std::fprintf(stderr, "Warning: %s\n", e.what());
+    }
+    return mesh;
 }
 
 std::shared_ptr<Mesh> Mesh::fromString(const std::string& data)
@@ -100,5 +320,362 @@ std::shared_ptr<Mesh> Mesh::fromString(const std::string& data)
         throw std::runtime_error("Failed to create mesh from string");
     }
 
-    return std::make_shared<Mesh>(scene->mMeshes[0]);
+    return std::make_shared<Mesh>(scene);
+}
+
+bool Mesh::hasShortIndices() const
+{
+    for (const Submesh& submesh : submeshes())
+    {
+        if (submesh.numVertices > 65536)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void Mesh::optimize(const std::string& name)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // Submeshes are optimized one by one, so each keeps its own ranges and relative indices.
+    std::vector<Vertex> vertices;
+    std::vector<Face> faces;
+    std::vector<Submesh> submeshes;
+    MeshOptimizer::Report total;
+    size_t clusters = 0;
+    for (const Submesh& submesh : m_submeshStorage)
+    {
+        std::vector<Vertex> submeshVertices{m_vertexStorage.begin() + submesh.firstVertex,
+                                            m_vertexStorage.begin() + submesh.firstVertex + submesh.numVertices};
+        const Lod& full = submesh.lods[0];
+        std::vector<Face> submeshFaces{m_faceStorage.begin() + full.firstFace, m_faceStorage.begin() + full.firstFace + full.numFaces};
+        const MeshOptimizer::Report report = MeshOptimizer::optimize(submeshVertices, submeshFaces);
+
+        total.verticesBefore += report.verticesBefore;
+        total.facesBefore += report.facesBefore;
+        total.before.misses += report.before.misses;
+        total.after.misses += report.after.misses;
+        clusters += report.clusters;
+
+        Submesh result = submesh;
+        result.firstVertex = static_cast<uint32_t>(vertices.size());
+        result.numVertices = static_cast<uint32_t>(submeshVertices.size());
+        result.numLods = 1;
+        result.lods[0] = {static_cast<uint32_t>(faces.size()), static_cast<uint32_t>(submeshFaces.size()), 0.0f};
+        vertices.insert(vertices.end(), submeshVertices.begin(), submeshVertices.end());
+        faces.insert(faces.end(), submeshFaces.begin(), submeshFaces.end());
+        submeshes.push_back(result);
+    }
+
+    m_vertexStorage = std::move(vertices);
+    m_faceStorage = std::move(faces);
+    m_submeshStorage = std::move(submeshes);
+    m_vertices = m_vertexStorage.data();
+    m_numVertices = m_vertexStorage.size();
+    m_faces = m_faceStorage.data();
+    m_numFaces = m_faceStorage.size();
+    m_submeshes = m_submeshStorage.data();
+    m_numSubmeshes = m_submeshStorage.size();
+
+    const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+    std::printf("Optimized mesh %s in %.1f ms: %zu -> %zu vertices, %zu -> %zu triangles, %zu clusters ordered for overdraw\n",
+                name.c_str(), milliseconds, total.verticesBefore, m_numVertices, total.facesBefore, m_numFaces, clusters);
+    std::printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f (FIFO cache of %d vertices), %d-bit indices\n",
+                double(total.before.misses) / std::max<size_t>(total.facesBefore, 1), double(total.after.misses) / std::max<size_t>(m_numFaces, 1),
+                double(total.before.misses) / std::max<size_t>(total.verticesBefore, 1), double(total.after.misses) / std::max<size_t>(m_numVertices, 1),
+                MeshOptimizer::CacheSize, hasShortIndices() ? 16 : 32);
+}
+
+void Mesh::buildLods(const std::string& name)
+{
+    const auto startTime = std::chrono::steady_clock::now();
+
+    // Every level is simplified from full resolution, so the levels of all submeshes run in parallel.
+    struct Job
+    {
+        size_t submesh;
+        int level;
+        MeshOptimizer::Simplified result;
+    };
+    std::vector<std::vector<Vertex>> vertices(m_submeshStorage.size());
+    std::vector<std::vector<Face>> faces(m_submeshStorage.size());
+    std::vector<Job> jobs;
+    size_t inputFaces = 0;
+    for (size_t s = 0; s < m_submeshStorage.size(); ++s)
+    {
+        const Submesh& submesh = m_submeshStorage[s];
+        const Lod& full = submesh.lods[0];
+        vertices[s].assign(m_vertexStorage.begin() + submesh.firstVertex, m_vertexStorage.begin() + submesh.firstVertex + submesh.numVertices);
+        faces[s].assign(m_faceStorage.begin() + full.firstFace, m_faceStorage.begin() + full.firstFace + full.numFaces);
+        if (full.numFaces >= MinLodFaces)
+        {
+            for (int level = 1; level < MaxLods; ++level)
+            {
+                jobs.push_back({s, level, {}});
+                inputFaces += full.numFaces;
+            }
+        }
+    }
+    if (jobs.empty())
+    {
+        return;
+    }
+
+    ThreadPool& pool = ThreadPool::instance();
+    pool.parallelFor(jobs.size(), [&](size_t i)
+    {
+        Job& job = jobs[i];
+        job.result = MeshOptimizer::simplify(vertices[job.submesh], faces[job.submesh], faces[job.submesh].size() >> job.level);
+        MeshOptimizer::optimizeVertexCache(job.result.faces, vertices[job.submesh].size());
+    });
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+    // A level that barely reduces the previous one (locked borders and seams) ends the chain.
+    std::vector<Face> output;
+    size_t job = 0;
+    for (size_t s = 0; s < m_submeshStorage.size(); ++s)
+    {
+        Submesh& submesh = m_submeshStorage[s];
+        submesh.numLods = 1;
+        submesh.lods[0].firstFace = static_cast<uint32_t>(output.size());
+        output.insert(output.end(), faces[s].begin(), faces[s].end());
+
+        bool extend = true;
+        for (; job < jobs.size() && jobs[job].submesh == s; ++job)
+        {
+            const MeshOptimizer::Simplified& result = jobs[job].result;
+            extend = extend && !result.faces.empty() && result.faces.size() <= MaxLodRatio * submesh.lods[submesh.numLods - 1].numFaces;
+            if (extend)
+            {
+                submesh.lods[submesh.numLods++] = {static_cast<uint32_t>(output.size()), static_cast<uint32_t>(result.faces.size()), result.error};
+                output.insert(output.end(), result.faces.begin(), result.faces.end());
+            }
+        }
+    }
+    m_faceStorage = std::move(output);
+    m_faces = m_faceStorage.data();
+    m_numFaces = m_faceStorage.size();
+
+    glm::vec3 minimum{std::numeric_limits<float>::max()}, maximum{-std::numeric_limits<float>::max()};
+    for (const Vertex& vertex : m_vertexStorage)
+    {
+        minimum = glm::min(minimum, vertex.position);
+        maximum = glm::max(maximum, vertex.position);
+    }
+    const float radius = std::max(0.5f * glm::length(maximum - minimum), std::numeric_limits<float>::min());
+
+    std::printf("LOD chain for %s: %zu simplifications in %.1f ms (%.2f M input triangles/s on %u threads)\n", name.c_str(), jobs.size(),
+                seconds * 1000.0, inputFaces / seconds / 1e6, pool.concurrency());
+    for (int level = 0; level < MaxLods; ++level)
+    {
+        size_t numFaces = 0, fullFaces = 0;
+        float error = 0.0f;
+        bool present = false;
+        for (const Submesh& submesh : m_submeshStorage)
+        {
+            const Lod& lod = submesh.lods[std::min<uint32_t>(level, submesh.numLods - 1)];
+            present = present || level < int(submesh.numLods);
+            numFaces += lod.numFaces;
+            fullFaces += submesh.lods[0].numFaces;
+            error = std::max(error, lod.error);
+        }
+        if (present)
+        {
+            std::printf("  LOD %d: %zu triangles (%.1f%%), error %.3g (%.3f%% of the radius)\n", level, numFaces,
+                        100.0 * numFaces / std::max<size_t>(fullFaces, 1), error, 100.0 * error / radius);
+        }
+    }
+}
+
+Mesh::PackedVertices Mesh::pack() const
+{
+    PackedVertices packed;
+    if (m_numVertices == 0)
+    {
+        return packed;
+    }
+
+    glm::vec3 minimum{m_vertices[0].position}, maximum{m_vertices[0].position};
+    for (const Vertex& vertex : vertices())
+    {
+        minimum = glm::min(minimum, vertex.position);
+        maximum = glm::max(maximum, vertex.position);
+    }
+    packed.positionOffset = minimum;
+    packed.positionScale = glm::max(maximum - minimum, glm::vec3{1e-20f});
+
+    packed.vertices.resize(m_numVertices);
+    for (size_t i = 0; i < m_numVertices; ++i)
+    {
+        const Vertex& vertex = m_vertices[i];
+        PackedVertex& result = packed.vertices[i];
+
+        const glm::vec3 unorm = glm::clamp((vertex.position - packed.positionOffset) / packed.positionScale, 0.0f, 1.0f);
+        for (int c = 0; c < 3; ++c)
+        {
+            result.position[c] = static_cast<uint16_t>(std::round(unorm[c] * 65535.0f));
+        }
+        result.position[3] = 0;
+
+        const glm::vec4 qtangent = encodeQTangent(vertex.normal, vertex.tangent, vertex.bitangent);
+        for (int c = 0; c < 4; ++c)
+        {
+            result.qtangent[c] = toSnorm16(qtangent[c]);
+        }
+        result.texcoord[0] = glm::packHalf1x16(vertex.texcoord.x);
+        result.texcoord[1] = glm::packHalf1x16(vertex.texcoord.y);
+
+        // Measure the error of exactly what the shader will decode.
+        glm::vec3 position;
+        for (int c = 0; c < 3; ++c)
+        {
+            position[c] = result.position[c] / 65535.0f * packed.positionScale[c] + packed.positionOffset[c];
+        }
+        glm::vec3 normal, tangent, bitangent;
+        decodeQTangent({fromSnorm16(result.qtangent[0]), fromSnorm16(result.qtangent[1]), fromSnorm16(result.qtangent[2]), fromSnorm16(result.qtangent[3])},
+                       normal, tangent, bitangent);
+        const glm::vec2 texcoord{glm::unpackHalf1x16(result.texcoord[0]), glm::unpackHalf1x16(result.texcoord[1])};
+
+        packed.maxPositionError = std::max(packed.maxPositionError, glm::length(position - vertex.position));
+        packed.maxNormalErrorDegrees = std::max(packed.maxNormalErrorDegrees, angleDegrees(normal, glm::normalize(vertex.normal)));
+        if (glm::dot(vertex.tangent, vertex.tangent) > 1e-12f)
+        {
+            packed.maxTangentErrorDegrees = std::max(packed.maxTangentErrorDegrees, angleDegrees(tangent, glm::normalize(vertex.tangent)));
+        }
+        packed.maxTexcoordError = std::max(packed.maxTexcoordError, glm::length(texcoord - vertex.texcoord));
+    }
+
+    const double fullMB = double(m_numVertices * sizeof(Vertex)) / (1 << 20);
+    const double packedMB = double(m_numVertices * sizeof(PackedVertex)) / (1 << 20);
+    std::printf("Packed %zu vertices: %zu -> %zu bytes (%.2f MB -> %.2f MB, %.0f%% less vertex data)\n", m_numVertices, sizeof(Vertex),
+                sizeof(PackedVertex), fullMB, packedMB, 100.0 * (1.0 - packedMB / fullMB));
+    std::printf("  max error: position %.3g (%.4f%% of the bounds), normal %.3f deg, tangent %.3f deg, texcoord %.3g\n",
+                packed.maxPositionError, 100.0 * packed.maxPositionError / std::max(glm::length(maximum - minimum), 1e-20f),
+                packed.maxNormalErrorDegrees, packed.maxTangentErrorDegrees, packed.maxTexcoordError);
+    return packed;
+}
+
+std::shared_ptr<Mesh> Mesh::fromCache(const std::string& filename, uint64_t key)
+{
+    auto file = std::make_shared<FileUtility::MappedFile>(filename);
+
+    CacheHeader header;
+    if (file->size() < sizeof(header))
+    {
+        throw std::runtime_error("Truncated mesh cache: " + filename);
+    }
+    std::memcpy(&header, file->data(), sizeof(header));
+    if (std::memcmp(header.magic, CacheMagic, sizeof(CacheMagic)) != 0 || header.version != CacheVersion || header.vertexSize != sizeof(Vertex))
+    {
+        throw std::runtime_error("Unsupported mesh cache: " + filename);
+    }
+    if (header.key != key)
+    {
+        return nullptr;
+    }
+
+    auto fits = [&](uint64_t offset, uint64_t count, size_t size, size_t alignment)
+    {
+        return count <= file->size() / size && offset % alignment == 0 && offset <= file->size() && count * size <= file->size() - offset;
+    };
+    if (!fits(header.vertexOffset, header.numVertices, sizeof(Vertex), alignof(Vertex)) ||
+        !fits(header.faceOffset, header.numFaces, sizeof(Face), alignof(Face)) ||
+        !fits(header.submeshOffset, header.numSubmeshes, sizeof(Submesh), alignof(Submesh)) ||
+        !fits(header.materialOffset, header.materialBytes, 1, 1))
+    {
+        throw std::runtime_error("Truncated mesh cache: " + filename);
+    }
+
+    // The arrays are used in place: the pages are read when the buffers are uploaded.
+    std::shared_ptr<Mesh> mesh{new Mesh};
+    mesh->m_vertices = reinterpret_cast<const Vertex*>(file->data() + header.vertexOffset);
+    mesh->m_numVertices = size_t(header.numVertices);
+    mesh->m_faces = reinterpret_cast<const Face*>(file->data() + header.faceOffset);
+    mesh->m_numFaces = size_t(header.numFaces);
+    mesh->m_submeshes = reinterpret_cast<const Submesh*>(file->data() + header.submeshOffset);
+    mesh->m_numSubmeshes = size_t(header.numSubmeshes);
+    for (const Submesh& submesh : mesh->submeshes())
+    {
+        bool valid = uint64_t(submesh.firstVertex) + submesh.numVertices <= header.numVertices && submesh.numLods >= 1 && submesh.numLods <= MaxLods;
+        for (uint32_t level = 0; valid && level < submesh.numLods; ++level)
+        {
+            valid = uint64_t(submesh.lods[level].firstFace) + submesh.lods[level].numFaces <= header.numFaces;
+        }
+        if (!valid)
+        {
+            throw std::runtime_error("Invalid mesh cache submesh: " + filename);
+        }
+    }
+
+    const unsigned char* materials = file->data() + header.materialOffset;
+    const unsigned char* materialsEnd = materials + header.materialBytes;
+    uint32_t numMaterials;
+    if (header.materialBytes < sizeof(numMaterials))
+    {
+        throw std::runtime_error("Truncated mesh cache: " + filename);
+    }
+    std::memcpy(&numMaterials, materials, sizeof(numMaterials));
+    materials += sizeof(numMaterials);
+    for (uint32_t m = 0; m < numMaterials; ++m)
+    {
+        Material material;
+        material.name = readString(materials, materialsEnd);
+        material.baseColorTexture = readString(materials, materialsEnd);
+        material.normalTexture = readString(materials, materialsEnd);
+        material.metallicRoughnessTexture = readString(materials, materialsEnd);
+        mesh->m_materials.push_back(std::move(material));
+    }
+    mesh->m_mapped = file->isMapped();
+    mesh->m_mapping = std::move(file);
+    return mesh;
+}
+
+void Mesh::writeCache(const std::string& filename, uint64_t key) const
+{
+    CacheHeader header = {};
+    std::memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+    header.version = CacheVersion;
+    header.vertexSize = sizeof(Vertex);
+    header.key = key;
+    header.numVertices = m_numVertices;
+    header.numFaces = m_numFaces;
+    header.numSubmeshes = m_numSubmeshes;
+    header.vertexOffset = sizeof(CacheHeader);
+    header.faceOffset = header.vertexOffset + m_numVertices * sizeof(Vertex);
+    header.submeshOffset = header.faceOffset + m_numFaces * sizeof(Face);
+    header.materialOffset = header.submeshOffset + m_numSubmeshes * sizeof(Submesh);
+
+    std::ostringstream materials;
+    const uint32_t numMaterials = static_cast<uint32_t>(m_materials.size());
+    materials.write(reinterpret_cast<const char*>(&numMaterials), sizeof(numMaterials));
+    for (const Material& material : m_materials)
+    {
+        writeString(materials, material.name);
+        writeString(materials, material.baseColorTexture);
+        writeString(materials, material.normalTexture);
+        writeString(materials, material.metallicRoughnessTexture);
+    }
+    const std::string materialBytes = materials.str();
+    header.materialBytes = materialBytes.size();
+
+    const std::string temporaryFilename = filename + ".tmp";
+    {
+        std::ofstream file{temporaryFilename, std::ios::binary | std::ios::trunc};
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Could not open file for writing: " + temporaryFilename);
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char*>(m_vertices), std::streamsize(m_numVertices * sizeof(Vertex)));
+        file.write(reinterpret_cast<const char*>(m_faces), std::streamsize(m_numFaces * sizeof(Face)));
+        file.write(reinterpret_cast<const char*>(m_submeshes), std::streamsize(m_numSubmeshes * sizeof(Submesh)));
+        file.write(materialBytes.data(), std::streamsize(materialBytes.size()));
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write mesh cache: " + temporaryFilename);
+        }
+    }
+    std::filesystem::rename(temporaryFilename, filename);
 }
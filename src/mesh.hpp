@@ -28,19 +28,119 @@ public:
     };
     static_assert(sizeof(Face) == 3 * sizeof(uint32_t), "Face size is not as expected");
 
-    // Static factory methods
+    static constexpr int MaxLods = 5;
+
+    // A level of detail of a submesh: a range of faces() over the vertices of the submesh.
+    struct Lod
+    {
+        uint32_t firstFace, numFaces;
+        float error;  // Largest simplification error in model units (see MeshOptimizer::simplify); 0 at full resolution.
+    };
+
+    // One mesh of the imported scene: ranges of the shared arrays, drawn as one indirect draw command. Face
+    // indices are relative to firstVertex (the base vertex of the draw), so they fit 16 bits per submesh.
+    struct Submesh
+    {
+        uint32_t firstVertex, numVertices;
+        uint32_t material;  // Index into materials().
+        uint32_t numLods;   // Levels of detail, full resolution first, each with about half the triangles.
+        Lod lods[MaxLods];
+    };
+    static_assert(sizeof(Submesh) == 4 * sizeof(uint32_t) + MaxLods * sizeof(Lod), "Submesh size is not as expected");
+
+    // Material of the imported scene; texture paths are as the model file references them, empty if absent.
+    struct Material
+    {
+        std::string name;
+        std::string baseColorTexture;
+        std::string normalTexture;
+        std::string metallicRoughnessTexture;
+    };
+
+    // Compact vertex: the position as 16-bit unorm within the mesh bounds, the whole tangent frame as a QTangent
+    // (a 16-bit snorm quaternion whose w sign holds the bitangent handedness) and half-float texture coordinates.
+    struct PackedVertex
+    {
+        uint16_t position[4];  // xyz; w is padding that keeps the QTangent 8-byte aligned.
+        int16_t qtangent[4];   // xyzw
+        uint16_t texcoord[2];
+    };
+    static_assert(sizeof(PackedVertex) == 20, "PackedVertex size is not as expected");
+
+    struct PackedVertices
+    {
+        std::vector<PackedVertex> vertices;
+        glm::vec3 positionScale{1.0f}, positionOffset{0.0f};  // position = unorm * scale + offset
+
+        // Largest errors against the original vertices.
+        float maxPositionError = 0.0f;       // In model units.
+        float maxNormalErrorDegrees = 0.0f;
+        float maxTangentErrorDegrees = 0.0f; // Includes making the tangent orthogonal to the normal.
+        float maxTexcoordError = 0.0f;
+    };
+
+    // Read-only view of an array of the mesh, which is either imported or mapped from the mesh cache.
+    template<typename T>
+    class ArrayView
+    {
+    public:
+        ArrayView(const T* data, size_t size) : m_data(data), m_size(size) {}
+
+        const T* data() const { return m_data; }
+        size_t size() const { return m_size; }
+        const T* begin() const { return m_data; }
+        const T* end() const { return m_data + m_size; }
+        const T& operator[](size_t index) const { return m_data[index]; }
+
+    private:
+        const T* m_data;
+        size_t m_size;
+    };
+
+    // Static factory methods. fromFile imports every mesh and material of the scene into shared arrays, optimizes
+    // them, builds their levels of detail and stores them next to the model (<file>.pmesh), keyed by the file contents and import settings;
+    // later calls map that file instead of running Assimp.
     static std::shared_ptr<Mesh> fromFile(const std::string& filename);
     static std::shared_ptr<Mesh> fromString(const std::string& data);
 
     // Getter methods
-    const std::vector<Vertex>& vertices() const { return m_vertices; }
-    const std::vector<Face>& faces() const { return m_faces; }
+    ArrayView<Vertex> vertices() const { return {m_vertices, m_numVertices}; }
+    ArrayView<Face> faces() const { return {m_faces, m_numFaces}; }
+    ArrayView<Submesh> submeshes() const { return {m_submeshes, m_numSubmeshes}; }
+    const std::vector<Material>& materials() const { return m_materials; }
+    // True when the arrays point into a mapped mesh cache file.
+    bool isMapped() const { return m_mapped; }
+    // True when every (submesh relative) index fits 16 bits, so the index buffer can be half the size.
+    bool hasShortIndices() const;
+
+    // Quantizes the vertices into the compact layout and reports the size savings and error bounds.
+    PackedVertices pack() const;
 
 	// Constructor
-    explicit Mesh(const struct aiMesh* mesh);
+    explicit Mesh(const struct aiScene* scene);
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
 private:
+    Mesh() = default;
+
+    static std::shared_ptr<Mesh> fromCache(const std::string& filename, uint64_t key);
+    // Welds and reorders every submesh of the imported arrays for the GPU (see MeshOptimizer).
+    void optimize(const std::string& name);
+    // Appends the simplified levels of detail of every submesh to the faces.
+    void buildLods(const std::string& name);
+    void writeCache(const std::string& filename, uint64_t key) const;
 
     // Member variables
-    std::vector<Vertex> m_vertices;
-    std::vector<Face> m_faces;
+    const Vertex* m_vertices = nullptr;
+    size_t m_numVertices = 0;
+    const Face* m_faces = nullptr;
+    size_t m_numFaces = 0;
+    const Submesh* m_submeshes = nullptr;
+    size_t m_numSubmeshes = 0;
+    std::vector<Material> m_materials;
+    bool m_mapped = false;
+    std::vector<Vertex> m_vertexStorage;     // Arrays of an imported mesh.
+    std::vector<Face> m_faceStorage;
+    std::vector<Submesh> m_submeshStorage;
+    std::shared_ptr<const void> m_mapping;   // Cache file the arrays of a cached mesh point into.
 };
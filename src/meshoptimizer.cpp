@@ -0,0 +1,615 @@
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <queue>
+#include <unordered_map>
+
+#include "meshoptimizer.hpp"
+#include "utils.hpp"
+
+namespace
+{
+	constexpr uint32_t Unused = std::numeric_limits<uint32_t>::max();
+
+	uint32_t* indices(Mesh::Face& face) { return &face.v1; }
+	const uint32_t* indices(const Mesh::Face& face) { return &face.v1; }
+
+	// The triangles around every vertex, in compressed rows.
+	struct Adjacency
+	{
+		std::vector<uint32_t> offsets;
+		std::vector<uint32_t> triangles;
+
+		Adjacency(const std::vector<Mesh::Face>& faces, size_t numVertices)
+			: offsets(numVertices + 1, 0)
+			, triangles(faces.size() * 3)
+		{
+			for(const Mesh::Face& face : faces) {
+				for(int k=0; k<3; ++k) {
+					++offsets[indices(face)[k] + 1];
+				}
+			}
+			for(size_t v=0; v<numVertices; ++v) {
+				offsets[v + 1] += offsets[v];
+			}
+			std::vector<uint32_t> next{offsets.begin(), offsets.end() - 1};
+			for(size_t t=0; t<faces.size(); ++t) {
+				for(int k=0; k<3; ++k) {
+					triangles[next[indices(faces[t])[k]]++] = uint32_t(t);
+				}
+			}
+		}
+
+		uint32_t count(size_t vertex) const { return offsets[vertex + 1] - offsets[vertex]; }
+	};
+
+	// FIFO post-transform cache: a vertex is cached while fewer than size vertices were transformed after it.
+	class FifoCache
+	{
+	public:
+		FifoCache(size_t numVertices, int size)
+			: m_timestamps(numVertices, 0)
+			, m_time(size_t(size) + 1)
+			, m_size(size_t(size))
+		{}
+
+		// Returns true on a miss, which transforms the vertex and pushes it into the cache.
+		bool access(uint32_t vertex)
+		{
+			if(age(vertex) <= m_size) {
+				return false;
+			}
+			m_timestamps[vertex] = m_time++;
+			return true;
+		}
+
+		// Transformations since the vertex entered the cache; larger than the cache size once it has left.
+		size_t age(uint32_t vertex) const { return m_time - m_timestamps[vertex]; }
+		size_t size() const { return m_size; }
+
+		void clear() { m_time += m_size + 1; }
+
+	private:
+		std::vector<size_t> m_timestamps;
+		size_t m_time;
+		size_t m_size;
+	};
+
+	// Sum of squared distances to a set of planes, as the symmetric 4x4 matrix of (x, y, z, 1).
+	struct Quadric
+	{
+		double xx = 0, xy = 0, xz = 0, xw = 0, yy = 0, yz = 0, yw = 0, zz = 0, zw = 0, ww = 0;
+
+		void addPlane(const glm::dvec3& normal, double distance)
+		{
+			xx += normal.x * normal.x; xy += normal.x * normal.y; xz += normal.x * normal.z; xw += normal.x * distance;
+			yy += normal.y * normal.y; yz += normal.y * normal.z; yw += normal.y * distance;
+			zz += normal.z * normal.z; zw += normal.z * distance;
+			ww += distance * distance;
+		}
+
+		Quadric& operator+=(const Quadric& other)
+		{
+			xx += other.xx; xy += other.xy; xz += other.xz; xw += other.xw; yy += other.yy;
+			yz += other.yz; yw += other.yw; zz += other.zz; zw += other.zw; ww += other.ww;
+			return *this;
+		}
+
+		double error(const glm::vec3& p) const
+		{
+			const double x = p.x, y = p.y, z = p.z;
+			const double result = x * (xx * x + 2.0 * (xy * y + xz * z + xw)) + y * (yy * y + 2.0 * (yz * z + yw)) + z * (zz * z + 2.0 * zw) + ww;
+			return std::max(result, 0.0);
+		}
+	};
+
+	struct Collapse
+	{
+		double cost;
+		uint32_t from, to;
+		uint32_t fromVersion, toVersion;
+
+		bool operator>(const Collapse& other) const { return cost > other.cost; }
+	};
+
+	struct VertexHash
+	{
+		size_t operator()(const Mesh::Vertex* vertex) const
+		{
+			Utility::Hash64 hash;
+			hash.update(*vertex);
+			return size_t(hash.value());
+		}
+	};
+
+	struct VertexEqual
+	{
+		bool operator()(const Mesh::Vertex* a, const Mesh::Vertex* b) const
+		{
+			return std::memcmp(a, b, sizeof(Mesh::Vertex)) == 0;
+		}
+	};
+}
+
+namespace MeshOptimizer
+{
+	CacheStatistics analyzeVertexCache(const std::vector<Mesh::Face>& faces, size_t numVertices, int cacheSize)
+	{
+		CacheStatistics statistics;
+		if(faces.empty() || numVertices == 0) {
+			return statistics;
+		}
+
+		FifoCache cache{numVertices, cacheSize};
+		size_t misses = 0;
+		for(const Mesh::Face& face : faces) {
+			for(int k=0; k<3; ++k) {
+				misses += cache.access(indices(face)[k]);
+			}
+		}
+		statistics.misses = misses;
+		statistics.acmr = double(misses) / faces.size();
+		statistics.atvr = double(misses) / numVertices;
+		return statistics;
+	}
+
+	size_t weldVertices(std::vector<Mesh::Vertex>& vertices, std::vector<Mesh::Face>& faces)
+	{
+		std::unordered_map<const Mesh::Vertex*, uint32_t, VertexHash, VertexEqual> unique;
+		unique.reserve(vertices.size());
+
+		std::vector<uint32_t> remap(vertices.size());
+		std::vector<Mesh::Vertex> welded;
+		welded.reserve(vertices.size());
+		for(size_t i=0; i<vertices.size(); ++i) {
+			const auto inserted = unique.emplace(&vertices[i], uint32_t(welded.size()));
+			if(inserted.second) {
+				welded.push_back(vertices[i]);
+			}
+			remap[i] = inserted.first->second;
+		}
+
+		size_t numFaces = 0;
+		for(const Mesh::Face& face : faces) {
+			const Mesh::Face result = {remap[face.v1], remap[face.v2], remap[face.v3]};
+			if(result.v1 != result.v2 && result.v2 != result.v3 && result.v3 != result.v1) {
+				faces[numFaces++] = result;
+			}
+		}
+		faces.resize(numFaces);
+
+		const size_t removed = vertices.size() - welded.size();
+		vertices = std::move(welded);
+		return removed;
+	}
+
+	std::vector<size_t> optimizeVertexCache(std::vector<Mesh::Face>& faces, size_t numVertices, int cacheSize)
+	{
+		std::vector<size_t> clusters;
+		if(faces.empty()) {
+			return clusters;
+		}
+
+		const Adjacency adjacency{faces, numVertices};
+		std::vector<uint32_t> live(numVertices);
+		for(size_t v=0; v<numVertices; ++v) {
+			live[v] = adjacency.count(v);
+		}
+
+		FifoCache cache{numVertices, cacheSize};
+		std::vector<char> emitted(faces.size(), 0);
+		std::vector<uint32_t> deadEnd;
+		std::vector<uint32_t> candidates;
+		std::vector<Mesh::Face> output;
+		output.reserve(faces.size());
+
+		// Where fanning restarts once no neighbor has triangles left: recently used vertices first, then the
+		// next vertex in index order with triangles left.
+		size_t cursor = 0;
+		auto skipDeadEnd = [&]() -> int64_t {
+			while(!deadEnd.empty()) {
+				const uint32_t vertex = deadEnd.back();
+				deadEnd.pop_back();
+				if(live[vertex] > 0) {
+					return vertex;
+				}
+			}
+			for(; cursor<numVertices; ++cursor) {
+				if(live[cursor] > 0) {
+					return int64_t(cursor);
+				}
+			}
+			return -1;
+		};
+
+		int64_t fan = skipDeadEnd();
+		clusters.push_back(0);
+		while(fan >= 0) {
+			candidates.clear();
+			for(uint32_t i=adjacency.offsets[fan]; i<adjacency.offsets[fan + 1]; ++i) {
+				const uint32_t triangle = adjacency.triangles[i];
+				if(emitted[triangle]) {
+					continue;
+				}
+				emitted[triangle] = 1;
+				output.push_back(faces[triangle]);
+				for(int k=0; k<3; ++k) {
+					const uint32_t vertex = indices(faces[triangle])[k];
+					deadEnd.push_back(vertex);
+					candidates.push_back(vertex);
+					--live[vertex];
+					cache.access(vertex);
+				}
+			}
+
+			// Fan next around the oldest candidate that stays cached while its remaining triangles are emitted.
+			int64_t next = -1;
+			size_t bestPriority = 0;
+			for(const uint32_t vertex : candidates) {
+				if(live[vertex] == 0) {
+					continue;
+				}
+				const size_t age = cache.age(vertex);
+				const size_t priority = (age + 2 * live[vertex] <= cache.size()) ? age : 0;
+				if(next < 0 || priority > bestPriority) {
+					next = vertex;
+					bestPriority = priority;
+				}
+			}
+			if(next < 0) {
+				next = skipDeadEnd();
+				if(next >= 0) {
+					clusters.push_back(output.size());
+				}
+			}
+			fan = next;
+		}
+
+		faces = std::move(output);
+		return clusters;
+	}
+
+	size_t optimizeOverdraw(std::vector<Mesh::Face>& faces, const std::vector<Mesh::Vertex>& vertices, const std::vector<size_t>& clusters,
+							float threshold)
+	{
+		if(faces.empty() || clusters.empty()) {
+			return 0;
+		}
+
+		// Split the clusters wherever the triangles since the last split, drawn with an empty cache, have an
+		// ACMR within the threshold of the whole cluster's, so any order of the pieces keeps that bound.
+		FifoCache cache{vertices.size(), CacheSize};
+		std::vector<size_t> pieces;
+		for(size_t c=0; c<clusters.size(); ++c) {
+			const size_t begin = clusters[c];
+			const size_t end = (c + 1 < clusters.size()) ? clusters[c + 1] : faces.size();
+
+			cache.clear();
+			size_t clusterMisses = 0;
+			for(size_t t=begin; t<end; ++t) {
+				for(int k=0; k<3; ++k) {
+					clusterMisses += cache.access(indices(faces[t])[k]);
+				}
+			}
+			const double splitACMR = threshold * double(clusterMisses) / double(end - begin);
+
+			cache.clear();
+			size_t start = begin, misses = 0;
+			for(size_t t=begin; t<end; ++t) {
+				for(int k=0; k<3; ++k) {
+					misses += cache.access(indices(faces[t])[k]);
+				}
+				if(t + 1 == end || double(misses) <= splitACMR * double(t + 1 - start)) {
+					pieces.push_back(start);
+					start = t + 1;
+					misses = 0;
+					cache.clear();
+				}
+			}
+		}
+
+		// Outward-facing pieces far from the center are likely occluders: draw them first.
+		auto area = [&](const Mesh::Face& face, glm::vec3& centroid) {
+			const glm::vec3& a = vertices[face.v1].position;
+			const glm::vec3& b = vertices[face.v2].position;
+			const glm::vec3& c = vertices[face.v3].position;
+			centroid = (a + b + c) / 3.0f;
+			return glm::cross(b - a, c - a);
+		};
+
+		glm::vec3 meshCentroid{0.0f};
+		float meshArea = 0.0f;
+		for(const Mesh::Face& face : faces) {
+			glm::vec3 centroid;
+			const float faceArea = glm::length(area(face, centroid));
+			meshCentroid += centroid * faceArea;
+			meshArea += faceArea;
+		}
+		meshCentroid /= std::max(meshArea, std::numeric_limits<float>::min());
+
+		struct Piece
+		{
+			size_t begin, end;
+			float sortKey;
+		};
+		std::vector<Piece> order(pieces.size());
+		for(size_t p=0; p<pieces.size(); ++p) {
+			Piece& piece = order[p];
+			piece.begin = pieces[p];
+			piece.end = (p + 1 < pieces.size()) ? pieces[p + 1] : faces.size();
+
+			glm::vec3 centroidSum{0.0f}, normalSum{0.0f};
+			float areaSum = 0.0f;
+			for(size_t t=piece.begin; t<piece.end; ++t) {
+				glm::vec3 centroid;
+				const glm::vec3 normal = area(faces[t], centroid);
+				const float faceArea = glm::length(normal);
+				centroidSum += centroid * faceArea;
+				normalSum += normal;
+				areaSum += faceArea;
+			}
+			const float normalLength = glm::length(normalSum);
+			piece.sortKey = (areaSum > 0.0f && normalLength > 0.0f) ? glm::dot(centroidSum / areaSum - meshCentroid, normalSum / normalLength) : 0.0f;
+		}
+		std::stable_sort(order.begin(), order.end(), [](const Piece& a, const Piece& b) { return a.sortKey > b.sortKey; });
+
+		std::vector<Mesh::Face> output;
+		output.reserve(faces.size());
+		for(const Piece& piece : order) {
+			output.insert(output.end(), faces.begin() + piece.begin, faces.begin() + piece.end);
+		}
+		faces = std::move(output);
+		return order.size();
+	}
+
+	void optimizeVertexFetch(std::vector<Mesh::Vertex>& vertices, std::vector<Mesh::Face>& faces)
+	{
+		std::vector<uint32_t> remap(vertices.size(), Unused);
+		std::vector<Mesh::Vertex> ordered;
+		ordered.reserve(vertices.size());
+		for(Mesh::Face& face : faces) {
+			for(int k=0; k<3; ++k) {
+				uint32_t& index = indices(face)[k];
+				if(remap[index] == Unused) {
+					remap[index] = uint32_t(ordered.size());
+					ordered.push_back(vertices[index]);
+				}
+				index = remap[index];
+			}
+		}
+		vertices = std::move(ordered);
+	}
+
+	Simplified simplify(const std::vector<Mesh::Vertex>& vertices, const std::vector<Mesh::Face>& faces, size_t targetFaces, float maxError)
+	{
+		Simplified result;
+		result.faces = faces;
+		std::vector<Mesh::Face>& work = result.faces;
+		const size_t numVertices = vertices.size();
+
+		// Every vertex starts with the planes of its triangles, summed in its quadric and listed by triangle so the
+		// error of a collapse can be measured as a distance.
+		std::vector<Quadric> quadrics(numVertices);
+		std::vector<glm::dvec4> planes(work.size());
+		std::vector<std::vector<uint32_t>> vertexPlanes(numVertices);
+		for(size_t t=0; t<work.size(); ++t) {
+			const Mesh::Face& face = work[t];
+			const glm::dvec3 a = vertices[face.v1].position, b = vertices[face.v2].position, c = vertices[face.v3].position;
+			const glm::dvec3 normal = glm::cross(b - a, c - a);
+			const double length = glm::length(normal);
+			if(length > 0.0) {
+				planes[t] = glm::dvec4{normal / length, -glm::dot(normal / length, a)};
+				for(int k=0; k<3; ++k) {
+					quadrics[indices(face)[k]].addPlane(normal / length, planes[t].w);
+					vertexPlanes[indices(face)[k]].push_back(uint32_t(t));
+				}
+			}
+		}
+
+		std::vector<std::vector<uint32_t>> triangles(numVertices);
+		for(size_t t=0; t<work.size(); ++t) {
+			for(int k=0; k<3; ++k) {
+				triangles[indices(work[t])[k]].push_back(uint32_t(t));
+			}
+		}
+		// Border, seam and non-manifold vertices are locked: on a closed manifold every edge has two triangles,
+		// so every neighbor appears in exactly two triangles around the vertex.
+		std::vector<char> locked(numVertices, 0);
+		std::vector<uint32_t> neighbors;
+		for(size_t v=0; v<numVertices; ++v) {
+			neighbors.clear();
+			for(const uint32_t t : triangles[v]) {
+				for(int k=0; k<3; ++k) {
+					if(indices(work[t])[k] != v) {
+						neighbors.push_back(indices(work[t])[k]);
+					}
+				}
+			}
+			std::sort(neighbors.begin(), neighbors.end());
+			for(size_t i=0; i<neighbors.size() && !locked[v]; ) {
+				size_t j = i;
+				while(j < neighbors.size() && neighbors[j] == neighbors[i]) {
+					++j;
+				}
+				locked[v] = (j - i != 2);
+				i = j;
+			}
+		}
+
+		std::vector<char> removedTriangle(work.size(), 0), removedVertex(numVertices, 0);
+		std::vector<uint32_t> versions(numVertices, 0);
+		// Both directions of every edge are candidates; entries go stale when either end changes.
+		std::vector<Collapse> candidates;
+		auto consider = [&](uint32_t a, uint32_t b, std::vector<Collapse>& output) {
+			Quadric sum = quadrics[a];
+			sum += quadrics[b];
+			if(!locked[a]) {
+				output.push_back({sum.error(vertices[b].position), a, b, versions[a], versions[b]});
+			}
+			if(!locked[b]) {
+				output.push_back({sum.error(vertices[a].position), b, a, versions[b], versions[a]});
+			}
+		};
+		for(const Mesh::Face& face : work) {
+			for(int k=0; k<3; ++k) {
+				// Interior edges appear in two triangles; queue them once.
+				const uint32_t a = indices(face)[k], b = indices(face)[(k + 1) % 3];
+				if(a < b || locked[a] || locked[b]) {
+					consider(a, b, candidates);
+				}
+			}
+		}
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> queue{std::greater<Collapse>{}, std::move(candidates)};
+
+		auto contains = [](const Mesh::Face& face, uint32_t vertex) { return face.v1 == vertex || face.v2 == vertex || face.v3 == vertex; };
+		auto faceNormal = [&](const Mesh::Face& face) {
+			const glm::vec3& a = vertices[face.v1].position;
+			return glm::cross(vertices[face.v2].position - a, vertices[face.v3].position - a);
+		};
+
+		size_t liveFaces = work.size();
+		double largestDistance = 0.0;
+		std::vector<uint32_t> fromNeighbors, toNeighbors;
+		while(liveFaces > targetFaces && !queue.empty()) {
+			const Collapse collapse = queue.top();
+			queue.pop();
+			const uint32_t from = collapse.from, to = collapse.to;
+			if(removedVertex[from] || removedVertex[to] || versions[from] != collapse.fromVersion || versions[to] != collapse.toVersion) {
+				continue;
+			}
+
+			// Link condition: the only vertices next to both ends are the opposite corners of the shared triangles.
+			fromNeighbors.clear();
+			toNeighbors.clear();
+			size_t shared = 0;
+			bool valid = true;
+			for(const uint32_t t : triangles[from]) {
+				if(removedTriangle[t]) {
+					continue;
+				}
+				shared += contains(work[t], to);
+				for(int k=0; k<3; ++k) {
+					fromNeighbors.push_back(indices(work[t])[k]);
+				}
+				// Moving the corner must not flip the triangle.
+				if(!contains(work[t], to)) {
+					Mesh::Face moved = work[t];
+					std::replace(indices(moved), indices(moved) + 3, from, to);
+					if(glm::dot(faceNormal(work[t]), faceNormal(moved)) <= 0.0f) {
+						valid = false;
+						break;
+					}
+				}
+			}
+			if(!valid || shared == 0) {
+				continue;
+			}
+			for(const uint32_t t : triangles[to]) {
+				if(!removedTriangle[t]) {
+					for(int k=0; k<3; ++k) {
+						toNeighbors.push_back(indices(work[t])[k]);
+					}
+				}
+			}
+			std::sort(fromNeighbors.begin(), fromNeighbors.end());
+			fromNeighbors.erase(std::unique(fromNeighbors.begin(), fromNeighbors.end()), fromNeighbors.end());
+			std::sort(toNeighbors.begin(), toNeighbors.end());
+			toNeighbors.erase(std::unique(toNeighbors.begin(), toNeighbors.end()), toNeighbors.end());
+			size_t common = 0;
+			for(const uint32_t vertex : fromNeighbors) {
+				common += (vertex != from && vertex != to && std::binary_search(toNeighbors.begin(), toNeighbors.end(), vertex));
+			}
+			if(common != shared) {
+				continue;
+			}
+
+			// The remaining vertex stands in for the original surface around the removed one: its distance to
+			// those planes is the error in model units. The quadric only orders the collapses; its square root
+			// sums the planes and overstates the distance.
+			const glm::dvec3 position = vertices[to].position;
+			double distance = 0.0;
+			for(const uint32_t t : vertexPlanes[from]) {
+				distance = std::max(distance, std::abs(glm::dot(glm::dvec3{planes[t]}, position) + planes[t].w));
+			}
+			if(distance > double(maxError)) {
+				continue;
+			}
+
+			for(const uint32_t t : triangles[from]) {
+				if(removedTriangle[t]) {
+					continue;
+				}
+				if(contains(work[t], to)) {
+					removedTriangle[t] = 1;
+					--liveFaces;
+				}
+				else {
+					std::replace(indices(work[t]), indices(work[t]) + 3, from, to);
+					triangles[to].push_back(t);
+				}
+			}
+			triangles[from].clear();
+			removedVertex[from] = 1;
+			quadrics[to] += quadrics[from];
+			std::vector<uint32_t>& merged = vertexPlanes[to];
+			merged.insert(merged.end(), vertexPlanes[from].begin(), vertexPlanes[from].end());
+			std::sort(merged.begin(), merged.end());
+			merged.erase(std::unique(merged.begin(), merged.end()), merged.end());
+			vertexPlanes[from] = {};
+			++versions[to];
+			largestDistance = std::max(largestDistance, distance);
+
+			// Keep the live triangles of the remaining vertex once and requeue its edges.
+			std::vector<uint32_t>& around = triangles[to];
+			around.erase(std::remove_if(around.begin(), around.end(), [&](uint32_t t) { return removedTriangle[t] != 0; }), around.end());
+			std::sort(around.begin(), around.end());
+			around.erase(std::unique(around.begin(), around.end()), around.end());
+			toNeighbors.clear();
+			for(const uint32_t t : around) {
+				for(int k=0; k<3; ++k) {
+					if(indices(work[t])[k] != to) {
+						toNeighbors.push_back(indices(work[t])[k]);
+					}
+				}
+			}
+			std::sort(toNeighbors.begin(), toNeighbors.end());
+			toNeighbors.erase(std::unique(toNeighbors.begin(), toNeighbors.end()), toNeighbors.end());
+			candidates.clear();
+			for(const uint32_t vertex : toNeighbors) {
+				consider(to, vertex, candidates);
+			}
+			for(const Collapse& candidate : candidates) {
+				queue.push(candidate);
+			}
+		}
+
+		size_t numFaces = 0;
+		for(size_t t=0; t<work.size(); ++t) {
+			if(!removedTriangle[t]) {
+				work[numFaces++] = work[t];
+			}
+		}
+		work.resize(numFaces);
+		result.error = float(largestDistance);
+		return result;
+	}
+
+	Report optimize(std::vector<Mesh::Vertex>& vertices, std::vector<Mesh::Face>& faces)
+	{
+		Report report;
+		report.verticesBefore = vertices.size();
+		report.facesBefore = faces.size();
+		report.before = analyzeVertexCache(faces, vertices.size());
+
+		weldVertices(vertices, faces);
+		const std::vector<size_t> clusters = optimizeVertexCache(faces, vertices.size());
+		report.clusters = optimizeOverdraw(faces, vertices, clusters);
+		optimizeVertexFetch(vertices, faces);
+
+		report.verticesAfter = vertices.size();
+		report.facesAfter = faces.size();
+		report.after = analyzeVertexCache(faces, vertices.size());
+		return report;
+	}
+}
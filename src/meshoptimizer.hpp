@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+#include "mesh.hpp"
+
+// Reordering of imported meshes for the GPU: Assimp emits triangles and vertices in file order, which leaves
+// the post-transform vertex cache hit rate, overdraw and vertex fetch locality to chance. Every step keeps the
+// rendered triangles and their winding; only their order and the numbering of the vertices change.
+namespace MeshOptimizer
+{
+	// Post-transform cache modeled by the optimizer and the statistics: a FIFO of this many vertices.
+	constexpr int CacheSize = 16;
+
+	struct CacheStatistics
+	{
+		size_t misses = 0;  // Vertices transformed.
+		double acmr = 0.0;  // Average cache miss ratio: transformed vertices per triangle (0.5 at best, 3 at worst).
+		double atvr = 0.0;  // Average transformed vertex ratio: transformed vertices per vertex (1 at best).
+	};
+
+	/**
+	 * @brief Simulates the FIFO post-transform cache over the index buffer.
+	 */
+	CacheStatistics analyzeVertexCache(const std::vector<Mesh::Face>& faces, size_t numVertices, int cacheSize = CacheSize);
+
+	/**
+	 * @brief Merges vertices with identical attributes, found by hashing their bytes, and drops the triangles
+	 * that become degenerate. Returns the number of vertices removed.
+	 */
+	size_t weldVertices(std::vector<Mesh::Vertex>& vertices, std::vector<Mesh::Face>& faces);
+
+	/**
+	 * @brief Reorders the triangles for the vertex cache with Tipsify (Sander et al., "Fast Triangle Reordering
+	 * for Vertex Locality and Reduced Overdraw"): fans around the next vertex that is still in the cache and has
+	 * triangles left, in linear time. Returns the first triangle of every cluster, the runs between the points
+	 * where the fan had to restart outside the cache, so moving whole clusters costs few extra cache misses.
+	 */
+	std::vector<size_t> optimizeVertexCache(std::vector<Mesh::Face>& faces, size_t numVertices, int cacheSize = CacheSize);
+
+	/**
+	 * @brief Sorts the clusters of optimizeVertexCache so the ones facing away from the mesh center, which tend to
+	 * occlude the rest, are drawn first. Clusters are split further wherever the triangles so far, drawn with an
+	 * empty cache, stay within the threshold factor of the cluster's ACMR, which bounds the cost of the new order.
+	 * Returns the number of pieces sorted.
+	 */
+	size_t optimizeOverdraw(std::vector<Mesh::Face>& faces, const std::vector<Mesh::Vertex>& vertices, const std::vector<size_t>& clusters,
+						  float threshold = 1.05f);
+
+	/**
+	 * @brief Renumbers the vertices in the order the triangles first use them, so vertex fetch walks the vertex
+	 * buffer forward; unreferenced vertices are removed.
+	 */
+	void optimizeVertexFetch(std::vector<Mesh::Vertex>& vertices, std::vector<Mesh::Face>& faces);
+
+	struct Simplified
+	{
+		std::vector<Mesh::Face> faces;
+		float error = 0.0f;  // Largest distance of a collapsed-onto vertex to the original planes it replaces, in model units.
+	};
+
+	/**
+	 * @brief Simplifies the triangles with quadric error metric edge collapses (Garland and Heckbert) onto existing
+	 * vertices, so the result indexes the same vertices. Vertices on edges with a single triangle, which are the
+	 * open borders and, after welding, the attribute seams, stay in place, and collapses that flip a triangle or
+	 * break the manifold are skipped, as are collapses whose error would exceed maxError. The quadrics order the
+	 * collapses; the error is the distance of the remaining vertex to the original triangle planes around the
+	 * removed one. Stops at the target triangle count or when no collapse is left.
+	 */
+	Simplified simplify(const std::vector<Mesh::Vertex>& vertices, const std::vector<Mesh::Face>& faces, size_t targetFaces,
+						float maxError = std::numeric_limits<float>::max());
+
+	struct Report
+	{
+		size_t verticesBefore = 0, verticesAfter = 0;
+		size_t facesBefore = 0, facesAfter = 0;
+		size_t clusters = 0;  // Pieces ordered for overdraw.
+		CacheStatistics before, after;
+	};
+
+	/**
+	 * @brief Runs all steps in order; returns the counts and the cache statistics before and after.
+	 */
+	Report optimize(std::vector<Mesh::Vertex>& vertices, std::vector<Mesh::Face>& faces);
+}
@@ -0,0 +1,297 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <limits>
+#include <stdexcept>
+
+#include "image.hpp"
+#include "mipmaps.hpp"
+#include "simd.hpp"
+#include "threading.hpp"
+#include "utils.hpp"
+
+namespace
+{
+	constexpr float PI = 3.14159265f;
+
+	// Radius (in destination texels) and shape of the windowed sinc filters.
+	constexpr float KaiserWidth = 3.0f;
+	constexpr float KaiserAlpha = 4.0f;
+	constexpr float LanczosWidth = 3.0f;
+
+	float sinc(float x)
+	{
+		return std::fabs(x) < 1e-5f ? 1.0f : std::sin(PI * x) / (PI * x);
+	}
+
+	// Zeroth order modified Bessel function of the first kind.
+	float besselI0(float x)
+	{
+		float sum = 1.0f, term = 1.0f;
+		for(int k=1; k<32 && term > sum * 1e-8f; ++k) {
+			term *= (x / (2.0f * k)) * (x / (2.0f * k));
+			sum += term;
+		}
+		return sum;
+	}
+
+	float filterSupport(Mipmaps::Filter filter)
+	{
+		switch(filter) {
+		case Mipmaps::Filter::Kaiser:  return KaiserWidth;
+		case Mipmaps::Filter::Lanczos: return LanczosWidth;
+		default:                       return 0.5f;
+		}
+	}
+
+	float filterWeight(Mipmaps::Filter filter, float t)
+	{
+		const float x = std::fabs(t);
+		switch(filter) {
+		case Mipmaps::Filter::Kaiser:
+			if(x >= KaiserWidth) {
+				return 0.0f;
+			}
+			return sinc(x) * besselI0(KaiserAlpha * std::sqrt(1.0f - (x / KaiserWidth) * (x / KaiserWidth))) / besselI0(KaiserAlpha);
+		case Mipmaps::Filter::Lanczos:
+			return x < LanczosWidth ? sinc(x) * sinc(x / LanczosWidth) : 0.0f;
+		default:
+			return x <= 0.5f ? 1.0f : 0.0f;
+		}
+	}
+
+	// Normalized taps of every destination texel along one axis; sources past the edges are clamped.
+	struct AxisKernel
+	{
+		struct Tap
+		{
+			int index;
+			float weight;
+		};
+		std::vector<std::vector<Tap>> taps;
+	};
+
+	AxisKernel buildKernel(Mipmaps::Filter filter, int sourceSize, int destinationSize)
+	{
+		AxisKernel kernel;
+		kernel.taps.resize(destinationSize);
+
+		// The filter is defined in destination texels, i.e. stretched by the reduction factor in the source.
+		const float scale = float(sourceSize) / float(destinationSize);
+		const float support = filterSupport(filter) * scale;
+		for(int d=0; d<destinationSize; ++d) {
+			const float center = (d + 0.5f) * scale;
+			const int first = int(std::floor(center - support));
+			const int last = int(std::ceil(center + support));
+
+			float total = 0.0f;
+			std::vector<AxisKernel::Tap>& taps = kernel.taps[d];
+			for(int s=first; s<=last; ++s) {
+				const float weight = filterWeight(filter, (s + 0.5f - center) / scale);
+				if(weight != 0.0f) {
+					taps.push_back({std::clamp(s, 0, sourceSize - 1), weight});
+					total += weight;
+				}
+			}
+			for(AxisKernel::Tap& tap : taps) {
+				tap.weight /= total;
+			}
+		}
+		return kernel;
+	}
+
+	float srgbToLinear(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float linearToSRGB(float value)
+	{
+		return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+	}
+
+	// Converts 8-bit samples to the space they are filtered in.
+	std::vector<float> decodeLevel(const unsigned char* pixels, size_t numPixels, int channels, Mipmaps::Content content)
+	{
+		float srgbTable[256];
+		for(int i=0; i<256; ++i) {
+			srgbTable[i] = srgbToLinear(i / 255.0f);
+		}
+
+		std::vector<float> values(numPixels * channels);
+		for(size_t i=0; i<values.size(); ++i) {
+			const int channel = int(i % channels);
+			const unsigned char value = pixels[i];
+			if(channel == 3) {
+				values[i] = value / 255.0f;
+			}
+			else if(content == Mipmaps::Content::SRGB) {
+				values[i] = srgbTable[value];
+			}
+			else if(content == Mipmaps::Content::NormalMap) {
+				values[i] = value / 127.5f - 1.0f;
+			}
+			else {
+				values[i] = value / 255.0f;
+			}
+		}
+		return values;
+	}
+
+	unsigned char encodeSample(float value, int channel, Mipmaps::Content content)
+	{
+		if(channel != 3) {
+			if(content == Mipmaps::Content::SRGB) {
+				value = linearToSRGB(std::clamp(value, 0.0f, 1.0f));
+			}
+			else if(content == Mipmaps::Content::NormalMap) {
+				value = value * 0.5f + 0.5f;
+			}
+		}
+		return static_cast<unsigned char>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	// Reduces one level: every destination row is filtered vertically across the source rows (vectorized over
+	// the whole row), then horizontally.
+	std::vector<float> reduceLevel(const std::vector<float>& source, int width, int height, int channels,
+								   int nextWidth, int nextHeight, const Mipmaps::Settings& settings)
+	{
+		const AxisKernel horizontal = buildKernel(settings.filter, width, nextWidth);
+		const AxisKernel vertical = buildKernel(settings.filter, height, nextHeight);
+		const size_t rowLength = size_t(width) * channels;
+		const size_t nextRowLength = size_t(nextWidth) * channels;
+
+		std::vector<float> result(nextRowLength * nextHeight);
+		ThreadPool::instance().parallelFor(size_t(nextHeight), [&](size_t y) {
+			std::vector<float> column(rowLength, 0.0f);
+			for(const AxisKernel::Tap& tap : vertical.taps[y]) {
+				const float* row = source.data() + size_t(tap.index) * rowLength;
+				const SIMD::Float weight = tap.weight;
+				size_t i = 0;
+				for(; i + SIMD::Width <= rowLength; i += SIMD::Width) {
+					SIMD::fmadd(SIMD::Float::load(row + i), weight, SIMD::Float::load(column.data() + i)).store(column.data() + i);
+				}
+				for(; i < rowLength; ++i) {
+					column[i] += row[i] * tap.weight;
+				}
+			}
+
+			float* output = result.data() + y * nextRowLength;
+			for(int x=0; x<nextWidth; ++x) {
+				float* texel = output + size_t(x) * channels;
+				std::fill(texel, texel + channels, 0.0f);
+				for(const AxisKernel::Tap& tap : horizontal.taps[x]) {
+					const float* sample = column.data() + size_t(tap.index) * channels;
+					for(int c=0; c<channels; ++c) {
+						texel[c] += sample[c] * tap.weight;
+					}
+				}
+
+				if(settings.content == Mipmaps::Content::NormalMap && channels >= 3) {
+					const float length = std::sqrt(texel[0] * texel[0] + texel[1] * texel[1] + texel[2] * texel[2]);
+					if(length > 1e-6f) {
+						texel[0] /= length;
+						texel[1] /= length;
+						texel[2] /= length;
+					}
+					else {
+						texel[0] = texel[1] = 0.0f;
+						texel[2] = 1.0f;
+					}
+				}
+			}
+		});
+		return result;
+	}
+
+	// Peak signal to noise ratio of 8-bit data over the given channels of every texel.
+	struct ErrorSum
+	{
+		double squaredError = 0.0;
+		size_t count = 0;
+
+		void add(const unsigned char* a, const unsigned char* b, size_t numPixels, int channels, int comparedChannels)
+		{
+			for(size_t i=0; i<numPixels; ++i) {
+				for(int c=0; c<comparedChannels; ++c) {
+					const double difference = double(a[i * channels + c]) - double(b[i * channels + c]);
+					squaredError += difference * difference;
+				}
+			}
+			count += numPixels * comparedChannels;
+		}
+
+		double psnr() const
+		{
+			const double mse = squaredError / double(std::max<size_t>(count, 1));
+			return mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : std::numeric_limits<double>::infinity();
+		}
+	};
+}
+
+namespace Mipmaps
+{
+	MipChain generate(const Image& image, const Settings& settings)
+	{
+		if(image.isHDR()) {
+			throw std::invalid_argument("Mip chains can only be generated for 8-bit images");
+		}
+
+		MipChain chain;
+		chain.width = image.width();
+		chain.height = image.height();
+		chain.channels = image.channels();
+
+		const int levels = Utility::numMipmapLevels(chain.width, chain.height);
+		const unsigned char* pixels = image.pixels<unsigned char>();
+		chain.levels.emplace_back(pixels, pixels + size_t(image.pitch()) * image.height());
+
+		std::vector<float> values = decodeLevel(pixels, size_t(chain.width) * chain.height, chain.channels, settings.content);
+		for(int level=1; level<levels; ++level) {
+			// Each level is reduced from the unquantized values of the previous one.
+			values = reduceLevel(values, chain.levelWidth(level - 1), chain.levelHeight(level - 1), chain.channels,
+								 chain.levelWidth(level), chain.levelHeight(level), settings);
+
+			std::vector<unsigned char> encoded(values.size());
+			for(size_t i=0; i<values.size(); ++i) {
+				encoded[i] = encodeSample(values[i], int(i % chain.channels), settings.content);
+			}
+			chain.levels.push_back(std::move(encoded));
+		}
+		return chain;
+	}
+
+	MipChain compress(const MipChain& chain, BlockCompression::Format format, const std::string& name)
+	{
+		MipChain compressed;
+		compressed.width = chain.width;
+		compressed.height = chain.height;
+		compressed.channels = chain.channels;
+		compressed.compression = format;
+
+		const auto startTime = std::chrono::steady_clock::now();
+		size_t sourceBytes = 0, compressedBytes = 0;
+		for(const std::vector<unsigned char>& level : chain.levels) {
+			const int index = int(compressed.levels.size());
+			compressed.levels.push_back(BlockCompression::compress(level.data(), chain.levelWidth(index), chain.levelHeight(index), chain.channels, format));
+			sourceBytes += level.size();
+			compressedBytes += compressed.levels.back().size();
+		}
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+
+		ErrorSum error;
+		const int comparedChannels = BlockCompression::encodedChannels(format, chain.channels);
+		for(size_t level=0; level<chain.levels.size(); ++level) {
+			const int width = chain.levelWidth(int(level)), height = chain.levelHeight(int(level));
+			const std::vector<unsigned char> decoded = BlockCompression::decompress(compressed.levels[level].data(), width, height, chain.channels, format);
+			error.add(chain.levels[level].data(), decoded.data(), size_t(width) * height, chain.channels, comparedChannels);
+		}
+
+		static const char* FormatNames[] = {"none", "BC4", "BC5", "BC7"};
+		std::printf("Compressed %s (%s, %zu levels): %.2f MB -> %.2f MB (%.1f:1), %.1f MB/s, PSNR %.2f dB\n",
+					name.c_str(), FormatNames[int(format)], chain.levels.size(), sourceBytes / 1048576.0, compressedBytes / 1048576.0,
+					double(sourceBytes) / double(compressedBytes), sourceBytes / 1048576.0 / seconds, error.psnr());
+		return compressed;
+	}
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "blockcompression.hpp"
+
+class Image;
+
+// Mip chains for 8-bit material textures, filtered on the CPU instead of by glGenerateTextureMipmap.
+// The result does not depend on the driver and is filtered in linear space for sRGB data; chains are
+// stored in texture containers (see TextureContainer) so later runs only upload them.
+namespace Mipmaps
+{
+	enum class Filter
+	{
+		Box,      // 2x2 average.
+		Kaiser,   // Kaiser-windowed sinc (width 3, alpha 4): sharp with little ringing.
+		Lanczos,  // Lanczos-3 windowed sinc: sharpest, rings slightly on hard edges.
+	};
+
+	// How the samples are interpreted while filtering.
+	enum class Content
+	{
+		Linear,     // Filtered as stored (roughness, metalness, ...).
+		SRGB,       // Color channels decoded to linear light, filtered, and encoded again.
+		NormalMap,  // Tangent-space normals: filtered in [-1, 1] and renormalized on every level.
+	};
+
+	struct Settings
+	{
+		Filter filter = Filter::Kaiser;
+		Content content = Content::Linear;
+		BlockCompression::Format compression = BlockCompression::Format::None;
+	};
+
+	/**
+	 * @brief An 8-bit image with its complete mip chain, level 0 first, rows tightly packed
+	 * or, for compressed chains, the blocks of every level.
+	 */
+	struct MipChain
+	{
+		int width = 0, height = 0, channels = 0;
+		BlockCompression::Format compression = BlockCompression::Format::None;
+		std::vector<std::vector<unsigned char>> levels;
+
+		int levelWidth(int level) const { return width >> level > 0 ? width >> level : 1; }
+		int levelHeight(int level) const { return height >> level > 0 ? height >> level : 1; }
+	};
+
+	/**
+	 * @brief Builds every level down to 1x1 with the given filter, in parallel rows on the thread pool.
+	 */
+	MipChain generate(const Image& image, const Settings& settings);
+
+	/**
+	 * @brief Encodes every level of an uncompressed chain; reports the compression ratio, throughput and PSNR.
+	 */
+	MipChain compress(const MipChain& chain, BlockCompression::Format format, const std::string& name);
+}
@@ -1,13 +1,29 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include <iterator>
+#include <limits>
 #include <stdexcept>
 #include <memory>
+#include <mutex>
+#include <thread>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
 #include <glm/gtx/euler_angles.hpp>
 
 #include <GLFW/glfw3.h>
 
+#include "ibl.hpp"
+#include "iblcache.hpp"
+#include "material.hpp"
 #include "mesh.hpp"
+#include "sampletables.hpp"
+#include "texturecontainer.hpp"
+#include "threading.hpp"
 #include "image.hpp"
 #include "utils.hpp"
 
@@ -24,6 +40,20 @@ namespace RendererDetails
 		glm::mat4 viewProjectionMatrix;
 		glm::mat4 skyProjectionMatrix;
 		glm::mat4 sceneRotationMatrix;
+		glm::vec4 positionScale;   // Dequantizes packed positions (Mesh::PackedVertices); 1 and 0 for float vertices.
+		glm::vec4 positionOffset;
+	};
+
+	/**
+	 * @brief Layout of the commands in a GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect.
+	 */
+	struct DrawElementsIndirectCommand
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
 	};
 
 	/**
@@ -38,8 +68,143 @@ namespace RendererDetails
 		} lights[SceneSettings::MaxLights]; // Assuming SceneSettings::MaxLights is a defined constant
 
 		glm::vec4 eyePosition;
+		glm::vec4 irradianceSH[9];
+	};
+
+	/**
+	 * @brief Measures the GPU time of the commands issued between construction and elapsedMilliseconds().
+	 */
+	class GPUTimer
+	{
+	public:
+		GPUTimer()
+		{
+			glCreateQueries(GL_TIME_ELAPSED, 1, &m_query);
+			glBeginQuery(GL_TIME_ELAPSED, m_query);
+		}
+		~GPUTimer()
+		{
+			glDeleteQueries(1, &m_query);
+		}
+		double elapsedMilliseconds()
+		{
+			GLuint64 nanoseconds = 0;
+			glEndQuery(GL_TIME_ELAPSED);
+			glGetQueryObjectui64v(m_query, GL_QUERY_RESULT, &nanoseconds);
+			return double(nanoseconds) * 1e-6;
+		}
+
+	private:
+		GLuint m_query = 0;
+	};
+
+	/**
+	 * @brief Records which thread ran each startup step and when, to show how much of the asset loading overlaps.
+	 */
+	class StartupTimeline
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+
+		explicit StartupTimeline(Clock::time_point origin) : m_origin(origin), m_mainThread(std::this_thread::get_id()) {}
+
+		// Runs func() and records it as a step of the calling thread.
+		template <typename Func>
+		auto measure(const std::string &label, Func func) -> decltype(func())
+		{
+			struct Scope
+			{
+				StartupTimeline &timeline;
+				const std::string &label;
+				Clock::time_point begin = Clock::now();
+				~Scope() { timeline.add(label, std::this_thread::get_id(), begin, Clock::now()); }
+			} scope{*this, label};
+			return func();
+		}
+
+		void add(const std::string &label, std::thread::id thread, Clock::time_point begin, Clock::time_point end)
+		{
+			std::lock_guard<std::mutex> lock{m_mutex};
+			m_steps.push_back({label, thread, milliseconds(begin), milliseconds(end)});
+		}
+
+		void print(Clock::time_point end) const
+		{
+			constexpr int BarWidth = 48;
+
+			std::lock_guard<std::mutex> lock{m_mutex};
+			const double total = std::max(milliseconds(end), 1e-3);
+
+			// Threads are numbered in order of their first step; the main (GL context) thread is listed as "main".
+			std::vector<std::thread::id> threads{m_mainThread};
+			double busy = 0.0;
+			std::printf("Startup timeline (%.1f ms):\n", total);
+			for (const Step &step : m_steps)
+			{
+				auto thread = std::find(threads.begin(), threads.end(), step.thread);
+				if (thread == threads.end())
+				{
+					thread = threads.insert(threads.end(), step.thread);
+				}
+				const std::string threadName = (thread == threads.begin()) ? "main" : "worker " + std::to_string(thread - threads.begin());
+
+				char bar[BarWidth + 1];
+				const int first = glm::clamp(int(step.begin / total * BarWidth), 0, BarWidth - 1);
+				const int last = glm::clamp(int(step.end / total * BarWidth), first, BarWidth - 1);
+				for (int i = 0; i < BarWidth; ++i)
+				{
+					bar[i] = (i >= first && i <= last) ? '#' : '.';
+				}
+				bar[BarWidth] = '\0';
+
+				std::printf("  %-9s %-28s %8.1f %8.1f  %s\n", threadName.c_str(), step.label.c_str(), step.begin, step.end, bar);
+				busy += step.end - step.begin;
+			}
+			std::printf("  %.1f ms of recorded work in %.1f ms (%.2fx overlap)\n", busy, total, busy / total);
+		}
+
+	private:
+		struct Step
+		{
+			std::string label;
+			std::thread::id thread;
+			double begin, end;
+		};
+
+		double milliseconds(Clock::time_point time) const
+		{
+			return std::chrono::duration<double, std::milli>(time - m_origin).count();
+		}
+
+		Clock::time_point m_origin;
+		std::thread::id m_mainThread;
+		mutable std::mutex m_mutex;
+		std::vector<Step> m_steps;
 	};
 
+	// Split-sum BRDF LUT generated at build time (kEmbeddedBRDF_LUT_Size, kEmbeddedBRDF_LUT).
+#include "spbrdf_lut.inc"
+
+	// Video memory of a texture with its mip chain.
+	size_t textureBytes(const Texture &texture, int bytesPerTexel, int layers)
+	{
+		size_t bytes = 0;
+		for (int level = 0; level < texture.levels; ++level)
+		{
+			bytes += size_t(glm::max(texture.width >> level, 1)) * glm::max(texture.height >> level, 1) * bytesPerTexel * layers;
+		}
+		return bytes;
+	}
+
+	// Uploads an importance-sample table into an immutable shader storage buffer.
+	GLuint createSampleBuffer(const std::vector<glm::vec4> &samples)
+	{
+		GLuint buffer;
+		glCreateBuffers(1, &buffer);
+		glNamedBufferStorage(buffer, samples.size() * sizeof(glm::vec4), samples.data(), 0);
+		return buffer;
+	}
+
 	void SetGLFWWindowHints()
 	{
 		glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
@@ -69,6 +234,9 @@ namespace RendererDetails
 		glEnable(GL_CULL_FACE);
 		glEnable(GL_TEXTURE_CUBE_MAP_SEAMLESS);
 		glFrontFace(GL_CCW);
+
+		// Uploaded rows are tightly packed, including RGB mip levels of odd width.
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
 	}
 
 }
@@ -128,30 +296,103 @@ void Renderer::shutdown()
 	// Assuming these are actual cleanup methods you have defined
 	deleteMeshBuffer(m_skybox);
 	deleteMeshBuffer(m_pbrModel);
+	m_uploadRing.destroy();
 
 	glDeleteProgram(m_tonemapProgram);
 	glDeleteProgram(m_skyboxProgram);
 	glDeleteProgram(m_pbrProgram);
 
-	deleteTexture(m_envTexture);
-	deleteTexture(m_irmapTexture);
+	if (m_iblBake)
+	{
+		releaseIBLBake(*m_iblBake);
+		m_iblBake.reset();
+	}
+	for (GLuint program : {m_bakePrograms.equirectToCube, m_bakePrograms.spmap, m_bakePrograms.irmap, m_bakePrograms.shProject, m_bakePrograms.shReduce})
+	{
+		glDeleteProgram(program);
+	}
+
+	for (EnvironmentLibrary::Entry &entry : m_environments.entries)
+	{
+		deleteTexture(entry.resources.envTexture);
+		deleteTexture(entry.resources.irmapTexture);
+	}
+	m_environments.entries.clear();
+	m_ibl = IBLResources{};
 	deleteTexture(m_spBRDF_LUT);
 	deleteTexture(m_albedoTexture);
 	deleteTexture(m_normalTexture);
-	deleteTexture(m_metalnessTexture);
-	deleteTexture(m_roughnessTexture);
+	deleteTexture(m_ormTexture);
 }
 
 void Renderer::setup()
 {
-	// Parameters
-	static constexpr int kEnvMapSize = 1024;
-	static constexpr int kIrradianceMapSize = 32;
-	static constexpr int kBRDF_LUT_Size = 256;
+	const auto startTime = std::chrono::steady_clock::now();
+	auto timeline = std::make_shared<RendererDetails::StartupTimeline>(startTime);
+
+	// Decoding images and importing meshes is pure CPU work: it runs on the worker pool while this
+	// thread compiles shaders. Only the uploads below need the GL context.
+	ThreadPool &pool = ThreadPool::instance();
+	auto loadMesh = [&pool, timeline](const std::string &filename)
+	{
+		return pool.submit([timeline, filename]()
+		{
+			return timeline->measure("import " + filename.substr(filename.find_last_of('/') + 1), [&]() { return Mesh::fromFile(filename); });
+		});
+	};
+	// Block compression needs the CPU mip chain; the driver cannot generate mips of compressed textures.
+	const bool compressTextures = m_settings.compressTextures && m_settings.textureMipmaps != TextureMipmapMode::Driver;
+	const TextureMipmapMode mipmapMode = m_settings.textureMipmaps;
+	auto loadContainer = [mipmapMode, compressTextures](const std::string &filename)
+	{
+		const Mipmaps::Filter filter = (mipmapMode == TextureMipmapMode::Box)    ? Mipmaps::Filter::Box
+									 : (mipmapMode == TextureMipmapMode::Lanczos) ? Mipmaps::Filter::Lanczos
+																				  : Mipmaps::Filter::Kaiser;
+		const Material::TextureSettings texture = Material::textureSettings(filename, filter, compressTextures);
+		if (mipmapMode == TextureMipmapMode::Driver && !TextureContainer::isContainer(filename))
+		{
+			const std::shared_ptr<Image> image = Image::fromFile(filename, texture.channels);
+			const unsigned char *pixels = image->pixels<unsigned char>();
+			return TextureContainer::fromChain({image->width(), image->height(), image->channels(), BlockCompression::Format::None,
+												{{pixels, pixels + size_t(image->pitch()) * image->height()}}},
+											   texture.mipmaps.content);
+		}
+		return TextureContainer::loadOrConvert(filename, texture.channels, texture.mipmaps);
+	};
+	auto fileName = [](const std::string &path) { return path.substr(path.find_last_of('/') + 1); };
+	auto loadImage = [&pool, timeline, loadContainer, fileName](const std::string &filename)
+	{
+		return pool.submit([=]()
+		{
+			return timeline->measure("decode " + fileName(filename), [&]() { return loadContainer(filename); });
+		});
+	};
+	// Occlusion, roughness and metalness share one texture, packed from the separate maps if necessary.
+	auto loadORM = [&pool, timeline, loadContainer, fileName](const std::string &materialPrefix)
+	{
+		return pool.submit([=]()
+		{
+			const std::string filename = timeline->measure("pack ORM", [&]() { return Material::packORM(materialPrefix); });
+			return timeline->measure("decode " + fileName(filename), [&]() { return loadContainer(filename); });
+		});
+	};
+
+	std::future<std::shared_ptr<Mesh>> skyboxMesh = loadMesh("data/meshes/skybox.obj");
+	std::future<std::shared_ptr<Mesh>> pbrMesh = loadMesh("data/meshes/Flaski.fbx");
+	std::future<std::shared_ptr<TextureContainer>> albedoImage = loadImage("data/textures/flaski/Flaski_DefaultMaterial_BaseColor.png");
+	std::future<std::shared_ptr<TextureContainer>> normalImage = loadImage("data/textures/flaski/Flaski_DefaultMaterial_Normal.png");
+	std::future<std::shared_ptr<TextureContainer>> ormImage = loadORM("data/textures/flaski/Flaski_DefaultMaterial_");
+
+	// The environment (cache lookup or decoding) loads on its own thread from here on as well.
+	const auto iblStartTime = std::chrono::steady_clock::now();
+	std::unique_ptr<IBLBakeJob> iblJob = startIBLBake(m_currentEnvironment);
 
 	// Set global OpenGL state.
 	RendererDetails::SetGlobalOpenGLState();
 
+	// Staging buffer the mesh and texture data is uploaded through.
+	m_uploadRing.create(m_settings.uploadRingMB << 20);
+
 	// Create empty VAO for rendering full screen triangle.
 	glCreateVertexArrays(1, &m_emptyVAO);
 
@@ -159,103 +400,985 @@ void Renderer::setup()
 	m_transformUB = createUniformBuffer<RendererDetails::TransformUB>();
 	m_shadingUB = createUniformBuffer<RendererDetails::ShadingUB>();
 
-	// Load assets & compile/link rendering programs.
-	m_tonemapProgram = linkProgram({compileShader("shaders/tonemap.vs", GL_VERTEX_SHADER),
-									compileShader("shaders/tonemap.fs", GL_FRAGMENT_SHADER)});
+	// Compile/link rendering programs.
+	timeline->measure("compile tonemap", [&]()
+	{
+		m_tonemapProgram = linkProgram({compileShader("shaders/tonemap.vs", GL_VERTEX_SHADER),
+										compileShader("shaders/tonemap.fs", GL_FRAGMENT_SHADER)});
+	});
+	timeline->measure("compile skybox", [&]()
+	{
+		m_skyboxProgram = linkProgram({compileShader("shaders/skybox.vs", GL_VERTEX_SHADER),
+									   compileShader("shaders/skybox.fs", GL_FRAGMENT_SHADER)});
+	});
+
+	const bool irradianceSH = m_settings.irradianceMode != IrradianceMode::Cubemap;
+
+	std::vector<std::string> pbrDefines;
+	if (irradianceSH)
+	{
+		pbrDefines.push_back("IRRADIANCE_SH");
+	}
+	if (m_settings.brdfMode == BRDFMode::Analytic)
+	{
+		pbrDefines.push_back("BRDF_ANALYTIC");
+	}
+	if (compressTextures)
+	{
+		pbrDefines.push_back("NORMAL_MAP_RG");
+	}
+
+	std::vector<std::string> pbrVertexDefines;
+	if (m_settings.packedVertices)
+	{
+		pbrVertexDefines.push_back("PACKED_VERTICES");
+	}
+
+	timeline->measure("compile pbr", [&]()
+	{
+		m_pbrProgram = linkProgram({compileShader("shaders/pbr.vs", GL_VERTEX_SHADER, pbrVertexDefines),
+									compileShader("shaders/pbr.fs", GL_FRAGMENT_SHADER, pbrDefines)});
+	});
+	timeline->measure("compile IBL bake", [&]() { createBakePrograms(); });
+
+	// Upload the decoded assets; get() rethrows any loading error here.
+	timeline->measure("upload meshes", [&]()
+	{
+		m_skybox = createMeshBuffer(skyboxMesh.get());
+		m_pbrModel = createMeshBuffer(pbrMesh.get(), m_settings.packedVertices);
+		m_uploadRing.submit();
+	});
+	// The material textures stream in from the first frame on: neutral placeholders until they have loaded, then
+	// their smallest levels, refined to full resolution by updateTextureStreaming().
+	m_textureStreamer.startTime = startTime;
+	streamTexture("albedo", m_albedoTexture, std::move(albedoImage), glm::vec4{0.5f, 0.5f, 0.5f, 1.0f});
+	streamTexture("normal", m_normalTexture, std::move(normalImage), glm::vec4{0.5f, 0.5f, 1.0f, 1.0f});
+	streamTexture("ORM", m_ormTexture, std::move(ormImage), glm::vec4{1.0f, 1.0f, 0.0f, 1.0f});
+
+	// Load the image-based lighting resources from the on-disk cache, or bake and cache them.
+	const bool iblCacheHit = timeline->measure("IBL upload/bake", [&]()
+	{
+		const bool cacheHit = setupIBL(*iblJob);
+		glFinish();
+		return cacheHit;
+	});
+	timeline->add(iblJob->cacheHit ? "load cached IBL" : "load environment", iblJob->loadingThread, iblJob->loadingStart, iblJob->loadingEnd);
+	iblJob.reset();
+	const auto iblEndTime = std::chrono::steady_clock::now();
+	m_environmentSwapTime = iblEndTime;
+
+	timeline->measure("BRDF LUT", [&]()
+	{
+		setupBRDF_LUT();
+		glFinish();
+	});
+
+	const auto endTime = std::chrono::steady_clock::now();
+	std::printf("IBL resources (%s): %.1f ms\n", iblCacheHit ? "warm cache" : "cold cache",
+				std::chrono::duration<double, std::milli>(iblEndTime - iblStartTime).count());
+	std::printf("Startup: %.1f ms\n", std::chrono::duration<double, std::milli>(endTime - startTime).count());
+	timeline->print(endTime);
+
+	if(!m_settings.iblDumpDirectory.empty())
+	{
+		dumpIBLTextures(m_settings.iblDumpDirectory);
+	}
+}
+
+bool Renderer::setupIBL(IBLBakeJob &job)
+{
+	while (!advanceIBLBake(job, std::numeric_limits<double>::infinity()))
+	{
+	}
+
+	const bool cacheHit = job.cacheHit;
+	const uint64_t cacheKey = job.cacheKey;
+	finishIBLBake(job);
+	++m_environments.stats.misses;
+	activateEnvironment(*findResidentEnvironment(job.environmentIndex));
+
+	const IBLCache cache{kIBLCacheDirectory};
+	if (cacheHit)
+	{
+		std::printf("Loaded cached IBL resources: %s\n", cache.path(cacheKey).c_str());
+	}
+	else if (m_settings.iblCache)
+	{
+		cache.store(cacheKey, readbackIBL());
+		std::printf("Stored IBL resources: %s\n", cache.path(cacheKey).c_str());
+	}
+	return cacheHit;
+}
+
+uint64_t Renderer::iblCacheKey(const std::string &environmentFile) const
+{
+	static const char *kernelSources[] = {
+		"shaders/equirect2cube.cs",
+		"shaders/spmap.cs",
+		"shaders/irmap.cs",
+		"shaders/shproject.cs",
+		"shaders/shreduce.cs",
+	};
+
+	Utility::Hash64 hash;
+
+	for (const std::string &file : IBL::environmentFiles(environmentFile))
+	{
+		const std::vector<char> environment = FileUtility::readBinary(file);
+		hash.update(environment.data(), environment.size());
+	}
+	for (const char *source : kernelSources)
+	{
+		hash.update(FileUtility::readText(source));
+	}
+
+	hash.update(kEnvMapSize);
+	hash.update(kIrradianceMapSize);
+	hash.update(kSHProjectionSize);
+	hash.update(kSpecularSamples);
+	hash.update(kIrradianceSamples);
+	hash.update(kFilteredIrradianceSamples);
+	hash.update(m_settings.irradianceMode);
+	hash.update(m_settings.filteredIrradiance);
+	hash.update(m_settings.prefilterMode);
+	return hash.value();
+}
+
+void Renderer::createBakePrograms()
+{
+	m_bakePrograms.equirectToCube = linkProgram({compileShader("shaders/equirect2cube.cs", GL_COMPUTE_SHADER)});
+	if (m_settings.prefilterMode == SpecularPrefilterMode::SingleDispatch)
+	{
+		GLint maxImageUniforms = 0;
+		glGetIntegerv(GL_MAX_COMPUTE_IMAGE_UNIFORMS, &maxImageUniforms);
+		m_bakePrograms.spmapLevelsPerDispatch = glm::clamp(maxImageUniforms, 1, 16);
+		m_bakePrograms.spmap = linkProgram({compileShader("shaders/spmap.cs", GL_COMPUTE_SHADER,
+			{"SINGLE_DISPATCH", "MIP_LEVEL_COUNT " + std::to_string(m_bakePrograms.spmapLevelsPerDispatch)})});
+	}
+	else
+	{
+		m_bakePrograms.spmap = linkProgram({compileShader("shaders/spmap.cs", GL_COMPUTE_SHADER)});
+	}
+	if (m_settings.irradianceMode == IrradianceMode::Cubemap)
+	{
+		std::vector<std::string> irmapDefines;
+		if (m_settings.filteredIrradiance)
+		{
+			irmapDefines.push_back("FILTERED_IMPORTANCE_SAMPLING");
+		}
+		m_bakePrograms.irmap = linkProgram({compileShader("shaders/irmap.cs", GL_COMPUTE_SHADER, irmapDefines)});
+	}
+	else if (m_settings.irradianceMode == IrradianceMode::SHCompute)
+	{
+		m_bakePrograms.shProject = linkProgram({compileShader("shaders/shproject.cs", GL_COMPUTE_SHADER)});
+		m_bakePrograms.shReduce = linkProgram({compileShader("shaders/shreduce.cs", GL_COMPUTE_SHADER)});
+	}
+}
+
+std::unique_ptr<IBLBakeJob> Renderer::startIBLBake(int environmentIndex)
+{
+	std::unique_ptr<IBLBakeJob> job{new IBLBakeJob};
+	job->environmentIndex = environmentIndex;
+	job->environmentFile = m_settings.environments[environmentIndex];
+	job->startTime = std::chrono::steady_clock::now();
+	glCreateQueries(GL_TIME_ELAPSED, 1, &job->timerQuery);
+
+	// File I/O and decoding happen on a worker thread; prepareIBLBake() picks up the result.
+	IBLBakeJob *pJob = job.get();
+	const bool useCache = m_settings.iblCache;
+	job->loading = std::async(std::launch::async, [this, pJob, useCache]()
+	{
+		pJob->loadingThread = std::this_thread::get_id();
+		pJob->loadingStart = std::chrono::steady_clock::now();
+		if (useCache)
+		{
+			pJob->cacheKey = iblCacheKey(pJob->environmentFile);
+			pJob->cacheHit = IBLCache{kIBLCacheDirectory}.load(pJob->cacheKey, pJob->cached);
+		}
+		if (!pJob->cacheHit)
+		{
+			pJob->source = IBL::loadEnvironment(pJob->environmentFile, true, true);
+		}
+		pJob->loadingEnd = std::chrono::steady_clock::now();
+	});
+	return job;
+}
+
+void Renderer::prepareIBLBake(IBLBakeJob &job)
+{
+	job.loading.get();
+	job.prepared = true;
+
+	if (job.cacheHit)
+	{
+		queueIBLUpload(job);
+	}
+	else
+	{
+		queueIBLBake(job);
+	}
+
+	// Make all image stores visible to texture fetches before the resources are used for rendering.
+	job.units.push_back({"finalize", 0.0, []()
+	{
+		glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+	}});
+}
+
+void Renderer::queueIBLUpload(IBLBakeJob &job)
+{
+	const IBLCache::Contents &contents = job.cached;
+	auto find = [&contents](const char *name)
+	{
+		const IBLCache::Texture *cached = contents.find(name);
+		if (!cached)
+		{
+			throw std::runtime_error("IBL cache entry is incomplete");
+		}
+		return cached;
+	};
+
+	// One unit per face and level keeps every upload small.
+	auto queue = [this, &job](const IBLCache::Texture *cached, Texture &texture)
+	{
+		texture = createTexture(GL_TEXTURE_CUBE_MAP, cached->width, cached->height, cached->internalFormat, cached->levels);
+		for (int level = 0; level < cached->levels; ++level)
+		{
+			const int width = glm::max(cached->width >> level, 1);
+			const int height = glm::max(cached->height >> level, 1);
+			const size_t faceBytes = cached->mipData[level].size() / cached->depth;
+			for (int face = 0; face < cached->depth; ++face)
+			{
+				const unsigned char *data = cached->mipData[level].data() + face * faceBytes;
+				job.units.push_back({"upload", double(width) * height, [&texture, cached, level, face, width, height, data]()
+				{
+					glTextureSubImage3D(texture.id, level, 0, 0, face, width, height, 1, cached->format, cached->type, data);
+				}});
+			}
+		}
+	};
+
+	queue(find("envMap"), job.resources.envTexture);
+	if (m_settings.irradianceMode == IrradianceMode::Cubemap)
+	{
+		queue(find("irmap"), job.resources.irmapTexture);
+	}
+	else
+	{
+		if (contents.irradianceSH.size() != 9)
+		{
+			throw std::runtime_error("IBL cache entry is incomplete");
+		}
+		std::copy(contents.irradianceSH.begin(), contents.irradianceSH.end(), job.resources.irradianceSH);
+	}
+}
+
+void Renderer::queueIBLBake(IBLBakeJob &job)
+{
+	static constexpr int kIrradianceTileSize = 8; // Edge of the block of texels convolved by one irmap unit.
+
+	// Cube map inputs are baked at their own resolution.
+	const bool equirect = job.source.equirect || job.source.equirectDecoder;
+	job.envMapSize = equirect ? kEnvMapSize : job.source.cubemap.size;
+	const int envMapSize = job.envMapSize;
+	const int levels = Utility::numMipmapLevels(envMapSize, envMapSize);
+	auto &units = job.units;
+
+	units.push_back({"upload", 0.0, [this, &job, envMapSize]()
+	{
+		job.envTextureUnfiltered = createTexture(GL_TEXTURE_CUBE_MAP, envMapSize, envMapSize, GL_RGBA16F);
+		job.resources.envTexture = createTexture(GL_TEXTURE_CUBE_MAP, envMapSize, envMapSize, GL_RGBA16F);
+	}});
+
+	if (job.source.equirectDecoder)
+	{
+		// Decode the equirectangular environment map block by block as it is uploaded, so the full image is never
+		// held in memory.
+		const RGBEDecoder &decoder = *job.source.equirectDecoder;
+		const int width = decoder.width(), height = decoder.height();
+		const size_t rowBytes = size_t(width) * RGBEDecoder::bytesPerPixel(RGBEDecoder::Format::Half, 3);
+		const int rowsPerBlock = int(glm::clamp(kEnvironmentBlockBytes / rowBytes, size_t(1), size_t(height)));
+		units.push_back({"upload", 0.0, [this, &job, width, height]()
+		{
+			job.envTextureEquirect = createTexture(GL_TEXTURE_2D, width, height, GL_RGB16F, 1);
+		}});
+		for (int firstRow = 0; firstRow < height; firstRow += rowsPerBlock)
+		{
+			const int numRows = glm::min(rowsPerBlock, height - firstRow);
+			units.push_back({"upload", double(width) * numRows, [this, &job, firstRow, numRows, height]()
+			{
+				uploadEnvironmentRows(*job.source.equirectDecoder, job.envTextureEquirect, firstRow, numRows);
+				if (firstRow + numRows == height)
+				{
+					job.source.equirectDecoder.reset();
+					job.source.equirectFile.reset();
+				}
+			}});
+		}
+	}
+	else if (job.source.equirect)
+	{
+		units.push_back({"upload", double(kEnvMapSize) * kEnvMapSize, [this, &job]()
+		{
+			job.envTextureEquirect = createTexture(job.source.equirect, GL_RGB, GL_RGB16F, 1);
+			job.source.equirect.reset();
+		}});
+	}
+
+	if (equirect)
+	{
+		// Convert the equirectangular environment map to a cube map, one face per unit.
+		for (GLuint face = 0; face < 6; ++face)
+		{
+			units.push_back({"equirect2cube", double(kEnvMapSize) * kEnvMapSize, [this, &job, face]()
+			{
+				glUseProgram(m_bakePrograms.equirectToCube);
+				glBindTextureUnit(0, job.envTextureEquirect.id);
+				glBindImageTexture(0, job.envTextureUnfiltered.id, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+				glProgramUniform3ui(m_bakePrograms.equirectToCube, 0, 0, 0, face);
+				glDispatchCompute(kEnvMapSize / 32, kEnvMapSize / 32, 1);
+			}});
+		}
+	}
+	else
+	{
+		// Cube map inputs are uploaded as they are, one face per unit.
+		for (int face = 0; face < 6; ++face)
+		{
+			units.push_back({"upload", double(envMapSize) * envMapSize, [&job, envMapSize, face]()
+			{
+				glTextureSubImage3D(job.envTextureUnfiltered.id, 0, 0, 0, face, envMapSize, envMapSize, 1, GL_RGBA, GL_FLOAT,
+									job.source.cubemap.face(0, face));
+				if (face == 5)
+				{
+					job.source.cubemap = IBL::Cubemap{};
+				}
+			}});
+		}
+	}
+
+	// Build the unfiltered mip chain used for filtered importance sampling and copy level 0 into the destination.
+	units.push_back({"mipmaps", 6.0 * envMapSize * envMapSize, [this, &job, envMapSize]()
+	{
+		glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+		glGenerateTextureMipmap(job.envTextureUnfiltered.id);
+		glCopyImageSubData(job.envTextureUnfiltered.id, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
+						   job.resources.envTexture.id, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
+						   envMapSize, envMapSize, 6);
+		deleteTexture(job.envTextureEquirect);
+	}});
+
+	// Pre-filter the rest of the mip chain.
+	const IBL::SpecularSampleTable sampleTable = IBL::buildSpecularSampleTable(envMapSize, levels, kSpecularSamples);
+	job.specularSampleBuffer = RendererDetails::createSampleBuffer(sampleTable.samples);
+	if (m_settings.prefilterMode == SpecularPrefilterMode::SingleDispatch)
+	{
+		queueSinglePrefilter(job, sampleTable);
+	}
+	else
+	{
+		queueTiledPrefilter(job, sampleTable);
+	}
+
+	// Compute the diffuse irradiance cube map, one tile of one face per unit. Filtered importance sampling
+	// reads the unfiltered mip chain and needs far fewer samples than uniform sampling of level 0.
+	if (m_settings.irradianceMode == IrradianceMode::Cubemap)
+	{
+		const bool filtered = m_settings.filteredIrradiance;
+		const unsigned int numSamples = filtered ? kFilteredIrradianceSamples : kIrradianceSamples;
+		units.push_back({"irmap", 0.0, [this, &job, filtered, numSamples, envMapSize]()
+		{
+			job.resources.irmapTexture = createTexture(GL_TEXTURE_CUBE_MAP, kIrradianceMapSize, kIrradianceMapSize, GL_RGBA16F, 1);
+			job.irradianceSampleBuffer = RendererDetails::createSampleBuffer(filtered
+				? IBL::buildFilteredIrradianceSampleTable(numSamples, envMapSize)
+				: IBL::buildIrradianceSampleTable(numSamples));
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+		}});
+		for (GLuint face = 0; face < 6; ++face)
+		{
+			for (int y = 0; y < kIrradianceMapSize; y += kIrradianceTileSize)
+			{
+				for (int x = 0; x < kIrradianceMapSize; x += kIrradianceTileSize)
+				{
+					units.push_back({"irmap", double(kIrradianceTileSize) * kIrradianceTileSize * numSamples, [this, &job, filtered, numSamples, face, x, y]()
+					{
+						glUseProgram(m_bakePrograms.irmap);
+						glBindTextureUnit(0, filtered ? job.envTextureUnfiltered.id : job.resources.envTexture.id);
+						glBindImageTexture(0, job.resources.irmapTexture.id, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+						glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, job.irradianceSampleBuffer);
+						glProgramUniform1ui(m_bakePrograms.irmap, 0, numSamples);
+						glProgramUniform3ui(m_bakePrograms.irmap, 1, GLuint(x), GLuint(y), face);
+						glDispatchCompute(kIrradianceTileSize / 8, kIrradianceTileSize / 8, 1);
+					}});
+				}
+			}
+		}
+	}
+	// Project irradiance onto spherical harmonics from a fixed-size mip of the unfiltered environment,
+	// so the cost does not depend on the environment resolution. The coefficients stay on the GPU until
+	// the job completes, and the CPU variant reads the mip back only then, so neither stalls the frame.
+	else if (m_settings.irradianceMode == IrradianceMode::SHCompute)
+	{
+		const int level = glm::max(0, levels - Utility::numMipmapLevels(kSHProjectionSize, kSHProjectionSize));
+		const int size = glm::max(envMapSize >> level, 1);
+		units.push_back({"shproject", 6.0 * size * size, [this, &job, level, size]()
+		{
+			const GLuint numGroups = glm::max(1, size / 8);
+			const GLuint numPartials = numGroups * numGroups * 6;
+
+			glCreateBuffers(1, &job.shPartialSums);
+			glNamedBufferStorage(job.shPartialSums, numPartials * sizeof(job.resources.irradianceSH), nullptr, 0);
+			glCreateBuffers(1, &job.shCoefficients);
+			glNamedBufferStorage(job.shCoefficients, sizeof(job.resources.irradianceSH), nullptr, 0);
+
+			glUseProgram(m_bakePrograms.shProject);
+			glBindTextureUnit(0, job.envTextureUnfiltered.id);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, job.shPartialSums);
+			glProgramUniform1i(m_bakePrograms.shProject, 0, level);
+			glDispatchCompute(numGroups, numGroups, 6);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			glUseProgram(m_bakePrograms.shReduce);
+			glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, job.shCoefficients);
+			glProgramUniform1ui(m_bakePrograms.shReduce, 0, numPartials);
+			glDispatchCompute(1, 1, 1);
+		}});
+	}
+}
+
+void Renderer::queueTiledPrefilter(IBLBakeJob &job, const IBL::SpecularSampleTable &sampleTable)
+{
+	static constexpr int kTileSize = 64; // Edge of the block of texels pre-filtered by one unit.
+
+	const int envMapSize = job.envMapSize;
+	const int levels = int(sampleTable.levels.size());
+	auto &units = job.units;
+
+	// One tile of one face of one level per unit; each level is a separate stage so its GPU time is reported.
+	for (int level = 1; level < levels; ++level)
+	{
+		const int size = glm::max(envMapSize >> level, 1);
+		const IBL::SpecularSampleTable::Level range = sampleTable.levels[level];
+		const std::string stage = "spmap level " + std::to_string(level);
+		for (GLuint face = 0; face < 6; ++face)
+		{
+			for (int y = 0; y < size; y += kTileSize)
+			{
+				for (int x = 0; x < size; x += kTileSize)
+				{
+					const int tileSize = glm::min(kTileSize, size);
+					units.push_back({stage, double(tileSize) * tileSize * range.count, [this, &job, level, face, x, y, tileSize, range]()
+					{
+						const GLuint numGroups = (tileSize + 31) / 32;
+						glUseProgram(m_bakePrograms.spmap);
+						glBindTextureUnit(0, job.envTextureUnfiltered.id);
+						glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, job.specularSampleBuffer);
+						glBindImageTexture(0, job.resources.envTexture.id, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+						glProgramUniform1ui(m_bakePrograms.spmap, 0, range.first);
+						glProgramUniform1ui(m_bakePrograms.spmap, 1, range.count);
+						glProgramUniform3ui(m_bakePrograms.spmap, 2, GLuint(x), GLuint(y), face);
+						glDispatchCompute(numGroups, numGroups, 1);
+					}});
+				}
+			}
+		}
+	}
+}
+
+void Renderer::queueSinglePrefilter(IBLBakeJob &job, const IBL::SpecularSampleTable &sampleTable)
+{
+	static constexpr GLuint kGroupsPerUnit = 64;  // 8x8 work groups pre-filtered by one unit when time-sliced.
+
+	GLint maxGroups = 0;
+	glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &maxGroups);
+
+	const int envMapSize = job.envMapSize;
+	const int levels = int(sampleTable.levels.size());
+
+	// Levels are bound in batches of at most spmapLevelsPerDispatch images (a single batch unless the
+	// implementation has fewer image units than the chain has levels).
+	for (int baseLevel = 1; baseLevel < levels; baseLevel += m_bakePrograms.spmapLevelsPerDispatch)
+	{
+		const int levelCount = glm::min(m_bakePrograms.spmapLevelsPerDispatch, levels - baseLevel);
+
+		// Per bound level: first sample, sample count, size; and the cost of each 8x8 work group.
+		std::vector<glm::uvec4> levelInfo(levelCount);
+		std::vector<std::pair<GLuint, double>> levelGroups;  // (end of the level's flattened group range, cost per group)
+		GLuint numGroups = 0;
+		for (int i = 0; i < levelCount; ++i)
+		{
+			const int level = baseLevel + i;
+			const GLuint size = GLuint(glm::max(envMapSize >> level, 1));
+			const GLuint tilesPerRow = (size + 7) / 8;
+			const IBL::SpecularSampleTable::Level range = sampleTable.levels[level];
+			levelInfo[i] = glm::uvec4{range.first, range.count, size, 0};
+			numGroups += 6 * tilesPerRow * tilesPerRow;
+			levelGroups.push_back({numGroups, 64.0 * range.count});
+		}
+
+		// One dispatch for the whole batch when baking at once; ranges of kGroupsPerUnit groups when time-sliced.
+		const GLuint groupsPerUnit = job.timeSliced ? kGroupsPerUnit : GLuint(maxGroups);
+		for (GLuint firstGroup = 0; firstGroup < numGroups; firstGroup += groupsPerUnit)
+		{
+			const GLuint count = glm::min(groupsPerUnit, numGroups - firstGroup);
+
+			double cost = 0.0;
+			GLuint begin = 0;
+			for (const auto &range : levelGroups)
+			{
+				const GLuint overlapBegin = glm::max(begin, firstGroup), overlapEnd = glm::min(range.first, firstGroup + count);
+				if (overlapEnd > overlapBegin)
+				{
+					cost += (overlapEnd - overlapBegin) * range.second;
+				}
+				begin = range.first;
+			}
+
+			job.units.push_back({"spmap", cost, [this, &job, baseLevel, levelCount, levelInfo, firstGroup, count]()
+			{
+				glUseProgram(m_bakePrograms.spmap);
+				glBindTextureUnit(0, job.envTextureUnfiltered.id);
+				glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, job.specularSampleBuffer);
+				for (int i = 0; i < levelCount; ++i)
+				{
+					glBindImageTexture(GLuint(i), job.resources.envTexture.id, baseLevel + i, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+				}
+				glProgramUniform1ui(m_bakePrograms.spmap, 0, GLuint(levelCount));
+				glProgramUniform1ui(m_bakePrograms.spmap, 1, firstGroup);
+				glProgramUniform4uiv(m_bakePrograms.spmap, 2, levelCount, glm::value_ptr(levelInfo[0]));
+				glDispatchCompute(count, 1, 1);
+			}});
+		}
+	}
+}
+
+bool Renderer::advanceIBLBake(IBLBakeJob &job, double budgetMilliseconds)
+{
+	// An infinite budget runs the whole job at once, timing every stage.
+	const bool blocking = std::isinf(budgetMilliseconds);
+
+	if (!job.prepared)
+	{
+		if (!blocking && job.loading.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			return false;
+		}
+		job.timeSliced = !blocking;
+		prepareIBLBake(job);
+	}
+	++job.frames;
+
+	if (blocking)
+	{
+		std::unique_ptr<RendererDetails::GPUTimer> timer;
+		std::string stage;
+		for (; job.nextUnit < job.units.size(); ++job.nextUnit)
+		{
+			const IBLBakeJob::Unit &unit = job.units[job.nextUnit];
+			if (!timer || stage != unit.stage)
+			{
+				if (timer)
+				{
+					std::printf("IBL bake %-14s %9.3f ms\n", stage.c_str(), timer->elapsedMilliseconds());
+				}
+				timer.reset(new RendererDetails::GPUTimer);
+				stage = unit.stage;
+			}
+			unit.run();
+		}
+		if (timer)
+		{
+			std::printf("IBL bake %-14s %9.3f ms\n", stage.c_str(), timer->elapsedMilliseconds());
+		}
+	}
+	else
+	{
+		// Refine the cost model with the GPU time of the previous slice once the query result is available.
+		if (job.queryCost > 0.0)
+		{
+			GLint available = 0;
+			glGetQueryObjectiv(job.timerQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+			if (available)
+			{
+				GLuint64 nanoseconds = 0;
+				glGetQueryObjectui64v(job.timerQuery, GL_QUERY_RESULT, &nanoseconds);
+				job.millisecondsPerCost = 0.5 * (job.millisecondsPerCost + double(nanoseconds) * 1e-6 / job.queryCost);
+				job.queryCost = 0.0;
+			}
+		}
+
+		// Issue units until the estimated GPU time reaches the budget; always make some progress.
+		const bool timed = job.queryCost == 0.0 && job.nextUnit < job.units.size();
+		if (timed)
+		{
+			glBeginQuery(GL_TIME_ELAPSED, job.timerQuery);
+		}
+		double issuedCost = 0.0;
+		while (job.nextUnit < job.units.size())
+		{
+			const IBLBakeJob::Unit &unit = job.units[job.nextUnit];
+			if (issuedCost > 0.0 && (issuedCost + unit.cost) * job.millisecondsPerCost > budgetMilliseconds)
+			{
+				break;
+			}
+			unit.run();
+			issuedCost += unit.cost;
+			++job.nextUnit;
+		}
+		if (timed)
+		{
+			glEndQuery(GL_TIME_ELAPSED);
+			job.queryCost = issuedCost;
+		}
+	}
+
+	if (job.nextUnit < job.units.size())
+	{
+		return false;
+	}
+	if (!job.fence)
+	{
+		job.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	const GLenum status = glClientWaitSync(job.fence, GL_SYNC_FLUSH_COMMANDS_BIT, blocking ? std::numeric_limits<GLuint64>::max() : 0);
+	return status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED;
+}
+
+void Renderer::finishIBLBake(IBLBakeJob &job)
+{
+	// The GPU has finished with the job, so reading back SH data no longer stalls.
+	if (!job.cacheHit && m_settings.irradianceMode == IrradianceMode::SHCompute)
+	{
+		glGetNamedBufferSubData(job.shCoefficients, 0, sizeof(job.resources.irradianceSH), job.resources.irradianceSH);
+	}
+	else if (!job.cacheHit && m_settings.irradianceMode == IrradianceMode::SHCPU)
+	{
+		const int level = glm::max(0, job.envTextureUnfiltered.levels - Utility::numMipmapLevels(kSHProjectionSize, kSHProjectionSize));
+		const int size = glm::max(job.envMapSize >> level, 1);
+		const auto start = std::chrono::steady_clock::now();
+
+		IBL::Cubemap source{size, 1};
+		glGetTextureImage(job.envTextureUnfiltered.id, level, GL_RGBA, GL_FLOAT,
+						  GLsizei(source.mips[0].size() * sizeof(glm::vec4)), source.mips[0].data());
+
+		const IBL::IrradianceSH sh = IBL::projectIrradianceSH(source, 0);
+		for (int k = 0; k < 9; ++k)
+		{
+			job.resources.irradianceSH[k] = glm::vec4{sh[k], 0.0f};
+		}
+
+		const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+		std::printf("Irradiance SH (CPU, %dx%d source): %.3f ms\n", size, size, milliseconds);
+	}
+
+	// Hand the new resources to the environment library and release the job's temporaries.
+	addResidentEnvironment(job.environmentIndex, job.resources);
+	releaseIBLBake(job);
+}
+
+void Renderer::releaseIBLBake(IBLBakeJob &job)
+{
+	if (job.loading.valid())
+	{
+		job.loading.wait();
+	}
+
+	deleteTexture(job.envTextureEquirect);
+	deleteTexture(job.envTextureUnfiltered);
+	deleteTexture(job.resources.envTexture);
+	deleteTexture(job.resources.irmapTexture);
+	for (GLuint *buffer : {&job.specularSampleBuffer, &job.irradianceSampleBuffer, &job.shPartialSums, &job.shCoefficients})
+	{
+		glDeleteBuffers(1, buffer);
+		*buffer = 0;
+	}
+	glDeleteQueries(1, &job.timerQuery);
+	job.timerQuery = 0;
+	if (job.fence)
+	{
+		glDeleteSync(job.fence);
+		job.fence = nullptr;
+	}
+}
 
-	m_skybox = createMeshBuffer(Mesh::fromFile("data/meshes/skybox.obj"));
-	m_skyboxProgram = linkProgram({compileShader("shaders/skybox.vs", GL_VERTEX_SHADER),
-								   compileShader("shaders/skybox.fs", GL_FRAGMENT_SHADER)});
+void Renderer::updateEnvironment(const SceneSettings &scene)
+{
+	const int count = int(m_settings.environments.size());
+	const auto now = std::chrono::steady_clock::now();
 
-	m_pbrModel = createMeshBuffer(Mesh::fromFile("data/meshes/Flaski.fbx"));
-	m_pbrProgram = linkProgram({compileShader("shaders/pbr.vs", GL_VERTEX_SHADER),
-								compileShader("shaders/pbr.fs", GL_FRAGMENT_SHADER)});
+	// Indices without an environment are ignored; the next environment follows the one last requested.
+	if (scene.environmentRequest != m_environmentRequest)
+	{
+		m_environmentRequest = scene.environmentRequest;
+		if (scene.environment == SceneSettings::NextEnvironment)
+		{
+			m_requestedEnvironment = (m_requestedEnvironment + 1) % count;
+		}
+		else if (scene.environment >= 0 && scene.environment < count)
+		{
+			m_requestedEnvironment = scene.environment;
+		}
+	}
+	if (m_settings.environmentRotationSeconds > 0.0 && m_requestedEnvironment == m_currentEnvironment &&
+		std::chrono::duration<double>(now - m_environmentSwapTime).count() >= m_settings.environmentRotationSeconds)
+	{
+		m_requestedEnvironment = (m_currentEnvironment + 1) % count;
+	}
+
+	if (m_requestedEnvironment != m_currentEnvironment)
+	{
+		// Resident environments are switched to at once.
+		if (EnvironmentLibrary::Entry *entry = findResidentEnvironment(m_requestedEnvironment))
+		{
+			++m_environments.stats.hits;
+			activateEnvironment(*entry);
+			std::printf("Environment %s ready (resident)\n", m_settings.environments[m_currentEnvironment].c_str());
+			printEnvironmentStats();
+			return;
+		}
 
-	m_albedoTexture = createTexture(Image::fromFile("data/textures/flaski/Flaski_DefaultMaterial_BaseColor.png", 3), GL_RGB, GL_SRGB8);
-	m_normalTexture = createTexture(Image::fromFile("data/textures/flaski/Flaski_DefaultMaterial_Normal.png", 3), GL_RGB, GL_RGB8);
-	m_metalnessTexture = createTexture(Image::fromFile("data/textures/flaski/Flaski_DefaultMaterial_Metallic.png", 1), GL_RED, GL_R8);
-	m_roughnessTexture = createTexture(Image::fromFile("data/textures/flaski/Flaski_DefaultMaterial_Roughness.png", 1), GL_RED, GL_R8);
+		// Abandon a bake (or preload) of an environment that is no longer wanted.
+		if (m_iblBake && m_iblBake->environmentIndex != m_requestedEnvironment)
+		{
+			releaseIBLBake(*m_iblBake);
+			m_iblBake.reset();
+		}
+		if (!m_iblBake)
+		{
+			++m_environments.stats.misses;
+			m_iblBake = startIBLBake(m_requestedEnvironment);
+		}
+	}
+	else if (!m_iblBake && m_settings.preloadEnvironments)
+	{
+		const int environmentIndex = nextPreloadEnvironment();
+		if (environmentIndex >= 0)
+		{
+			m_iblBake = startIBLBake(environmentIndex);
+		}
+	}
 
-	// Unfiltered environment cube map (temporary).
-	Texture envTextureUnfiltered = createTexture(GL_TEXTURE_CUBE_MAP, kEnvMapSize, kEnvMapSize, GL_RGBA16F);
+	if (!m_iblBake)
+	{
+		return;
+	}
 
-	// Load & convert equirectangular environment map to a cubemap texture.
+	try
+	{
+		if (!advanceIBLBake(*m_iblBake, m_settings.bakeBudgetMilliseconds))
+		{
+			return;
+		}
+	}
+	catch (const std::exception &e)
 	{
-		GLuint equirectToCubeProgram = linkProgram({compileShader("shaders/equirect2cube.cs", GL_COMPUTE_SHADER)});
+		std::fprintf(stderr, "Failed to load environment %s: %s\n", m_iblBake->environmentFile.c_str(), e.what());
+		if (m_iblBake->environmentIndex == m_requestedEnvironment)
+		{
+			m_requestedEnvironment = m_currentEnvironment;
+		}
+		releaseIBLBake(*m_iblBake);
+		m_iblBake.reset();
+		return;
+	}
 
-		Texture envTextureEquirect = createTexture(Image::fromFile("data/environment.hdr", 3), GL_RGB, GL_RGB16F, 1);
+	const double milliseconds = std::chrono::duration<double, std::milli>(now - m_iblBake->startTime).count();
+	std::printf("Environment %s ready (%s): %zu units over %d frames, %.1f ms\n", m_iblBake->environmentFile.c_str(),
+				m_iblBake->cacheHit ? "cached" : "baked", m_iblBake->units.size(), m_iblBake->frames, milliseconds);
 
-		glUseProgram(equirectToCubeProgram);
-		glBindTextureUnit(0, envTextureEquirect.id);
-		glBindImageTexture(0, envTextureUnfiltered.id, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
-		glDispatchCompute(envTextureUnfiltered.width / 32, envTextureUnfiltered.height / 32, 6);
+	const int environmentIndex = m_iblBake->environmentIndex;
+	finishIBLBake(*m_iblBake);
+	m_iblBake.reset();
 
-		glDeleteTextures(1, &envTextureEquirect.id);
-		glDeleteProgram(equirectToCubeProgram);
+	if (environmentIndex == m_requestedEnvironment)
+	{
+		activateEnvironment(*findResidentEnvironment(environmentIndex));
 	}
+	printEnvironmentStats();
+}
 
-	glGenerateTextureMipmap(envTextureUnfiltered.id);
+EnvironmentLibrary::Entry *Renderer::findResidentEnvironment(int environmentIndex)
+{
+	for (EnvironmentLibrary::Entry &entry : m_environments.entries)
+	{
+		if (entry.environmentIndex == environmentIndex)
+		{
+			return &entry;
+		}
+	}
+	return nullptr;
+}
 
-	// Compute pre-filtered specular environment map.
+void Renderer::addResidentEnvironment(int environmentIndex, IBLResources &resources)
+{
+	EnvironmentLibrary::Entry entry;
+	entry.environmentIndex = environmentIndex;
+	entry.resources = resources;
+	entry.bytes = RendererDetails::textureBytes(resources.envTexture, 8, 6) + RendererDetails::textureBytes(resources.irmapTexture, 8, 6);
+	entry.lastUse = ++m_environments.useCounter;
+	resources = IBLResources{};
+
+	m_environments.entries.push_back(entry);
+	m_environments.stats.residentBytes += entry.bytes;
+
+	// Evict least recently used entries other than the one in use and the one just added.
+	m_environments.stats.budgetBytes = m_settings.environmentBudgetMB << 20;
+	while (m_environments.stats.residentBytes > m_environments.stats.budgetBytes)
 	{
-		GLuint spmapProgram = linkProgram({compileShader("shaders/spmap.cs", GL_COMPUTE_SHADER)});
+		auto victim = m_environments.entries.end();
+		for (auto it = m_environments.entries.begin(); it != m_environments.entries.end(); ++it)
+		{
+			if (it->resources.envTexture.id != m_ibl.envTexture.id && it->environmentIndex != environmentIndex &&
+				(victim == m_environments.entries.end() || it->lastUse < victim->lastUse))
+			{
+				victim = it;
+			}
+		}
+		if (victim == m_environments.entries.end())
+		{
+			break;
+		}
 
-		m_envTexture = createTexture(GL_TEXTURE_CUBE_MAP, kEnvMapSize, kEnvMapSize, GL_RGBA16F);
+		std::printf("Evicting environment %s\n", m_settings.environments[victim->environmentIndex].c_str());
+		deleteTexture(victim->resources.envTexture);
+		deleteTexture(victim->resources.irmapTexture);
+		m_environments.stats.residentBytes -= victim->bytes;
+		++m_environments.stats.evictions;
+		m_environments.entries.erase(victim);
+	}
+	m_environments.stats.resident = m_environments.entries.size();
+}
 
-		// Copy 0th mipmap level into destination environment map.
-		glCopyImageSubData(envTextureUnfiltered.id, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
-						   m_envTexture.id, GL_TEXTURE_CUBE_MAP, 0, 0, 0, 0,
-						   m_envTexture.width, m_envTexture.height, 6);
+void Renderer::activateEnvironment(EnvironmentLibrary::Entry &entry)
+{
+	entry.lastUse = ++m_environments.useCounter;
+	m_ibl = entry.resources;
+	m_currentEnvironment = entry.environmentIndex;
+	m_environmentSwapTime = std::chrono::steady_clock::now();
+}
 
-		glUseProgram(spmapProgram);
-		glBindTextureUnit(0, envTextureUnfiltered.id);
+int Renderer::nextPreloadEnvironment() const
+{
+	// Preloading never evicts: stop once another environment of the current one's size would not fit.
+	size_t entryBytes = 0;
+	for (const EnvironmentLibrary::Entry &entry : m_environments.entries)
+	{
+		entryBytes = std::max(entryBytes, entry.bytes);
+	}
+	if (m_environments.stats.residentBytes + entryBytes > (m_settings.environmentBudgetMB << 20))
+	{
+		return -1;
+	}
 
-		// Pre-filter rest of the mip chain.
-		const float deltaRoughness = 1.0f / glm::max(float(m_envTexture.levels - 1), 1.0f);
-		for (int level = 1, size = kEnvMapSize / 2; level <= m_envTexture.levels; ++level, size /= 2)
+	const int count = int(m_settings.environments.size());
+	for (int i = 1; i < count; ++i)
+	{
+		const int environmentIndex = (m_currentEnvironment + i) % count;
+		const bool resident = std::any_of(m_environments.entries.begin(), m_environments.entries.end(),
+										  [environmentIndex](const EnvironmentLibrary::Entry &entry) { return entry.environmentIndex == environmentIndex; });
+		if (!resident)
 		{
-			const GLuint numGroups = glm::max(1, size / 32);
-			glBindImageTexture(0, m_envTexture.id, level, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
-			glProgramUniform1f(spmapProgram, 0, level * deltaRoughness);
-			glDispatchCompute(numGroups, numGroups, 6);
+			return environmentIndex;
 		}
-		glDeleteProgram(spmapProgram);
 	}
+	return -1;
+}
 
-	glDeleteTextures(1, &envTextureUnfiltered.id);
+void Renderer::printEnvironmentStats() const
+{
+	const EnvironmentLibrary::Stats &stats = m_environments.stats;
+	std::printf("Environment library: %zu resident, %.1f / %.1f MB, %llu hits, %llu misses, %llu evictions\n",
+				stats.resident, double(stats.residentBytes) / (1 << 20), double(stats.budgetBytes) / (1 << 20),
+				(unsigned long long)stats.hits, (unsigned long long)stats.misses, (unsigned long long)stats.evictions);
+}
 
-	// Compute diffuse irradiance cubemap.
+void Renderer::setupBRDF_LUT()
+{
+	switch (m_settings.brdfMode)
 	{
-		GLuint irmapProgram = linkProgram({compileShader("shaders/irmap.cs", GL_COMPUTE_SHADER)});
-
-		m_irmapTexture = createTexture(GL_TEXTURE_CUBE_MAP, kIrradianceMapSize, kIrradianceMapSize, GL_RGBA16F, 1);
+	case BRDFMode::Analytic:
+		// Evaluated in pbr.fs, no texture needed.
+		return;
 
-		glUseProgram(irmapProgram);
-		glBindTextureUnit(0, m_envTexture.id);
-		glBindImageTexture(0, m_irmapTexture.id, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
-		glDispatchCompute(m_irmapTexture.width / 32, m_irmapTexture.height / 32, 6);
-		glDeleteProgram(irmapProgram);
-	}
+	case BRDFMode::Embedded:
+		// Generated at build time by PBR-BRDF-LUT.
+		m_spBRDF_LUT = createTexture(GL_TEXTURE_2D, RendererDetails::kEmbeddedBRDF_LUT_Size, RendererDetails::kEmbeddedBRDF_LUT_Size, GL_RG16F, 1);
+		glTextureSubImage2D(m_spBRDF_LUT.id, 0, 0, 0, m_spBRDF_LUT.width, m_spBRDF_LUT.height, GL_RG, GL_HALF_FLOAT, RendererDetails::kEmbeddedBRDF_LUT);
+		break;
 
-	// Compute Cook-Torrance BRDF 2D LUT for split-sum approximation.
+	case BRDFMode::Compute:
 	{
+		// Compute Cook-Torrance BRDF 2D LUT for split-sum approximation.
 		GLuint spBRDFProgram = linkProgram({compileShader("shaders/spbrdf.cs", GL_COMPUTE_SHADER)});
 
 		m_spBRDF_LUT = createTexture(GL_TEXTURE_2D, kBRDF_LUT_Size, kBRDF_LUT_Size, GL_RG16F, 1);
-		glTextureParameteri(m_spBRDF_LUT.id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-		glTextureParameteri(m_spBRDF_LUT.id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+		const GLuint sampleBuffer = RendererDetails::createSampleBuffer(IBL::buildBRDFSampleTable(kBRDF_LUT_Size, kBRDFSamples));
 
 		glUseProgram(spBRDFProgram);
 		glBindImageTexture(0, m_spBRDF_LUT.id, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG16F);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sampleBuffer);
+		glProgramUniform1ui(spBRDFProgram, 0, kBRDFSamples);
 		glDispatchCompute(m_spBRDF_LUT.width / 32, m_spBRDF_LUT.height / 32, 1);
+		glDeleteBuffers(1, &sampleBuffer);
 		glDeleteProgram(spBRDFProgram);
+		break;
+	}
 	}
 
-	glFinish();
+	glTextureParameteri(m_spBRDF_LUT.id, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTextureParameteri(m_spBRDF_LUT.id, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+}
+
+IBLCache::Contents Renderer::readbackIBL() const
+{
+	auto readback = [](const std::string &name, const Texture &texture, GLenum internalformat, GLenum format, int components, int depth)
+	{
+		IBLCache::Texture cached;
+		cached.name = name;
+		cached.internalFormat = internalformat;
+		cached.format = format;
+		cached.type = GL_HALF_FLOAT;
+		cached.width = texture.width;
+		cached.height = texture.height;
+		cached.depth = depth;
+		cached.levels = texture.levels;
+		cached.mipData.resize(texture.levels);
+		for (int level = 0; level < texture.levels; ++level)
+		{
+			const int width = glm::max(texture.width >> level, 1);
+			const int height = glm::max(texture.height >> level, 1);
+			std::vector<unsigned char> &data = cached.mipData[level];
+			data.resize(size_t(width) * height * depth * components * sizeof(GLhalf));
+			glGetTextureImage(texture.id, level, format, GL_HALF_FLOAT, GLsizei(data.size()), data.data());
+		}
+		return cached;
+	};
+
+	IBLCache::Contents contents;
+	contents.textures.push_back(readback("envMap", m_ibl.envTexture, GL_RGBA16F, GL_RGBA, 4, 6));
+	if (m_ibl.irmapTexture.id)
+	{
+		contents.textures.push_back(readback("irmap", m_ibl.irmapTexture, GL_RGBA16F, GL_RGBA, 4, 6));
+	}
+	if (m_settings.irradianceMode != IrradianceMode::Cubemap)
+	{
+		contents.irradianceSH.assign(std::begin(m_ibl.irradianceSH), std::end(m_ibl.irradianceSH));
+	}
+	return contents;
 }
 
 void Renderer::render(GLFWwindow *window, const CameraSettings &view, const SceneSettings &scene)
 {
+	// 0. BACKGROUND WORK:
+
+	// Advance a pending environment bake within the frame's budget and swap it in once complete.
+	updateEnvironment(scene);
+
+	// Upload the next levels of the material textures that are still streaming in.
+	updateTextureStreaming();
+	m_uploadRing.submit();
+
 	// 1. PREPARATION:
 
 	// Calculate projection, view, and scene rotation matrices using GLM library functions.
@@ -273,6 +1396,8 @@ void Renderer::render(GLFWwindow *window, const CameraSettings &view, const Scen
 		transformUniforms.viewProjectionMatrix = projectionMatrix * viewMatrix;
 		transformUniforms.skyProjectionMatrix = projectionMatrix * viewRotationMatrix;
 		transformUniforms.sceneRotationMatrix = sceneRotationMatrix;
+		transformUniforms.positionScale = glm::vec4{m_pbrModel.positionScale, 0.0f};
+		transformUniforms.positionOffset = glm::vec4{m_pbrModel.positionOffset, 0.0f};
 		glNamedBufferSubData(m_transformUB, 0, sizeof(RendererDetails::TransformUB), &transformUniforms);
 	}
 
@@ -280,6 +1405,7 @@ void Renderer::render(GLFWwindow *window, const CameraSettings &view, const Scen
 	{
 		RendererDetails::ShadingUB shadingUniforms;
 		shadingUniforms.eyePosition = glm::vec4(eyePosition, 0.0f);
+		std::copy(std::begin(m_ibl.irradianceSH), std::end(m_ibl.irradianceSH), shadingUniforms.irradianceSH);
 		for (int i = 0; i < SceneSettings::MaxLights; ++i)
 		{
 			const SceneSettings::Light &light = scene.lights[i];
@@ -305,24 +1431,27 @@ void Renderer::render(GLFWwindow *window, const CameraSettings &view, const Scen
 	// Draw the skybox (cube environment map background).
 	glDisable(GL_DEPTH_TEST); // Disable depth testing for skybox to ensure it's always rendered behind everything.
 	glUseProgram(m_skyboxProgram);
-	glBindTextureUnit(0, m_envTexture.id);
-	glBindVertexArray(m_skybox.vao);
-	glDrawElements(GL_TRIANGLES, m_skybox.numElements, GL_UNSIGNED_INT, 0);
+	glBindTextureUnit(0, m_ibl.envTexture.id);
+	drawMeshBuffer(m_skybox);
 
 	// Draw the Physically-Based Rendering (PBR) model.
 	glEnable(GL_DEPTH_TEST);
 	glUseProgram(m_pbrProgram);
-	// Bind the various textures (albedo, normal, metalness, roughness, environment map, irradiance map, split-sum BRDF lookup table).
+	// Bind the various textures (albedo, normal, occlusion/roughness/metalness, environment map, irradiance map unless SH is used, split-sum BRDF lookup table unless the analytic fit is used).
 	glBindTextureUnit(0, m_albedoTexture.id);
 	glBindTextureUnit(1, m_normalTexture.id);
-	glBindTextureUnit(2, m_metalnessTexture.id);
-	glBindTextureUnit(3, m_roughnessTexture.id);
-	glBindTextureUnit(4, m_envTexture.id);
-	glBindTextureUnit(5, m_irmapTexture.id);
-	glBindTextureUnit(6, m_spBRDF_LUT.id);
-	// Bind vertex array and draw.
-	glBindVertexArray(m_pbrModel.vao);
-	glDrawElements(GL_TRIANGLES, m_pbrModel.numElements, GL_UNSIGNED_INT, 0);
+	glBindTextureUnit(2, m_ormTexture.id);
+	glBindTextureUnit(4, m_ibl.envTexture.id);
+	if (m_ibl.irmapTexture.id)
+	{
+		glBindTextureUnit(5, m_ibl.irmapTexture.id);
+	}
+	if (m_spBRDF_LUT.id)
+	{
+		glBindTextureUnit(6, m_spBRDF_LUT.id);
+	}
+	// Draw every submesh of the model with one indirect draw call, at the level of detail its size on screen needs.
+	drawMeshBuffer(m_pbrModel, selectLod(m_pbrModel, projectionMatrix, viewMatrix * sceneRotationMatrix));
 
 	// 5. POST-PROCESSING:
 
@@ -340,15 +1469,36 @@ void Renderer::render(GLFWwindow *window, const CameraSettings &view, const Scen
 
 	// Swap the window buffers to display the rendered frame.
 	glfwSwapBuffers(window);
+
+	if (m_firstFrame)
+	{
+		m_firstFrame = false;
+		std::printf("First frame: %.1f ms after setup started\n",
+					std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - m_textureStreamer.startTime).count());
+	}
 }
 
-GLuint Renderer::compileShader(const std::string &filename, GLenum type)
+GLuint Renderer::compileShader(const std::string &filename, GLenum type, const std::vector<std::string> &defines)
 {
-	const std::string src = FileUtility::readText(filename);
+	std::string src = FileUtility::readText(filename);
 	if (src.empty())
 	{
 		throw std::runtime_error("Cannot read shader source file: " + filename);
 	}
+
+	// Inject preprocessor definitions right after the #version directive, keeping line numbers intact.
+	if (!defines.empty())
+	{
+		std::string preamble;
+		for (const std::string &define : defines)
+		{
+			preamble += "#define " + define + "\n";
+		}
+		preamble += "#line 2\n";
+
+		const size_t versionEnd = src.find('\n');
+		src.insert(versionEnd == std::string::npos ? src.size() : versionEnd + 1, preamble);
+	}
 	const GLchar *srcBufferPtr = src.c_str();
 
 	std::printf("Compiling GLSL shader: %s\n", filename.c_str());
@@ -435,7 +1585,11 @@ Texture Renderer::createTexture(const std::shared_ptr<class Image> &image, GLenu
 		glTextureSubImage2D(texture.id, 0, 0, 0, texture.width, texture.height, format, type, pixels);
 	};
 
-	if (image->isHDR())
+	if (image->isHalfFloat())
+	{
+		uploadTextureData(GL_HALF_FLOAT, image->pixels<uint16_t>());
+	}
+	else if (image->isHDR())
 	{
 		uploadTextureData(GL_FLOAT, image->pixels<float>());
 	}
@@ -458,6 +1612,215 @@ void Renderer::deleteTexture(Texture &texture)
 	std::memset(&texture, 0, sizeof(Texture));
 }
 
+void Renderer::streamTexture(const std::string &name, Texture &texture, std::future<std::shared_ptr<TextureContainer>> loading,
+							 const glm::vec4 &placeholder)
+{
+	texture = createTexture(GL_TEXTURE_2D, 1, 1, GL_RGBA8, 1);
+	glClearTexImage(texture.id, 0, GL_RGBA, GL_FLOAT, &placeholder);
+
+	TextureStreamer::Stream stream;
+	stream.name = name;
+	stream.texture = &texture;
+	stream.loading = std::move(loading);
+	m_textureStreamer.streams.push_back(std::move(stream));
+	m_textureStreamer.complete = false;
+}
+
+void Renderer::beginTextureStream(TextureStreamer::Stream &stream)
+{
+	stream.container = stream.loading.get();
+	const TextureContainer &container = *stream.container;
+	const TextureContainer::Description &description = container.description();
+
+	// A container without a mip chain gets its mips from the driver, so it cannot be streamed in.
+	deleteTexture(*stream.texture);
+	*stream.texture = createTexture(GL_TEXTURE_2D, description.width, description.height, description.internalFormat,
+									description.levels > 1 ? description.levels : 0);
+	if (description.levels == 1)
+	{
+		m_textureStreamer.uploadedBytes += uploadTextureLevel(*stream.texture, container, 0);
+		if (stream.texture->levels > 1)
+		{
+			glGenerateTextureMipmap(stream.texture->id);
+		}
+		stream.residentLevel = 0;
+		return;
+	}
+
+	// The smallest levels are uploaded at once: they are a few kilobytes and make the texture usable.
+	stream.residentLevel = description.levels - 1;
+	m_textureStreamer.uploadedBytes += uploadTextureLevel(*stream.texture, container, stream.residentLevel);
+	while (stream.residentLevel > 0 &&
+		   std::max(container.levelWidth(stream.residentLevel - 1), container.levelHeight(stream.residentLevel - 1)) <= kStreamingTailSize)
+	{
+		--stream.residentLevel;
+		m_textureStreamer.uploadedBytes += uploadTextureLevel(*stream.texture, container, stream.residentLevel);
+	}
+	glTextureParameteri(stream.texture->id, GL_TEXTURE_BASE_LEVEL, stream.residentLevel);
+}
+
+void Renderer::uploadEnvironmentRows(const RGBEDecoder &decoder, const Texture &texture, int firstRow, int numRows)
+{
+	// The rows are decoded to half floats on the worker pool, straight into the upload ring when it has room.
+	const size_t rowBytes = size_t(decoder.width()) * RGBEDecoder::bytesPerPixel(RGBEDecoder::Format::Half, 3);
+	auto decode = [&decoder, firstRow, rowBytes](size_t numRows, unsigned char *destination)
+	{
+		ThreadPool::instance().parallelFor(numRows, [&](size_t row)
+		{
+			decoder.decodeRows(firstRow + int(row), 1, RGBEDecoder::Format::Half, 3, destination + row * rowBytes);
+		});
+	};
+
+	std::vector<unsigned char> pixels;
+	const void *data = nullptr;
+	const UploadRing::Allocation staging = m_uploadRing.stage(rowBytes * numRows, [&](unsigned char *destination) { decode(size_t(numRows), destination); });
+	if (staging.data)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadRing.buffer());
+		data = reinterpret_cast<const void *>(staging.offset);
+	}
+	else
+	{
+		pixels.resize(rowBytes * numRows);
+		decode(size_t(numRows), pixels.data());
+		data = pixels.data();
+	}
+
+	glTextureSubImage2D(texture.id, 0, 0, firstRow, decoder.width(), numRows, GL_RGB, GL_HALF_FLOAT, data);
+
+	if (staging.data)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+}
+
+size_t Renderer::uploadTextureLevel(const Texture &texture, const TextureContainer &container, int level)
+{
+	// The level is staged as it is stored in the container (usually a file mapping) and copied from the ring.
+	const TextureContainer::Description &description = container.description();
+	const UploadRing::Allocation staging = m_uploadRing.stage(container.levelData(level), container.levelSize(level));
+	const void *pixels = container.levelData(level);
+	if (staging.data)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadRing.buffer());
+		pixels = reinterpret_cast<const void *>(staging.offset);
+	}
+
+	if (container.isCompressed())
+	{
+		glCompressedTextureSubImage2D(texture.id, level, 0, 0, container.levelWidth(level), container.levelHeight(level),
+									  description.internalFormat, GLsizei(container.levelSize(level)), pixels);
+	}
+	else
+	{
+		glTextureSubImage2D(texture.id, level, 0, 0, container.levelWidth(level), container.levelHeight(level), description.format,
+							description.type, pixels);
+	}
+
+	if (staging.data)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	return container.levelSize(level);
+}
+
+void Renderer::updateTextureStreaming()
+{
+	TextureStreamer &streamer = m_textureStreamer;
+	if (streamer.complete)
+	{
+		return;
+	}
+	++streamer.frames;
+
+	// Textures whose container has loaded start streaming; get() rethrows a loading error here.
+	for (TextureStreamer::Stream &stream : streamer.streams)
+	{
+		if (!stream.container && stream.loading.valid() &&
+			stream.loading.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+		{
+			beginTextureStream(stream);
+		}
+	}
+
+	// Refine the least refined texture first, so all of them sharpen together; at least one level per frame.
+	const size_t budget = (m_settings.textureUploadBudgetMB > 0.0) ? size_t(m_settings.textureUploadBudgetMB * 1024 * 1024)
+																   : std::numeric_limits<size_t>::max();
+	size_t bytes = 0;
+	while (bytes < budget)
+	{
+		TextureStreamer::Stream *next = nullptr;
+		auto residentTexels = [](const TextureStreamer::Stream &stream)
+		{
+			return size_t(stream.container->levelWidth(stream.residentLevel)) * stream.container->levelHeight(stream.residentLevel);
+		};
+		for (TextureStreamer::Stream &stream : streamer.streams)
+		{
+			if (stream.container && stream.residentLevel > 0 && (!next || residentTexels(stream) < residentTexels(*next)))
+			{
+				next = &stream;
+			}
+		}
+		if (!next)
+		{
+			break;
+		}
+
+		--next->residentLevel;
+		bytes += uploadTextureLevel(*next->texture, *next->container, next->residentLevel);
+		glTextureParameteri(next->texture->id, GL_TEXTURE_BASE_LEVEL, next->residentLevel);
+	}
+	streamer.uploadedBytes += bytes;
+
+	const bool complete = std::all_of(streamer.streams.begin(), streamer.streams.end(), [](const TextureStreamer::Stream &stream)
+	{
+		return stream.container && stream.residentLevel == 0;
+	});
+	if (complete)
+	{
+		streamer.complete = true;
+		streamer.streams.clear();
+		std::printf("Textures at full resolution: %.1f ms after setup started (%.2f MB in %d frames)\n",
+					std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - streamer.startTime).count(),
+					streamer.uploadedBytes / 1048576.0, streamer.frames);
+		printUploadStats();
+	}
+}
+
+void Renderer::dumpIBLTextures(const std::string &directory) const
+{
+	std::printf("Writing IBL textures to: %s\n", directory.c_str());
+
+	auto dumpCubemap = [&](const Texture &texture, const std::string &name)
+	{
+		for (int level = 0; level < texture.levels; ++level)
+		{
+			const int size = glm::max(texture.width >> level, 1);
+			const size_t faceSize = size_t(size) * size * 3;
+			std::vector<float> pixels(6 * faceSize);
+			glGetTextureImage(texture.id, level, GL_RGB, GL_FLOAT, GLsizei(pixels.size() * sizeof(float)), pixels.data());
+			for (int face = 0; face < 6; ++face)
+			{
+				const std::string filename = directory + "/" + name + "_" + std::to_string(level) + "_" + std::to_string(face) + ".hdr";
+				Image::writeHDR(filename, size, size, 3, &pixels[face * faceSize]);
+			}
+		}
+	};
+
+	dumpCubemap(m_ibl.envTexture, "spmap");
+	if (m_ibl.irmapTexture.id)
+	{
+		dumpCubemap(m_ibl.irmapTexture, "irmap");
+	}
+
+	if (m_spBRDF_LUT.id)
+	{
+		std::vector<float> lut(size_t(m_spBRDF_LUT.width) * m_spBRDF_LUT.height * 3);
+		glGetTextureImage(m_spBRDF_LUT.id, 0, GL_RGB, GL_FLOAT, GLsizei(lut.size() * sizeof(float)), lut.data());
+		Image::writeHDR(directory + "/spbrdf.hdr", m_spBRDF_LUT.width, m_spBRDF_LUT.height, 3, lut.data());
+	}
+}
+
 // Private helper functions to abstract the repeated framebuffer operations
 inline void Renderer::attachMultisampleRenderBuffer(GLuint framebuffer, GLuint &rbo, GLenum attachment, GLenum format, int samples, int width, int height)
 {
@@ -561,23 +1924,216 @@ void Renderer::deleteFrameBuffer(FrameBuffer &fb)
 	std::memset(&fb, 0, sizeof(FrameBuffer));
 }
 
-inline void createGLBuffer(GLuint &buffer, GLsizeiptr size, const void *data)
+void UploadRing::create(size_t size)
+{
+	if (size == 0)
+	{
+		return;
+	}
+	const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	glCreateBuffers(1, &m_buffer);
+	glNamedBufferStorage(m_buffer, GLsizeiptr(size), nullptr, flags);
+	m_mapping = static_cast<unsigned char *>(glMapNamedBufferRange(m_buffer, 0, GLsizeiptr(size), flags));
+	m_size = size;
+}
+
+void UploadRing::destroy()
+{
+	for (const Region &region : m_regions)
+	{
+		glDeleteSync(region.fence);
+	}
+	m_regions.clear();
+	if (m_buffer)
+	{
+		glUnmapNamedBuffer(m_buffer);
+		deleteGLObject(m_buffer, glDeleteBuffers);
+	}
+	m_mapping = nullptr;
+	m_size = m_head = m_used = m_pending = 0;
+}
+
+UploadRing::Allocation UploadRing::stage(const void *data, size_t size, size_t alignment)
+{
+	// Large copies are split over the worker pool, which writes straight into the mapping.
+	return stage(size, [data, size](unsigned char *destination)
+	{
+		constexpr size_t ChunkSize = 1 << 20;
+		const size_t numChunks = (size + ChunkSize - 1) / ChunkSize;
+		ThreadPool::instance().parallelFor(numChunks, [&](size_t chunk)
+		{
+			const size_t begin = chunk * ChunkSize;
+			std::memcpy(destination + begin, static_cast<const unsigned char *>(data) + begin, std::min(ChunkSize, size - begin));
+		});
+	}, alignment);
+}
+
+UploadRing::Allocation UploadRing::stage(size_t size, const std::function<void(unsigned char *destination)> &fill, size_t alignment)
+{
+	if (!m_mapping || size > m_size)
+	{
+		++m_stats.directUploads;
+		return {};
+	}
+
+	// Place the data at the next aligned offset, or at the start if it would run past the end.
+	size_t offset = (m_head + alignment - 1) / alignment * alignment;
+	if (offset + size > m_size)
+	{
+		offset = 0;
+	}
+	const size_t needed = (offset >= m_head ? offset - m_head : m_size - m_head) + size;
+
+	retire(false);
+	if (m_size - m_used < needed)
+	{
+		// The ring is full: wait for the GPU to finish reading the oldest regions.
+		const auto stallStart = std::chrono::steady_clock::now();
+		if (m_pending > 0)
+		{
+			submit();
+		}
+		while (m_size - m_used < needed && !m_regions.empty())
+		{
+			retire(true);
+		}
+		if (m_regions.empty())
+		{
+			m_head = m_used = 0;
+		}
+		++m_stats.stalls;
+		m_stats.stallMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stallStart).count();
+		return stage(size, fill, alignment);
+	}
+
+	const auto writeStart = std::chrono::steady_clock::now();
+	fill(m_mapping + offset);
+	m_stats.writeMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - writeStart).count();
+	m_stats.bytes += size;
+	++m_stats.uploads;
+
+	m_head = offset + size;
+	m_used += needed;
+	m_pending += needed;
+	return {offset, m_mapping + offset};
+}
+
+void UploadRing::submit()
+{
+	if (m_pending == 0)
+	{
+		return;
+	}
+	m_regions.push_back({glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), m_pending});
+	m_pending = 0;
+}
+
+void UploadRing::retire(bool wait)
+{
+	while (!m_regions.empty())
+	{
+		const Region &region = m_regions.front();
+		const GLenum status = glClientWaitSync(region.fence, wait ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, wait ? GLuint64(1000000000) : 0);
+		if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+		{
+			return;
+		}
+		glDeleteSync(region.fence);
+		m_used -= region.bytes;
+		m_regions.pop_front();
+		wait = false;
+	}
+}
+
+void Renderer::printUploadStats() const
+{
+	const UploadRing::Stats &stats = m_uploadRing.stats();
+	std::printf("Upload ring: %.2f MB in %llu uploads, %.0f MB/s written, %llu stalls (%.1f ms), %llu direct uploads\n",
+				double(stats.bytes) / (1 << 20), (unsigned long long)stats.uploads,
+				double(stats.bytes) / (1 << 20) / std::max(stats.writeMilliseconds * 1e-3, 1e-9), (unsigned long long)stats.stalls,
+				stats.stallMilliseconds, (unsigned long long)stats.directUploads);
+}
+
+void Renderer::createStagedBuffer(GLuint &buffer, size_t size, const void *data)
 {
 	glCreateBuffers(1, &buffer);
-	glNamedBufferStorage(buffer, size, data, 0);
+	const UploadRing::Allocation staging = m_uploadRing.stage(data, size);
+	if (!staging.data)
+	{
+		glNamedBufferStorage(buffer, GLsizeiptr(size), data, 0);
+		return;
+	}
+	glNamedBufferStorage(buffer, GLsizeiptr(size), nullptr, 0);
+	glCopyNamedBufferSubData(m_uploadRing.buffer(), buffer, GLintptr(staging.offset), 0, GLsizeiptr(size));
 }
 
-MeshBuffer Renderer::createMeshBuffer(const std::shared_ptr<class Mesh> &mesh)
+MeshBuffer Renderer::createMeshBuffer(const std::shared_ptr<class Mesh> &mesh, bool packed)
 {
 	MeshBuffer buffer;
 	buffer.numElements = static_cast<GLuint>(mesh->faces().size()) * 3;
 
-	createGLBuffer(buffer.vbo, mesh->vertices().size() * sizeof(Mesh::Vertex), mesh->vertices().data());
-	createGLBuffer(buffer.ibo, mesh->faces().size() * sizeof(Mesh::Face), mesh->faces().data());
-
+	if (mesh->hasShortIndices())
+	{
+		const std::vector<uint16_t> indices(&mesh->faces().data()->v1, &mesh->faces().data()->v1 + buffer.numElements);
+		createStagedBuffer(buffer.ibo, indices.size() * sizeof(uint16_t), indices.data());
+		buffer.indexType = GL_UNSIGNED_SHORT;
+	}
+	else
+	{
+		createStagedBuffer(buffer.ibo, mesh->faces().size() * sizeof(Mesh::Face), mesh->faces().data());
+	}
 	glCreateVertexArrays(1, &buffer.vao);
 	glVertexArrayElementBuffer(buffer.vao, buffer.ibo);
 
+	// Every submesh is one command over its range of the shared buffers, repeated for every level of detail. All
+	// submeshes are shaded with the renderer's one texture set: the imported materials are not used for drawing.
+	for (const Mesh::Submesh &submesh : mesh->submeshes())
+	{
+		buffer.numLods = std::max(buffer.numLods, int(submesh.numLods));
+	}
+	std::vector<RendererDetails::DrawElementsIndirectCommand> commands;
+	for (int level = 0; level < buffer.numLods; ++level)
+	{
+		for (const Mesh::Submesh &submesh : mesh->submeshes())
+		{
+			const Mesh::Lod &lod = submesh.lods[std::min(level, int(submesh.numLods) - 1)];
+			commands.push_back({lod.numFaces * 3, 1, lod.firstFace * 3, GLint(submesh.firstVertex), 0});
+			buffer.lodErrors[level] = std::max(buffer.lodErrors[level], lod.error);
+		}
+	}
+	buffer.numDraws = GLsizei(mesh->submeshes().size());
+
+	glm::vec3 minimum{std::numeric_limits<float>::max()}, maximum{-std::numeric_limits<float>::max()};
+	for (const Mesh::Vertex &vertex : mesh->vertices())
+	{
+		minimum = glm::min(minimum, vertex.position);
+		maximum = glm::max(maximum, vertex.position);
+	}
+	buffer.boundsCenter = 0.5f * (minimum + maximum);
+	buffer.boundsRadius = 0.5f * glm::length(maximum - minimum);
+	createStagedBuffer(buffer.drawCommands, commands.size() * sizeof(commands[0]), commands.data());
+
+	if (packed)
+	{
+		// Matches the PACKED_VERTICES inputs of pbr.vs: normalized position and QTangent, half-float UVs.
+		const Mesh::PackedVertices vertices = mesh->pack();
+		buffer.positionScale = vertices.positionScale;
+		buffer.positionOffset = vertices.positionOffset;
+		createStagedBuffer(buffer.vbo, vertices.vertices.size() * sizeof(Mesh::PackedVertex), vertices.vertices.data());
+
+		glVertexArrayVertexBuffer(buffer.vao, 0, buffer.vbo, 0, sizeof(Mesh::PackedVertex));
+		glVertexArrayAttribFormat(buffer.vao, 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(Mesh::PackedVertex, position));
+		glVertexArrayAttribFormat(buffer.vao, 1, 4, GL_SHORT, GL_TRUE, offsetof(Mesh::PackedVertex, qtangent));
+		glVertexArrayAttribFormat(buffer.vao, 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(Mesh::PackedVertex, texcoord));
+		for (int i = 0; i < 3; ++i)
+		{
+			glEnableVertexArrayAttrib(buffer.vao, i);
+			glVertexArrayAttribBinding(buffer.vao, i, 0);
+		}
+		return buffer;
+	}
+
+	createStagedBuffer(buffer.vbo, mesh->vertices().size() * sizeof(Mesh::Vertex), mesh->vertices().data());
 	for (int i = 0; i < Mesh::NumAttributes; ++i)
 	{
 		glVertexArrayVertexBuffer(buffer.vao, i, buffer.vbo, i * sizeof(glm::vec3), sizeof(Mesh::Vertex));
@@ -588,11 +2144,43 @@ MeshBuffer Renderer::createMeshBuffer(const std::shared_ptr<class Mesh> &mesh)
 	return buffer;
 }
 
+void Renderer::drawMeshBuffer(const MeshBuffer &buffer, int lod)
+{
+	const size_t offset = size_t(lod) * buffer.numDraws * sizeof(RendererDetails::DrawElementsIndirectCommand);
+	glBindVertexArray(buffer.vao);
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, buffer.drawCommands);
+	glMultiDrawElementsIndirect(GL_TRIANGLES, buffer.indexType, reinterpret_cast<const void *>(offset), buffer.numDraws, 0);
+}
+
+int Renderer::selectLod(const MeshBuffer &buffer, const glm::mat4 &projectionMatrix, const glm::mat4 &modelViewMatrix) const
+{
+	if (m_settings.lodErrorPixels <= 0.0)
+	{
+		return 0;
+	}
+	// Project the errors at the point of the bounding sphere nearest to the eye; inside it, draw full resolution.
+	const glm::vec3 center = modelViewMatrix * glm::vec4{buffer.boundsCenter, 1.0f};
+	const float distance = glm::length(center) - buffer.boundsRadius;
+	if (distance <= 0.0f)
+	{
+		return 0;
+	}
+	const float pixelsPerUnit = 0.5f * float(m_framebuffer.height) * std::abs(projectionMatrix[1][1]) / distance;
+
+	int lod = 0;
+	while (lod + 1 < buffer.numLods && buffer.lodErrors[lod + 1] * pixelsPerUnit <= m_settings.lodErrorPixels)
+	{
+		++lod;
+	}
+	return lod;
+}
+
 void Renderer::deleteMeshBuffer(MeshBuffer &buffer)
 {
 	deleteGLObject(buffer.vao, glDeleteVertexArrays);
 	deleteGLObject(buffer.vbo, glDeleteBuffers);
 	deleteGLObject(buffer.ibo, glDeleteBuffers);
+	deleteGLObject(buffer.drawCommands, glDeleteBuffers);
 	std::memset(&buffer, 0, sizeof(MeshBuffer));
 }
 
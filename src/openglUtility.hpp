@@ -1,7 +1,20 @@
 #pragma once
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <deque>
+#include <future>
+#include <memory>
+#include <thread>
 #include <string>
+#include <vector>
 #include <glad/glad.h>
+#include "ibl.hpp"
+#include "iblcache.hpp"
 #include "renderer.hpp"
+#include "mesh.hpp"
+#include "sampletables.hpp"
+#include "texturecontainer.hpp"
 
 /**
  * @brief Represents a buffer for storing mesh data.
@@ -9,7 +22,17 @@
 struct MeshBuffer
 {
     GLuint vbo = 0, ibo = 0, vao = 0;
+    GLuint drawCommands = 0;  // One DrawElementsIndirectCommand per submesh and level of detail, level by level.
+    GLsizei numDraws = 0;     // Commands per level.
     GLuint numElements = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+    glm::vec3 positionScale{1.0f}, positionOffset{0.0f};  // Dequantization of packed vertex positions.
+    glm::vec3 boundsCenter{0.0f};
+    float boundsRadius = 0.0f;
+
+    // Levels of detail, full resolution first; submeshes with fewer levels repeat their last one.
+    int numLods = 1;
+    float lodErrors[Mesh::MaxLods] = {};     // Largest simplification error of a level in model units.
 };
 
 /**
@@ -34,12 +57,199 @@ struct Texture
     int levels = 0;
 };
 
+/**
+ * @brief Image-based lighting resources of one environment, swapped in as a unit.
+ */
+struct IBLResources
+{
+    Texture envTexture;                // Pre-filtered specular cube map.
+    Texture irmapTexture;              // Diffuse irradiance cube map (IrradianceMode::Cubemap only).
+    glm::vec4 irradianceSH[9] = {};    // Pre-scaled SH irradiance coefficients (IrradianceMode::SH*).
+};
+
+/**
+ * @brief Baked environments kept in video memory, so switching back to one needs no rebake.
+ *
+ * Entries own their textures and are evicted least recently used first whenever the library
+ * exceeds RendererSettings::environmentBudgetMB; the environment in use is never evicted.
+ */
+struct EnvironmentLibrary
+{
+    struct Entry
+    {
+        int environmentIndex = 0;
+        IBLResources resources;
+        size_t bytes = 0;              // Video memory of the entry's textures.
+        uint64_t lastUse = 0;          // Value of EnvironmentLibrary::useCounter when last selected.
+    };
+
+    /**
+     * @brief Residency and hit/miss counters.
+     */
+    struct Stats
+    {
+        size_t resident = 0;
+        size_t residentBytes = 0;
+        size_t budgetBytes = 0;
+        uint64_t hits = 0;             // Selections served by a resident entry.
+        uint64_t misses = 0;           // Selections that had to load or bake the environment.
+        uint64_t evictions = 0;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t useCounter = 0;
+    Stats stats;
+};
+
+/**
+ * @brief Persistently mapped staging buffer that texture and buffer uploads are copied through.
+ *
+ * Space is handed out in ring order and written by the worker pool straight into the mapping; the GL
+ * thread then issues copies from buffer offsets, which the driver performs asynchronously instead of
+ * copying client memory first. submit() fences the space used since the previous call, and allocate()
+ * waits for the oldest fence only when the ring is full.
+ */
+class UploadRing
+{
+public:
+    struct Allocation
+    {
+        size_t offset = 0;
+        unsigned char* data = nullptr;   // Null if the request does not fit the ring.
+    };
+
+    struct Stats
+    {
+        size_t bytes = 0;                // Data staged through the ring.
+        uint64_t uploads = 0;
+        double writeMilliseconds = 0.0;  // Time spent writing into the mapping.
+        uint64_t stalls = 0;             // Allocations that waited for the GPU to release space.
+        double stallMilliseconds = 0.0;
+        uint64_t directUploads = 0;      // Requests larger than the ring, uploaded from client memory.
+    };
+
+    void create(size_t size);
+    void destroy();
+
+    GLuint buffer() const { return m_buffer; }
+    const Stats& stats() const { return m_stats; }
+
+    /**
+     * @brief Reserves space for size bytes and copies data into it on the worker pool; returns a null
+     * allocation (and counts a direct upload) if the ring is disabled or too small.
+     */
+    Allocation stage(const void* data, size_t size, size_t alignment = 16);
+
+    /**
+     * @brief Same as above, but fill writes the size bytes straight into the mapping (e.g. while decoding them).
+     */
+    Allocation stage(size_t size, const std::function<void(unsigned char* destination)>& fill, size_t alignment = 16);
+
+    /**
+     * @brief Fences the space staged since the last call; the GL commands reading it must have been issued.
+     */
+    void submit();
+
+private:
+    struct Region
+    {
+        GLsync fence;
+        size_t bytes;                    // Staged data and alignment padding covered by the fence.
+    };
+
+    void retire(bool wait);
+
+    GLuint m_buffer = 0;
+    unsigned char* m_mapping = nullptr;
+    size_t m_size = 0;
+    size_t m_head = 0;                   // Next free byte.
+    size_t m_used = 0;                   // Bytes from the oldest unretired region to m_head.
+    size_t m_pending = 0;                // Bytes staged since the last submit().
+    std::deque<Region> m_regions;
+    Stats m_stats;
+};
+
+/**
+ * @brief Material textures uploaded coarsest level first while their containers load on the worker pool.
+ *
+ * A texture is a 1x1 placeholder until its container is ready. Then its smallest levels are uploaded at
+ * once and the finer ones one at a time under a per-frame byte budget, least refined texture first.
+ * GL_TEXTURE_BASE_LEVEL keeps sampling on the levels uploaded so far.
+ */
+struct TextureStreamer
+{
+    struct Stream
+    {
+        std::string name;
+        Texture* texture = nullptr;
+        std::future<std::shared_ptr<TextureContainer>> loading;
+        std::shared_ptr<TextureContainer> container;
+        int residentLevel = 0;         // Finest level uploaded so far.
+    };
+
+    std::vector<Stream> streams;       // Released once every level is resident.
+    std::chrono::steady_clock::time_point startTime;  // Start of setup, for time to first frame and to full quality.
+    size_t uploadedBytes = 0;
+    int frames = 0;
+    bool complete = false;
+};
+
+/**
+ * @brief Bake of one environment's IBL resources, split into small GPU work units.
+ *
+ * Units run in order under a per-frame GPU time budget; the renderer keeps using its current
+ * resources until the job's fence has signalled and then swaps the new ones in at once.
+ */
+struct IBLBakeJob
+{
+    struct Unit
+    {
+        std::string stage;             // Name of the bake stage, for reporting.
+        double cost;                   // Estimated GPU work (texels times samples).
+        std::function<void()> run;
+    };
+
+    std::string environmentFile;
+    int environmentIndex = 0;
+
+    // Cache lookup or image decoding, done on a worker thread.
+    std::future<void> loading;
+    uint64_t cacheKey = 0;
+    bool cacheHit = false;
+    IBLCache::Contents cached;
+    IBL::EnvironmentSource source;
+    std::thread::id loadingThread;     // Where and when the loading ran, for the startup timeline.
+    std::chrono::steady_clock::time_point loadingStart, loadingEnd;
+
+    bool prepared = false;
+    bool timeSliced = false;           // Units are issued under a per-frame budget rather than all at once.
+    int envMapSize = 0;                // Edge of the environment cube map being baked.
+    std::vector<Unit> units;
+    size_t nextUnit = 0;
+
+    IBLResources resources;
+    Texture envTextureEquirect, envTextureUnfiltered;
+    GLuint specularSampleBuffer = 0, irradianceSampleBuffer = 0;
+    GLuint shPartialSums = 0, shCoefficients = 0;
+    GLsync fence = nullptr;
+
+    // GPU cost model (milliseconds per unit of cost), refined from a timer query around each slice.
+    double millisecondsPerCost = 1e-6;
+    GLuint timerQuery = 0;
+    double queryCost = 0.0;            // Cost issued inside the pending query, 0 if none is pending.
+
+    std::chrono::steady_clock::time_point startTime;
+    int frames = 0;
+};
+
 /**
  * @brief The main renderer class.
  */
 class Renderer final : public RendererInterface
 {
 public:
+    explicit Renderer(const RendererSettings& settings = RendererSettings{}) : m_settings(settings) {}
+
     GLFWwindow* initialize(int width, int height, int maxSamples) override;
     void loadGLExtensions();
     void determineMultisampling(int maxSamples, int width, int height);
@@ -47,6 +257,12 @@ public:
     void setup() override;
     void render(GLFWwindow* window, const CameraSettings& view, const SceneSettings& scene) override;
 
+    // Residency and hit/miss counters of the environment library.
+    const EnvironmentLibrary::Stats& environmentStats() const { return m_environments.stats; }
+
+    // Throughput and stall counters of the upload ring.
+    const UploadRing::Stats& uploadStats() const { return m_uploadRing.stats(); }
+
 //Cleaner functions
 private:
     void cleanFramebuffers();
@@ -56,8 +272,21 @@ private:
     void cleanTextures();
 
 private:
+    // IBL bake parameters
+    static constexpr int kEnvMapSize = 1024;
+    static constexpr int kIrradianceMapSize = 32;
+    static constexpr int kBRDF_LUT_Size = 256;
+    static constexpr int kSHProjectionSize = 64;
+    static constexpr int kStreamingTailSize = 128;   // Levels up to this size are uploaded as soon as a texture has loaded.
+    static constexpr size_t kEnvironmentBlockBytes = 2 << 20;  // Half-float rows of an equirect decoded per upload unit.
+    static constexpr const char* kIBLCacheDirectory = "data/cache";
+    static constexpr unsigned int kSpecularSamples = 1024;      // Base count, reduced on rough levels.
+    static constexpr unsigned int kIrradianceSamples = 64 * 1024;
+    static constexpr unsigned int kFilteredIrradianceSamples = 4096;  // Same error as ~16k uniform samples.
+    static constexpr unsigned int kBRDFSamples = 1024;
+
     // Shader utility functions
-    static GLuint compileShader(const std::string& filename, GLenum type);
+    static GLuint compileShader(const std::string& filename, GLenum type, const std::vector<std::string>& defines = {});
     static GLuint linkProgram(std::initializer_list<GLuint> shaders);
 
     void setupTextureParameters(GLuint textureId, int levels) const;
@@ -67,6 +296,47 @@ private:
     Texture createTexture(const std::shared_ptr<class Image>& image, GLenum format, GLenum internalformat, int levels = 0) const;
     static void deleteTexture(Texture& texture);
 
+    // Texture streaming: the texture is a placeholder of the given color until its container has loaded,
+    // then updateTextureStreaming() uploads its levels coarsest first within the frame's budget.
+    void streamTexture(const std::string& name, Texture& texture, std::future<std::shared_ptr<TextureContainer>> loading, const glm::vec4& placeholder);
+    void beginTextureStream(TextureStreamer::Stream& stream);
+    size_t uploadTextureLevel(const Texture& texture, const TextureContainer& container, int level);
+    void updateTextureStreaming();
+
+    // Image-based lighting resources: completes a job from startIBLBake() at once, with the result loaded
+    // from the on-disk cache when possible (returns true on a hit).
+    bool setupIBL(IBLBakeJob& job);
+    uint64_t iblCacheKey(const std::string& environmentFile) const;
+    IBLCache::Contents readbackIBL() const;
+
+    // Incremental IBL baking. An infinite budget runs a job to completion in one call.
+    void createBakePrograms();
+    std::unique_ptr<IBLBakeJob> startIBLBake(int environmentIndex);
+    void prepareIBLBake(IBLBakeJob& job);
+    void queueIBLUpload(IBLBakeJob& job);
+    void queueIBLBake(IBLBakeJob& job);
+    void uploadEnvironmentRows(const class RGBEDecoder& decoder, const Texture& texture, int firstRow, int numRows);
+    void queueTiledPrefilter(IBLBakeJob& job, const IBL::SpecularSampleTable& sampleTable);
+    void queueSinglePrefilter(IBLBakeJob& job, const IBL::SpecularSampleTable& sampleTable);
+    bool advanceIBLBake(IBLBakeJob& job, double budgetMilliseconds);
+    void finishIBLBake(IBLBakeJob& job);
+    void releaseIBLBake(IBLBakeJob& job);
+    void updateEnvironment(const SceneSettings& scene);
+
+    // Environment library: takes ownership of baked resources and switches between resident entries.
+    EnvironmentLibrary::Entry* findResidentEnvironment(int environmentIndex);
+    void addResidentEnvironment(int environmentIndex, IBLResources& resources);
+    void activateEnvironment(EnvironmentLibrary::Entry& entry);
+    int nextPreloadEnvironment() const;
+    void printEnvironmentStats() const;
+    void printUploadStats() const;
+
+    // Split-sum BRDF LUT: uploads the embedded table, integrates it with spbrdf.cs, or skips it for the analytic fit.
+    void setupBRDF_LUT();
+
+    // Writes the baked IBL textures as Radiance HDR files for comparison with PBR-IBL-Bake.
+    void dumpIBLTextures(const std::string& directory) const;
+
     static void attachMultisampleRenderBuffer(GLuint framebuffer, GLuint &rbo, GLenum attachment, GLenum format, int samples, int width, int height);
     static void attachTextureBuffer(GLuint framebuffer, GLuint &texture, GLenum attachment, GLenum format, int width, int height);
 
@@ -76,8 +346,11 @@ private:
     static void deleteFrameBuffer(FrameBuffer& fb);
 
     // MeshBuffer utility functions
-    static MeshBuffer createMeshBuffer(const std::shared_ptr<class Mesh>& mesh);
+    MeshBuffer createMeshBuffer(const std::shared_ptr<class Mesh>& mesh, bool packed = false);
+    void createStagedBuffer(GLuint& buffer, size_t size, const void* data);
     static void deleteMeshBuffer(MeshBuffer& buffer);
+    static void drawMeshBuffer(const MeshBuffer& buffer, int lod = 0);
+    int selectLod(const MeshBuffer& buffer, const glm::mat4& projectionMatrix, const glm::mat4& modelViewMatrix) const;
 
     // Uniform buffer utility functions
     static GLuint createUniformBuffer(const void* data, size_t size);
@@ -92,6 +365,8 @@ private:
     static void logMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar* message, const void* userParam);
 #endif
 
+    RendererSettings m_settings;
+
     // Renderer capabilities
     struct 
     {
@@ -103,6 +378,24 @@ private:
     MeshBuffer m_skybox, m_pbrModel;
     GLuint m_emptyVAO;
     GLuint m_tonemapProgram, m_skyboxProgram, m_pbrProgram;
-    Texture m_envTexture, m_irmapTexture, m_spBRDF_LUT, m_albedoTexture, m_normalTexture, m_metalnessTexture, m_roughnessTexture;
+    Texture m_spBRDF_LUT, m_albedoTexture, m_normalTexture, m_ormTexture;
+    TextureStreamer m_textureStreamer;
+    UploadRing m_uploadRing;
+    bool m_firstFrame = true;
     GLuint m_transformUB, m_shadingUB;
+
+    // Environment lighting: the resources in use (owned by m_environments), the resident environments
+    // and the bake that will add the next one.
+    IBLResources m_ibl;
+    EnvironmentLibrary m_environments;
+    std::unique_ptr<IBLBakeJob> m_iblBake;
+    struct
+    {
+        GLuint equirectToCube = 0, spmap = 0, irmap = 0, shProject = 0, shReduce = 0;
+        int spmapLevelsPerDispatch = 1;   // Image array size of spmap.cs (SpecularPrefilterMode::SingleDispatch).
+    } m_bakePrograms;
+    int m_currentEnvironment = 0;
+    int m_requestedEnvironment = 0;
+    unsigned m_environmentRequest = 0; // Last SceneSettings::environmentRequest handled by render().
+    std::chrono::steady_clock::time_point m_environmentSwapTime;
 };
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <string>
+#include <vector>
 #include <glm/mat4x4.hpp>
 
 // Forward declaration of GLFW's window structure.
@@ -30,6 +33,67 @@ struct SceneSettings
 
     static const int MaxLights = 3; // Maximum number of lights.
     Light lights[MaxLights];
+
+    // Environment selection. Every request bumps the counter, which the renderer compares with the last one it
+    // handled, so selecting the environment that was selected before still switches back to it.
+    static const int NextEnvironment = -1;
+    int environment = NextEnvironment;  // Index into RendererSettings::environments, or NextEnvironment.
+    unsigned environmentRequest = 0;
+};
+
+// Source of the diffuse image-based lighting term.
+enum class IrradianceMode
+{
+    Cubemap,    // 32x32 irradiance cube map convolved by irmap.cs.
+    SHCompute,  // 9 spherical harmonics coefficients projected on the GPU (shproject.cs).
+    SHCPU,      // 9 spherical harmonics coefficients projected on the CPU.
+};
+
+// Source of the split-sum specular BRDF term (scale and bias applied to F0).
+enum class BRDFMode
+{
+    Embedded,   // LUT generated at build time by PBR-BRDF-LUT and uploaded at startup.
+    Compute,    // LUT integrated at startup by spbrdf.cs.
+    Analytic,   // Polynomial fit evaluated in pbr.fs; no LUT texture or binding.
+};
+
+// How spmap.cs covers the pre-filtered specular mip chain.
+enum class SpecularPrefilterMode
+{
+    Tiled,          // One dispatch per tile of one face of one level; GPU time is reported per level.
+    SingleDispatch, // All levels bound as an image array and covered by one dispatch of 8x8 work groups.
+};
+
+// How the mip chains of the material textures are built.
+enum class TextureMipmapMode
+{
+    Driver,   // glGenerateTextureMipmap at every startup.
+    Box,      // CPU filters (see Mipmaps::Filter); the chain is stored in a texture container
+    Kaiser,   // next to the texture and only uploaded on later runs.
+    Lanczos,
+};
+
+// Options controlling how the renderer builds its resources.
+struct RendererSettings
+{
+    std::string iblDumpDirectory;  // If set, baked IBL textures are written here as Radiance HDR files.
+    IrradianceMode irradianceMode = IrradianceMode::Cubemap;
+    bool filteredIrradiance = true;  // Filtered importance sampling for irmap.cs, with far fewer samples.
+    BRDFMode brdfMode = BRDFMode::Embedded;
+    SpecularPrefilterMode prefilterMode = SpecularPrefilterMode::Tiled;
+    bool iblCache = true;          // Load/store baked IBL resources in data/cache.
+    TextureMipmapMode textureMipmaps = TextureMipmapMode::Kaiser;
+    bool compressTextures = true;  // BC7 albedo, BC5 normals, BC4 scalar maps (requires CPU mipmaps).
+    double textureUploadBudgetMB = 4.0;  // Texture data streamed in per frame; 0 uploads every level at once.
+    size_t uploadRingMB = 64;      // Persistently mapped staging buffer for uploads; 0 uploads from client memory.
+    bool packedVertices = true;    // 20-byte quantized model vertices (Mesh::PackedVertex) instead of 56-byte floats.
+    double lodErrorPixels = 1.0;   // Screen-space error allowed when choosing the model's level of detail; 0 draws full resolution.
+
+    std::vector<std::string> environments{"data/environment.hdr"};  // HDR environments (see IBL::loadEnvironment).
+    double bakeBudgetMilliseconds = 2.0;     // GPU time per frame spent baking a newly selected environment.
+    double environmentRotationSeconds = 0.0; // If positive, switch to the next environment this often.
+    size_t environmentBudgetMB = 512;        // Video memory for baked environments kept resident.
+    bool preloadEnvironments = false;        // Bake the other environments in the background while they fit the budget.
 };
 
 // Interface defining the core methods a renderer should implement.
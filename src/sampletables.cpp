@@ -0,0 +1,143 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+
+#include "sampletables.hpp"
+
+namespace
+{
+	// Constants as spelled in the compute shaders.
+	constexpr float PI = 3.141592f;
+	constexpr float TwoPI = 2.0f * PI;
+	constexpr float IrradiancePI = 3.14159265359f;
+
+	// Levels that keep the full specular sample count, and the count rough levels never drop below.
+	constexpr int FullSampleLevels = 2;
+	constexpr unsigned int MinSpecularSamples = 128;
+
+	// Van der Corput radical inverse in base 2.
+	float radicalInverse(uint32_t bits)
+	{
+		bits = (bits << 16u) | (bits >> 16u);
+		bits = ((bits & 0x55555555u) << 1u) | ((bits & 0xAAAAAAAAu) >> 1u);
+		bits = ((bits & 0x33333333u) << 2u) | ((bits & 0xCCCCCCCCu) >> 2u);
+		bits = ((bits & 0x0F0F0F0Fu) << 4u) | ((bits & 0xF0F0F0F0u) >> 4u);
+		bits = ((bits & 0x00FF00FFu) << 8u) | ((bits & 0xFF00FF00u) >> 8u);
+		return float(bits) * 2.3283064365386963e-10f;
+	}
+
+	glm::vec2 sampleHammersley(uint32_t i, float invNumSamples)
+	{
+		return {i * invNumSamples, radicalInverse(i)};
+	}
+
+	// GGX half-vector in tangent space.
+	glm::vec3 sampleGGX(float u1, float u2, float roughness)
+	{
+		const float alpha = roughness * roughness;
+		const float cosTheta = std::sqrt((1.0f - u2) / (1.0f + (alpha*alpha - 1.0f) * u2));
+		const float sinTheta = std::sqrt(1.0f - cosTheta*cosTheta);
+		const float phi = TwoPI * u1;
+		return {sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta};
+	}
+
+	float ndfGGX(float cosHalfVector, float roughness)
+	{
+		const float alpha = roughness * roughness;
+		const float alphaSq = alpha * alpha;
+		const float denom = (cosHalfVector * cosHalfVector) * (alphaSq - 1.0f) + 1.0f;
+		return alphaSq / (PI * denom * denom);
+	}
+}
+
+namespace IBL
+{
+	unsigned int specularSampleCount(int level, unsigned int baseSamples)
+	{
+		const int shift = std::min(std::max(level - FullSampleLevels, 0), 31);
+		return std::min(baseSamples, std::max(MinSpecularSamples, baseSamples >> shift));
+	}
+
+	SpecularSampleTable buildSpecularSampleTable(int envMapSize, int levels, unsigned int baseSamples)
+	{
+		SpecularSampleTable table;
+		table.levels.resize(std::max(levels, 1));
+
+		const float deltaRoughness = 1.0f / std::max(float(levels - 1), 1.0f);
+		const float wt = 4.0f * PI / (6.0f * float(envMapSize) * float(envMapSize));
+
+		for(int level=1; level<levels; ++level) {
+			const float roughness = level * deltaRoughness;
+			const unsigned int numSamples = specularSampleCount(level, baseSamples);
+			const float invNumSamples = 1.0f / float(numSamples);
+
+			SpecularSampleTable::Level& range = table.levels[level];
+			range.first = unsigned(table.samples.size());
+			range.drawn = numSamples;
+			for(unsigned int i=0; i<numSamples; ++i) {
+				const glm::vec2 u = sampleHammersley(i, invNumSamples);
+				const glm::vec3 halfVector = sampleGGX(u.x, u.y, roughness);
+				const glm::vec3 lightDir = 2.0f * halfVector.z * halfVector - glm::vec3{0.0f, 0.0f, 1.0f};
+				if(lightDir.z > 0.0f) {
+					const float pdf = ndfGGX(std::max(halfVector.z, 0.0f), roughness) * 0.25f;
+					const float ws = 1.0f / (float(numSamples) * pdf);
+					const float lod = std::max(0.5f * std::log2(ws / wt) + 1.0f, 0.0f);
+					table.samples.push_back({lightDir, lod});
+				}
+			}
+			range.count = unsigned(table.samples.size()) - range.first;
+		}
+		return table;
+	}
+
+	std::vector<glm::vec4> buildIrradianceSampleTable(unsigned int numSamples)
+	{
+		const float invNumSamples = 1.0f / float(numSamples);
+
+		std::vector<glm::vec4> samples(numSamples);
+		for(unsigned int i=0; i<numSamples; ++i) {
+			const glm::vec2 u = sampleHammersley(i, invNumSamples);
+			const float radius = std::sqrt(std::max(0.0f, 1.0f - u.x * u.x));
+			const float phi = 2.0f * IrradiancePI * u.y;
+			samples[i] = {std::cos(phi) * radius, std::sin(phi) * radius, u.x, std::max(0.0f, u.x)};
+		}
+		return samples;
+	}
+
+	std::vector<glm::vec4> buildFilteredIrradianceSampleTable(unsigned int numSamples, int envMapSize)
+	{
+		const float invNumSamples = 1.0f / float(numSamples);
+		const float wt = 4.0f * PI / (6.0f * float(envMapSize) * float(envMapSize));
+
+		std::vector<glm::vec4> samples(numSamples);
+		for(unsigned int i=0; i<numSamples; ++i) {
+			const glm::vec2 u = sampleHammersley(i, invNumSamples);
+			const float radius = std::sqrt(u.x);
+			const float phi = TwoPI * u.y;
+			const float cosTheta = std::sqrt(std::max(0.0f, 1.0f - u.x));
+
+			// pdf = cos(theta) / pi. Unlike the specular lobe, the irradiance error is lowest without the +1 lod bias
+			// (measured with PBR-IBL-Bake --irradiance-benchmark).
+			const float pdf = std::max(cosTheta, 1e-4f) / PI;
+			const float ws = 1.0f / (float(numSamples) * pdf);
+			const float lod = std::max(0.5f * std::log2(ws / wt), 0.0f);
+			samples[i] = {std::cos(phi) * radius, std::sin(phi) * radius, cosTheta, lod};
+		}
+		return samples;
+	}
+
+	std::vector<glm::vec4> buildBRDFSampleTable(int size, unsigned int numSamples)
+	{
+		const float invNumSamples = 1.0f / float(numSamples);
+
+		std::vector<glm::vec4> samples(size_t(size) * numSamples);
+		for(int y=0; y<size; ++y) {
+			const float roughness = float(y) / float(size);
+			for(unsigned int i=0; i<numSamples; ++i) {
+				const glm::vec2 u = sampleHammersley(i, invNumSamples);
+				samples[size_t(y) * numSamples + i] = glm::vec4{sampleGGX(u.x, u.y, roughness), 0.0f};
+			}
+		}
+		return samples;
+	}
+}
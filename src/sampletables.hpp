@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+
+// Importance-sample tables shared by the IBL bake shaders (uploaded as shader storage buffers)
+// and the CPU kernels in ibl.cpp.
+// The Hammersley points and the GGX / hemisphere transforms only depend on the sample index and
+// the roughness, so they are built once per level instead of in every invocation's sample loop.
+namespace IBL
+{
+	/**
+	 * @brief Number of GGX samples drawn for a pre-filtered specular mip level.
+	 *
+	 * The first levels get the full base count; every further level halves it down to a floor.
+	 * Rough levels fetch from correspondingly blurrier source mips (filtered importance sampling),
+	 * so the extra samples there no longer reduce noise.
+	 */
+	unsigned int specularSampleCount(int level, unsigned int baseSamples);
+
+	/**
+	 * @brief Samples for every pre-filtered level of a specular environment map (spmap.cs).
+	 *
+	 * With the view direction equal to the normal the reflected light direction is fixed in tangent space,
+	 * so each sample is stored as that direction (xyz) and the source mip level to fetch it from (w).
+	 * Samples below the horizon contribute nothing and are dropped.
+	 */
+	struct SpecularSampleTable
+	{
+		struct Level
+		{
+			unsigned int first = 0;   // Index of the level's first sample.
+			unsigned int count = 0;   // Samples kept for the level.
+			unsigned int drawn = 0;   // Samples drawn, including the rejected ones.
+		};
+
+		std::vector<glm::vec4> samples;
+		std::vector<Level> levels;    // Indexed by mip level; level 0 is copied and has no samples.
+	};
+
+	SpecularSampleTable buildSpecularSampleTable(int envMapSize, int levels, unsigned int baseSamples);
+
+	/**
+	 * @brief Uniform hemisphere directions in tangent space (xyz) with their cosine weight (w) for irmap.cs.
+	 */
+	std::vector<glm::vec4> buildIrradianceSampleTable(unsigned int numSamples);
+
+	/**
+	 * @brief Cosine-weighted hemisphere directions in tangent space (xyz) with the source mip level (w)
+	 * for filtered importance sampling of the irradiance (irmap.cs with FILTERED_IMPORTANCE_SAMPLING).
+	 *
+	 * Each sample reads the mip whose texels cover the solid angle the sample represents, so the
+	 * estimate (the plain average of the lookups) stays smooth with far fewer samples.
+	 */
+	std::vector<glm::vec4> buildFilteredIrradianceSampleTable(unsigned int numSamples, int envMapSize);
+
+	/**
+	 * @brief GGX half vectors in tangent space for every row of the BRDF LUT (spbrdf.cs).
+	 *
+	 * Row y (roughness y / size) occupies samples [y * numSamples, (y + 1) * numSamples); w is unused.
+	 */
+	std::vector<glm::vec4> buildBRDFSampleTable(int size, unsigned int numSamples);
+}
@@ -0,0 +1,301 @@
+#pragma once
+
+#if defined(__AVX2__) || defined(__F16C__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#if defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+#endif
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+
+// Minimal packed-float abstraction used by the CPU kernels to process several texels per instruction.
+// The instruction set is chosen at compile time: AVX2 (8 lanes), SSE (4 lanes) or a scalar fallback.
+namespace SIMD
+{
+#if defined(__AVX2__)
+	constexpr int Width = 8;
+	constexpr const char* Name = "AVX2";
+
+	struct Mask { __m256 v; };
+
+	struct Float
+	{
+		__m256 v;
+
+		Float() = default;
+		Float(__m256 x) : v(x) {}
+		Float(float x) : v(_mm256_set1_ps(x)) {}
+
+		static Float load(const float* ptr) { return _mm256_loadu_ps(ptr); }
+		static Float loadBytes(const unsigned char* ptr) { return _mm256_cvtepi32_ps(_mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(ptr)))); }
+		void store(float* ptr) const { _mm256_storeu_ps(ptr, v); }
+		static Float iota(float start) { return _mm256_add_ps(_mm256_set1_ps(start), _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7)); }
+	};
+
+	inline Float operator+(Float a, Float b) { return _mm256_add_ps(a.v, b.v); }
+	inline Float operator-(Float a, Float b) { return _mm256_sub_ps(a.v, b.v); }
+	inline Float operator*(Float a, Float b) { return _mm256_mul_ps(a.v, b.v); }
+	inline Float operator/(Float a, Float b) { return _mm256_div_ps(a.v, b.v); }
+	inline Float operator-(Float a) { return _mm256_xor_ps(a.v, _mm256_set1_ps(-0.0f)); }
+	inline Float min(Float a, Float b) { return _mm256_min_ps(a.v, b.v); }
+	inline Float max(Float a, Float b) { return _mm256_max_ps(a.v, b.v); }
+	inline Float abs(Float a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a.v); }
+	inline Float sqrt(Float a) { return _mm256_sqrt_ps(a.v); }
+	inline Float floor(Float a) { return _mm256_floor_ps(a.v); }
+#if defined(__FMA__)
+	inline Float fmadd(Float a, Float b, Float c) { return _mm256_fmadd_ps(a.v, b.v, c.v); }
+#else
+	inline Float fmadd(Float a, Float b, Float c) { return _mm256_add_ps(_mm256_mul_ps(a.v, b.v), c.v); }
+#endif
+
+	inline Mask operator<(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ)}; }
+	inline Mask operator>(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ)}; }
+	inline Mask operator>=(Float a, Float b) { return {_mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ)}; }
+	inline Mask operator&(Mask a, Mask b) { return {_mm256_and_ps(a.v, b.v)}; }
+	inline Mask operator|(Mask a, Mask b) { return {_mm256_or_ps(a.v, b.v)}; }
+	inline Mask andNot(Mask a, Mask b) { return {_mm256_andnot_ps(b.v, a.v)}; }
+	inline bool any(Mask m) { return _mm256_movemask_ps(m.v) != 0; }
+
+	// Per-lane (mask ? a : b).
+	inline Float select(Mask m, Float a, Float b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+
+#elif defined(__SSE2__)
+	constexpr int Width = 4;
+	constexpr const char* Name = "SSE";
+
+	struct Mask { __m128 v; };
+
+	struct Float
+	{
+		__m128 v;
+
+		Float() = default;
+		Float(__m128 x) : v(x) {}
+		Float(float x) : v(_mm_set1_ps(x)) {}
+
+		static Float load(const float* ptr) { return _mm_loadu_ps(ptr); }
+		static Float loadBytes(const unsigned char* ptr)
+		{
+			int32_t word;
+			std::memcpy(&word, ptr, sizeof(word));
+#if defined(__SSE4_1__)
+			return _mm_cvtepi32_ps(_mm_cvtepu8_epi32(_mm_cvtsi32_si128(word)));
+#else
+			const __m128i zero = _mm_setzero_si128();
+			return _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(word), zero), zero));
+#endif
+		}
+		void store(float* ptr) const { _mm_storeu_ps(ptr, v); }
+		static Float iota(float start) { return _mm_add_ps(_mm_set1_ps(start), _mm_setr_ps(0, 1, 2, 3)); }
+	};
+
+	inline Float operator+(Float a, Float b) { return _mm_add_ps(a.v, b.v); }
+	inline Float operator-(Float a, Float b) { return _mm_sub_ps(a.v, b.v); }
+	inline Float operator*(Float a, Float b) { return _mm_mul_ps(a.v, b.v); }
+	inline Float operator/(Float a, Float b) { return _mm_div_ps(a.v, b.v); }
+	inline Float operator-(Float a) { return _mm_xor_ps(a.v, _mm_set1_ps(-0.0f)); }
+	inline Float min(Float a, Float b) { return _mm_min_ps(a.v, b.v); }
+	inline Float max(Float a, Float b) { return _mm_max_ps(a.v, b.v); }
+	inline Float abs(Float a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a.v); }
+	inline Float sqrt(Float a) { return _mm_sqrt_ps(a.v); }
+	inline Float fmadd(Float a, Float b, Float c) { return _mm_add_ps(_mm_mul_ps(a.v, b.v), c.v); }
+
+	inline Mask operator<(Float a, Float b) { return {_mm_cmplt_ps(a.v, b.v)}; }
+	inline Mask operator>(Float a, Float b) { return {_mm_cmpgt_ps(a.v, b.v)}; }
+	inline Mask operator>=(Float a, Float b) { return {_mm_cmpge_ps(a.v, b.v)}; }
+	inline Mask operator&(Mask a, Mask b) { return {_mm_and_ps(a.v, b.v)}; }
+	inline Mask operator|(Mask a, Mask b) { return {_mm_or_ps(a.v, b.v)}; }
+	inline Mask andNot(Mask a, Mask b) { return {_mm_andnot_ps(b.v, a.v)}; }
+	inline bool any(Mask m) { return _mm_movemask_ps(m.v) != 0; }
+
+#if defined(__SSE4_1__)
+	inline Float select(Mask m, Float a, Float b) { return _mm_blendv_ps(b.v, a.v, m.v); }
+	inline Float floor(Float a) { return _mm_floor_ps(a.v); }
+#else
+	inline Float select(Mask m, Float a, Float b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+	inline Float floor(Float a)
+	{
+		const __m128 truncated = _mm_cvtepi32_ps(_mm_cvttps_epi32(a.v));
+		return _mm_sub_ps(truncated, _mm_and_ps(_mm_cmpgt_ps(truncated, a.v), _mm_set1_ps(1.0f)));
+	}
+#endif
+
+#else
+	constexpr int Width = 1;
+	constexpr const char* Name = "Scalar";
+
+	struct Mask { bool v; };
+
+	struct Float
+	{
+		float v;
+
+		Float() = default;
+		Float(float x) : v(x) {}
+
+		static Float load(const float* ptr) { return *ptr; }
+		static Float loadBytes(const unsigned char* ptr) { return float(*ptr); }
+		void store(float* ptr) const { *ptr = v; }
+		static Float iota(float start) { return start; }
+	};
+
+	inline Float operator+(Float a, Float b) { return a.v + b.v; }
+	inline Float operator-(Float a, Float b) { return a.v - b.v; }
+	inline Float operator*(Float a, Float b) { return a.v * b.v; }
+	inline Float operator/(Float a, Float b) { return a.v / b.v; }
+	inline Float operator-(Float a) { return -a.v; }
+	inline Float min(Float a, Float b) { return a.v < b.v ? a.v : b.v; }
+	inline Float max(Float a, Float b) { return a.v > b.v ? a.v : b.v; }
+	inline Float abs(Float a) { return std::fabs(a.v); }
+	inline Float sqrt(Float a) { return std::sqrt(a.v); }
+	inline Float floor(Float a) { return std::floor(a.v); }
+	inline Float fmadd(Float a, Float b, Float c) { return a.v * b.v + c.v; }
+
+	inline Mask operator<(Float a, Float b) { return {a.v < b.v}; }
+	inline Mask operator>(Float a, Float b) { return {a.v > b.v}; }
+	inline Mask operator>=(Float a, Float b) { return {a.v >= b.v}; }
+	inline Mask operator&(Mask a, Mask b) { return {a.v && b.v}; }
+	inline Mask operator|(Mask a, Mask b) { return {a.v || b.v}; }
+	inline Mask andNot(Mask a, Mask b) { return {a.v && !b.v}; }
+	inline bool any(Mask m) { return m.v; }
+	inline Float select(Mask m, Float a, Float b) { return m.v ? a : b; }
+#endif
+
+	// IEEE half float nearest to x (ties to even), built from the float's bits; NaNs stay (quiet) NaNs.
+	inline uint16_t toHalf(float x)
+	{
+		uint32_t bits;
+		std::memcpy(&bits, &x, sizeof(bits));
+		const uint32_t sign = (bits >> 16) & 0x8000u;
+		bits &= 0x7FFFFFFFu;
+
+		uint32_t half;
+		if(bits >= 0x47800000u) {
+			// 2^16 and above: infinity, or NaN.
+			half = bits > 0x7F800000u ? 0x7E00u : 0x7C00u;
+		}
+		else if(bits < 0x38800000u) {
+			// Below 2^-14: adding 0.5 lines the subnormal mantissa up with the float's low bits, and rounds it.
+			float shifted;
+			std::memcpy(&shifted, &bits, sizeof(shifted));
+			shifted += 0.5f;
+			std::memcpy(&half, &shifted, sizeof(half));
+			half -= 0x3F000000u;
+		}
+		else {
+			// Rebias the exponent and round the 13 dropped mantissa bits to even; a carry rounds up the exponent.
+			half = (bits + 0xC8000FFFu + ((bits >> 13) & 1u)) >> 13;
+		}
+		return uint16_t(half | sign);
+	}
+
+#if defined(__SSE2__) && !defined(__F16C__)
+	// toHalf on four lanes with integer operations, for CPUs without F16C; returns the halves in 32-bit lanes.
+	inline __m128i toHalf(__m128 x)
+	{
+		const __m128i bits = _mm_castps_si128(x);
+		const __m128i sign = _mm_srli_epi32(_mm_andnot_si128(_mm_set1_epi32(0x7FFFFFFF), bits), 16);
+		const __m128i magnitude = _mm_and_si128(bits, _mm_set1_epi32(0x7FFFFFFF));
+
+		const __m128i nan = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x7F800000));
+		const __m128i infinite = _mm_or_si128(_mm_set1_epi32(0x7C00), _mm_and_si128(nan, _mm_set1_epi32(0x0200)));
+		const __m128i shifted = _mm_castps_si128(_mm_add_ps(_mm_castsi128_ps(magnitude), _mm_set1_ps(0.5f)));
+		const __m128i subnormal = _mm_sub_epi32(shifted, _mm_set1_epi32(0x3F000000));
+		const __m128i odd = _mm_and_si128(_mm_srli_epi32(magnitude, 13), _mm_set1_epi32(1));
+		const __m128i normal = _mm_srli_epi32(_mm_add_epi32(_mm_add_epi32(magnitude, _mm_set1_epi32(int(0xC8000FFFu))), odd), 13);
+
+		const __m128i isSubnormal = _mm_cmplt_epi32(magnitude, _mm_set1_epi32(0x38800000));
+		const __m128i isInfinite = _mm_cmpgt_epi32(magnitude, _mm_set1_epi32(0x477FFFFF));
+		__m128i half = _mm_or_si128(_mm_and_si128(isSubnormal, subnormal), _mm_andnot_si128(isSubnormal, normal));
+		half = _mm_or_si128(_mm_and_si128(isInfinite, infinite), _mm_andnot_si128(isInfinite, half));
+		return _mm_or_si128(half, sign);
+	}
+
+	// Packs the halves of two toHalf results into eight 16-bit lanes; sign extending them first keeps the
+	// saturating pack exact.
+	inline __m128i packHalves(__m128i low, __m128i high)
+	{
+		return _mm_packs_epi32(_mm_srai_epi32(_mm_slli_epi32(low, 16), 16), _mm_srai_epi32(_mm_slli_epi32(high, 16), 16));
+	}
+#endif
+
+	// Stores Width lanes as half floats, rounded like toHalf: with F16C where the build has it, else with integer SSE.
+	inline void storeHalf(Float a, uint16_t* ptr)
+	{
+#if defined(__AVX2__) && defined(__F16C__)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), _mm256_cvtps_ph(a.v, _MM_FROUND_TO_NEAREST_INT));
+#elif defined(__AVX2__)
+		_mm_storeu_si128(reinterpret_cast<__m128i*>(ptr), packHalves(toHalf(_mm256_castps256_ps128(a.v)), toHalf(_mm256_extractf128_ps(a.v, 1))));
+#elif defined(__SSE2__) && defined(__F16C__)
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(ptr), _mm_cvtps_ph(a.v, _MM_FROUND_TO_NEAREST_INT));
+#elif defined(__SSE2__)
+		_mm_storel_epi64(reinterpret_cast<__m128i*>(ptr), packHalves(toHalf(a.v), _mm_setzero_si128()));
+#else
+		*ptr = toHalf(a.v);
+#endif
+	}
+
+	inline Float& operator+=(Float& a, Float b) { return a = a + b; }
+	inline Float& operator*=(Float& a, Float b) { return a = a * b; }
+
+	// Three-component vector of packed floats (structure of arrays).
+	struct Float3
+	{
+		Float x, y, z;
+	};
+
+	inline Float3 operator+(const Float3& a, const Float3& b) { return {a.x + b.x, a.y + b.y, a.z + b.z}; }
+	inline Float3 operator-(const Float3& a, const Float3& b) { return {a.x - b.x, a.y - b.y, a.z - b.z}; }
+	inline Float3 operator*(const Float3& a, Float s) { return {a.x * s, a.y * s, a.z * s}; }
+	inline Float dot(const Float3& a, const Float3& b) { return fmadd(a.x, b.x, fmadd(a.y, b.y, a.z * b.z)); }
+	inline Float3 cross(const Float3& a, const Float3& b)
+	{
+		return {a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+	}
+	inline Float3 normalize(const Float3& a) { return a * (Float(1.0f) / sqrt(dot(a, a))); }
+	inline Float3 select(Mask m, const Float3& a, const Float3& b) { return {select(m, a.x, b.x), select(m, a.y, b.y), select(m, a.z, b.z)}; }
+
+	// Polynomial approximation of atan2(y, x); the maximum absolute error is below 2e-6 radians.
+	inline Float fastAtan2(Float y, Float x)
+	{
+		const Float ax = abs(x), ay = abs(y);
+		const Float t = min(ax, ay) / max(max(ax, ay), Float(1e-30f));
+		const Float t2 = t * t;
+
+		// Minimax fit of atan(t) on [0, 1].
+		Float p = -0.01172120f;
+		p = fmadd(p, t2, 0.05265332f);
+		p = fmadd(p, t2, -0.11643287f);
+		p = fmadd(p, t2, 0.19354346f);
+		p = fmadd(p, t2, -0.33262347f);
+		p = fmadd(p, t2, 0.99997726f);
+		Float angle = p * t;
+
+		angle = select(ay > ax, Float(1.57079633f) - angle, angle);
+		angle = select(x < Float(0.0f), Float(3.14159265f) - angle, angle);
+		return select(y < Float(0.0f), -angle, angle);
+	}
+
+	// Polynomial approximation of acos(x) for x in [-1, 1] (Abramowitz and Stegun 4.4.46); error below 3e-8 radians.
+	inline Float fastAcos(Float x)
+	{
+		const Float ax = min(abs(x), 1.0f);
+
+		Float p = -0.0012624911f;
+		p = fmadd(p, ax, 0.0066700901f);
+		p = fmadd(p, ax, -0.0170881256f);
+		p = fmadd(p, ax, 0.0308918810f);
+		p = fmadd(p, ax, -0.0501743046f);
+		p = fmadd(p, ax, 0.0889789874f);
+		p = fmadd(p, ax, -0.2145988016f);
+		p = fmadd(p, ax, 1.5707963050f);
+		const Float angle = p * sqrt(Float(1.0f) - ax);
+
+		return select(x < Float(0.0f), Float(3.14159265f) - angle, angle);
+	}
+}
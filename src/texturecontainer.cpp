@@ -0,0 +1,283 @@
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+
+#include "image.hpp"
+#include "texturecontainer.hpp"
+#include "utils.hpp"
+
+namespace
+{
+	const char Magic[8] = {'P', 'B', 'R', 'T', 'E', 'X', '\0', '\0'};
+	constexpr uint32_t Version = 1;
+	constexpr uint64_t DataAlignment = 16;
+	constexpr int MaxLevels = 32;
+
+	struct FileHeader
+	{
+		char magic[8];
+		uint32_t version;
+		uint32_t internalFormat, format, type;
+		uint32_t compression;
+		int32_t width, height, channels, levels;
+		uint32_t reserved0;
+		uint64_t sourceKey;
+		uint64_t reserved1;
+	};
+	static_assert(sizeof(FileHeader) == 64, "Container header layout changed");
+
+	// The GL enums stored in the header; the core library does not include the GL headers.
+	namespace GL
+	{
+		constexpr uint32_t UNSIGNED_BYTE = 0x1401, HALF_FLOAT = 0x140B, FLOAT = 0x1406;
+		constexpr uint32_t RED = 0x1903, RG = 0x8227, RGB = 0x1907, RGBA = 0x1908;
+		constexpr uint32_t R8 = 0x8229, RG8 = 0x822B, RGB8 = 0x8051, RGBA8 = 0x8058, SRGB8 = 0x8C41, SRGB8_ALPHA8 = 0x8C43;
+		constexpr uint32_t COMPRESSED_RED_RGTC1 = 0x8DBB, COMPRESSED_RG_RGTC2 = 0x8DBD;
+		constexpr uint32_t COMPRESSED_RGBA_BPTC_UNORM = 0x8E8C, COMPRESSED_SRGB_ALPHA_BPTC_UNORM = 0x8E8D;
+	}
+
+	// The GL formats the writer stores for a chain; open() accepts no others.
+	TextureContainer::Description describeFormat(BlockCompression::Format compression, int channels, bool srgb)
+	{
+		TextureContainer::Description description;
+		switch(compression) {
+		case BlockCompression::Format::BC4:
+			description.internalFormat = GL::COMPRESSED_RED_RGTC1;
+			return description;
+		case BlockCompression::Format::BC5:
+			description.internalFormat = GL::COMPRESSED_RG_RGTC2;
+			return description;
+		case BlockCompression::Format::BC7:
+			description.internalFormat = srgb ? GL::COMPRESSED_SRGB_ALPHA_BPTC_UNORM : GL::COMPRESSED_RGBA_BPTC_UNORM;
+			return description;
+		default:
+			break;
+		}
+
+		static const uint32_t Formats[] = {GL::RED, GL::RG, GL::RGB, GL::RGBA};
+		static const uint32_t InternalFormats[] = {GL::R8, GL::RG8, GL::RGB8, GL::RGBA8};
+		if(channels < 1 || channels > 4) {
+			throw std::invalid_argument("Unsupported channel count for a texture container");
+		}
+		description.format = Formats[channels - 1];
+		description.type = GL::UNSIGNED_BYTE;
+		description.internalFormat = InternalFormats[channels - 1];
+		if(srgb && channels == 3) {
+			description.internalFormat = GL::SRGB8;
+		}
+		else if(srgb && channels == 4) {
+			description.internalFormat = GL::SRGB8_ALPHA8;
+		}
+		return description;
+	}
+
+	TextureContainer::Description describe(const Mipmaps::MipChain& chain, Mipmaps::Content content)
+	{
+		TextureContainer::Description description = describeFormat(chain.compression, chain.channels, content == Mipmaps::Content::SRGB);
+		description.compression = chain.compression;
+		description.width = chain.width;
+		description.height = chain.height;
+		description.channels = chain.channels;
+		description.levels = int(chain.levels.size());
+		return description;
+	}
+
+	bool isWrittenFormat(const FileHeader& header)
+	{
+		const auto compression = static_cast<BlockCompression::Format>(header.compression);
+		for(bool srgb : {false, true}) {
+			const TextureContainer::Description description = describeFormat(compression, header.channels, srgb);
+			if(header.internalFormat == description.internalFormat && header.format == description.format && header.type == description.type) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	// Bytes a level must have, so a corrupted table is rejected before anything is uploaded.
+	uint64_t expectedLevelSize(const TextureContainer::Description& description, int width, int height)
+	{
+		if(description.compression != BlockCompression::Format::None) {
+			return BlockCompression::compressedSize(description.compression, width, height);
+		}
+		const uint64_t bytesPerChannel = (description.type == GL::FLOAT) ? 4 : (description.type == GL::HALF_FLOAT) ? 2 : 1;
+		return uint64_t(width) * height * description.channels * bytesPerChannel;
+	}
+
+	uint64_t alignUp(uint64_t value)
+	{
+		return (value + DataAlignment - 1) & ~(DataAlignment - 1);
+	}
+
+	uint64_t conversionKey(const std::string& imageFile, int channels, const Mipmaps::Settings& settings)
+	{
+		const FileUtility::MappedFile file{imageFile};
+
+		Utility::Hash64 hash;
+		hash.update(file.data(), file.size());
+		hash.update(Version);
+		hash.update(channels);
+		hash.update(settings.filter);
+		hash.update(settings.content);
+		hash.update(settings.compression);
+		return hash.value();
+	}
+}
+
+bool TextureContainer::isContainer(const std::string& filename)
+{
+	std::ifstream file{filename, std::ios::binary};
+	char magic[sizeof(Magic)];
+	return file.read(magic, sizeof(magic)) && std::memcmp(magic, Magic, sizeof(Magic)) == 0;
+}
+
+std::shared_ptr<TextureContainer> TextureContainer::open(const std::string& filename)
+{
+	auto file = std::make_shared<FileUtility::MappedFile>(filename);
+
+	FileHeader header;
+	if(file->size() < sizeof(header)) {
+		throw std::runtime_error("Not a texture container: " + filename);
+	}
+	std::memcpy(&header, file->data(), sizeof(header));
+	if(std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) {
+		throw std::runtime_error("Not a texture container: " + filename);
+	}
+	if(header.version != Version) {
+		throw std::runtime_error("Unsupported texture container version: " + filename);
+	}
+	if(header.width <= 0 || header.height <= 0 || header.channels < 1 || header.channels > 4 ||
+	   header.levels <= 0 || header.levels > MaxLevels || header.compression > uint32_t(BlockCompression::Format::BC7)) {
+		throw std::runtime_error("Invalid texture container header: " + filename);
+	}
+	if(!isWrittenFormat(header)) {
+		throw std::runtime_error("Unsupported texture container format: " + filename);
+	}
+
+	std::shared_ptr<TextureContainer> container{new TextureContainer};
+	container->m_description.internalFormat = header.internalFormat;
+	container->m_description.format = header.format;
+	container->m_description.type = header.type;
+	container->m_description.compression = static_cast<BlockCompression::Format>(header.compression);
+	container->m_description.width = header.width;
+	container->m_description.height = header.height;
+	container->m_description.channels = header.channels;
+	container->m_description.levels = header.levels;
+	container->m_description.sourceKey = header.sourceKey;
+
+	const uint64_t tableEnd = sizeof(header) + uint64_t(header.levels) * sizeof(Level);
+	if(file->size() < tableEnd) {
+		throw std::runtime_error("Truncated texture container: " + filename);
+	}
+	container->m_levels.resize(header.levels);
+	std::memcpy(container->m_levels.data(), file->data() + sizeof(header), header.levels * sizeof(Level));
+	for(int level=0; level<header.levels; ++level) {
+		const Level& entry = container->m_levels[level];
+		if(entry.offset < tableEnd || entry.offset > file->size() || entry.size > file->size() - entry.offset ||
+		   entry.size != expectedLevelSize(container->m_description, container->levelWidth(level), container->levelHeight(level))) {
+			throw std::runtime_error("Truncated texture container: " + filename);
+		}
+	}
+
+	container->m_data = file->data();
+	container->m_size = file->size();
+	container->m_mapped = file->isMapped();
+	container->m_storage = std::move(file);
+	return container;
+}
+
+std::shared_ptr<TextureContainer> TextureContainer::fromChain(const Mipmaps::MipChain& chain, Mipmaps::Content content, uint64_t sourceKey)
+{
+	std::shared_ptr<TextureContainer> container{new TextureContainer};
+	container->m_description = describe(chain, content);
+	container->m_description.sourceKey = sourceKey;
+
+	// Lay the chain out exactly as it is stored, so writing is a single copy of the buffer.
+	uint64_t offset = alignUp(sizeof(FileHeader) + chain.levels.size() * sizeof(Level));
+	for(const std::vector<unsigned char>& level : chain.levels) {
+		container->m_levels.push_back({offset, level.size()});
+		offset = alignUp(offset + level.size());
+	}
+
+	auto bytes = std::make_shared<std::vector<unsigned char>>(offset);
+	FileHeader header = {};
+	std::memcpy(header.magic, Magic, sizeof(Magic));
+	header.version = Version;
+	header.internalFormat = container->m_description.internalFormat;
+	header.format = container->m_description.format;
+	header.type = container->m_description.type;
+	header.compression = uint32_t(chain.compression);
+	header.width = chain.width;
+	header.height = chain.height;
+	header.channels = chain.channels;
+	header.levels = int32_t(chain.levels.size());
+	header.sourceKey = sourceKey;
+	std::memcpy(bytes->data(), &header, sizeof(header));
+	std::memcpy(bytes->data() + sizeof(header), container->m_levels.data(), container->m_levels.size() * sizeof(Level));
+	for(size_t level=0; level<chain.levels.size(); ++level) {
+		std::memcpy(bytes->data() + container->m_levels[level].offset, chain.levels[level].data(), chain.levels[level].size());
+	}
+
+	container->m_data = bytes->data();
+	container->m_size = bytes->size();
+	container->m_storage = std::move(bytes);
+	return container;
+}
+
+std::string TextureContainer::path(const std::string& imageFile)
+{
+	return imageFile + Extension;
+}
+
+std::shared_ptr<TextureContainer> TextureContainer::loadOrConvert(const std::string& imageFile, int channels, const Mipmaps::Settings& settings)
+{
+	if(isContainer(imageFile)) {
+		return open(imageFile);
+	}
+
+	const uint64_t key = conversionKey(imageFile, channels, settings);
+	const std::string containerFile = path(imageFile);
+	if(std::filesystem::exists(containerFile)) {
+		try {
+			std::shared_ptr<TextureContainer> container = open(containerFile);
+			if(container->description().sourceKey == key) {
+				return container;
+			}
+		}
+		catch(const std::exception& e) {
+			std::fprintf(stderr, "Ignoring invalid texture container: %s\n", e.what());
+		}
+	}
+
+	Mipmaps::MipChain chain = Mipmaps::generate(*Image::fromFile(imageFile, channels), settings);
+	if(settings.compression != BlockCompression::Format::None) {
+		chain = Mipmaps::compress(chain, settings.compression, imageFile);
+	}
+	std::shared_ptr<TextureContainer> container = fromChain(chain, settings.content, key);
+	try {
+		container->write(containerFile);
+		std::printf("Stored texture container: %s\n", containerFile.c_str());
+	}
+	catch(const std::exception& e) {
+		std::fprintf(stderr, "Warning: %s\n", e.what());
+	}
+	return container;
+}
+
+void TextureContainer::write(const std::string& filename) const
+{
+	const std::string temporaryFilename = filename + ".tmp";
+	{
+		std::ofstream file{temporaryFilename, std::ios::binary | std::ios::trunc};
+		if(!file.is_open()) {
+			throw std::runtime_error("Could not open file for writing: " + temporaryFilename);
+		}
+		file.write(reinterpret_cast<const char*>(m_data), std::streamsize(m_size));
+		if(!file) {
+			throw std::runtime_error("Failed to write texture container: " + temporaryFilename);
+		}
+	}
+	std::filesystem::rename(temporaryFilename, filename);
+}
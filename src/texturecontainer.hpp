@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mipmaps.hpp"
+
+/**
+ * @brief GPU-ready texture file (.ptex): a header with the GL formats, a table of per-level offsets and the
+ * level data exactly as glTextureSubImage2D / glCompressedTextureSubImage2D consume it.
+ *
+ * Opening a container maps the file and hands out pointers into the mapping, so loading it is a page-in
+ * followed by one upload per level with no decoding, filtering, encoding or copying.
+ *
+ * Layout (little endian): a 64-byte header, one {offset, size} pair of uint64 per level, then the level
+ * data, level 0 first, each level starting at a multiple of 16 bytes.
+ */
+class TextureContainer
+{
+public:
+	static constexpr const char* Extension = ".ptex";
+
+	struct Description
+	{
+		uint32_t internalFormat = 0;  // GL internal format of the storage.
+		uint32_t format = 0;          // GL pixel format of the data; 0 for compressed formats.
+		uint32_t type = 0;            // GL pixel type of the data; 0 for compressed formats.
+		BlockCompression::Format compression = BlockCompression::Format::None;
+		int width = 0, height = 0, channels = 0;
+		int levels = 0;
+		uint64_t sourceKey = 0;       // Identifies the source and settings the data was converted from.
+	};
+
+	/**
+	 * @brief Checks the magic number, so containers are recognized independent of their file extension.
+	 */
+	static bool isContainer(const std::string& filename);
+
+	/**
+	 * @brief Maps a container file; throws if it is not a valid container.
+	 */
+	static std::shared_ptr<TextureContainer> open(const std::string& filename);
+
+	/**
+	 * @brief Wraps a mip chain in memory; the GL formats follow from its channels, compression and content.
+	 */
+	static std::shared_ptr<TextureContainer> fromChain(const Mipmaps::MipChain& chain, Mipmaps::Content content, uint64_t sourceKey = 0);
+
+	/**
+	 * @brief File an image is converted to, next to the image itself.
+	 */
+	static std::string path(const std::string& imageFile);
+
+	/**
+	 * @brief Returns the texture for an image file. A container is opened as it is. For other images, <image>.ptex
+	 * is opened if it was converted from the current contents of the image with the same channel count and
+	 * settings; otherwise the image is decoded, its mip chain generated (and compressed), and the container written.
+	 */
+	static std::shared_ptr<TextureContainer> loadOrConvert(const std::string& imageFile, int channels, const Mipmaps::Settings& settings);
+
+	/**
+	 * @brief Writes the container, replacing the file atomically so readers never see partial data.
+	 */
+	void write(const std::string& filename) const;
+
+	const Description& description() const { return m_description; }
+	bool isCompressed() const { return m_description.compression != BlockCompression::Format::None; }
+
+	int levelWidth(int level) const { return m_description.width >> level > 0 ? m_description.width >> level : 1; }
+	int levelHeight(int level) const { return m_description.height >> level > 0 ? m_description.height >> level : 1; }
+	const unsigned char* levelData(int level) const { return m_data + m_levels[level].offset; }
+	size_t levelSize(int level) const { return size_t(m_levels[level].size); }
+
+	// Bytes of the whole container, header included.
+	size_t size() const { return m_size; }
+	bool isMapped() const { return m_mapped; }
+
+private:
+	struct Level
+	{
+		uint64_t offset;
+		uint64_t size;
+	};
+
+	TextureContainer() = default;
+
+	Description m_description;
+	std::vector<Level> m_levels;
+	const unsigned char* m_data = nullptr;
+	size_t m_size = 0;
+	std::shared_ptr<const void> m_storage;
+	bool m_mapped = false;
+};
@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+#include "threading.hpp"
+
+ThreadPool& ThreadPool::instance()
+{
+	static ThreadPool pool{std::max(std::thread::hardware_concurrency(), 1u) - 1};
+	return pool;
+}
+
+ThreadPool::ThreadPool(unsigned int numThreads)
+{
+	m_workers.reserve(numThreads);
+	for(unsigned int i=0; i<numThreads; ++i) {
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock{m_mutex};
+		m_stopping = true;
+	}
+	m_condition.notify_all();
+	for(std::thread& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::enqueue(std::function<void()> task)
+{
+	{
+		std::lock_guard<std::mutex> lock{m_mutex};
+		m_tasks.push_back(std::move(task));
+	}
+	m_condition.notify_one();
+}
+
+void ThreadPool::workerLoop()
+{
+	for(;;) {
+		std::function<void()> task;
+		{
+			std::unique_lock<std::mutex> lock{m_mutex};
+			m_condition.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+			if(m_stopping && m_tasks.empty()) {
+				return;
+			}
+			task = std::move(m_tasks.front());
+			m_tasks.pop_front();
+		}
+		task();
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& func)
+{
+	if(count == 0) {
+		return;
+	}
+	if(count == 1 || m_workers.empty()) {
+		for(size_t i=0; i<count; ++i) {
+			func(i);
+		}
+		return;
+	}
+
+	// Shared between the caller and the helper tasks; helpers that start after
+	// the caller returned find no remaining indices and exit without touching func.
+	struct State
+	{
+		std::atomic<size_t> next{0};
+		std::atomic<size_t> completed{0};
+		std::mutex mutex;
+		std::condition_variable done;
+		std::exception_ptr error;
+	};
+	auto state = std::make_shared<State>();
+
+	auto runner = [state, count, &func]() {
+		for(size_t i = state->next++; i < count; i = state->next++) {
+			try {
+				func(i);
+			}
+			catch(...) {
+				std::lock_guard<std::mutex> lock{state->mutex};
+				if(!state->error) {
+					state->error = std::current_exception();
+				}
+			}
+			if(++state->completed == count) {
+				std::lock_guard<std::mutex> lock{state->mutex};
+				state->done.notify_all();
+			}
+		}
+	};
+
+	const size_t numHelpers = std::min(count - 1, m_workers.size());
+	for(size_t i=0; i<numHelpers; ++i) {
+		enqueue(runner);
+	}
+	runner();
+
+	std::unique_lock<std::mutex> lock{state->mutex};
+	state->done.wait(lock, [&]() { return state->completed == count; });
+	if(state->error) {
+		std::rethrow_exception(state->error);
+	}
+}
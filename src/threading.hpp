@@ -0,0 +1,72 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Fixed-size pool of worker threads shared by the CPU-side processing code.
+ */
+class ThreadPool
+{
+public:
+	/**
+	 * @brief Returns the process-wide pool sized to the number of hardware threads.
+	 */
+	static ThreadPool& instance();
+
+	explicit ThreadPool(unsigned int numThreads);
+	~ThreadPool();
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	/**
+	 * @brief Number of threads that can run work, including the calling thread.
+	 */
+	unsigned int concurrency() const { return static_cast<unsigned int>(m_workers.size()) + 1; }
+
+	/**
+	 * @brief Runs func(i) for every i in [0, count) and blocks until all calls returned.
+	 *
+	 * The calling thread takes part in the work, so parallelFor may be nested
+	 * inside tasks that already run on the pool.
+	 */
+	void parallelFor(size_t count, const std::function<void(size_t)>& func);
+
+	/**
+	 * @brief Queues func() for a worker thread and returns a future for its result.
+	 *
+	 * Without worker threads func() runs on the calling thread before submit returns.
+	 */
+	template<typename Func>
+	auto submit(Func func) -> std::future<decltype(func())>
+	{
+		using Result = decltype(func());
+		auto task = std::make_shared<std::packaged_task<Result()>>(std::move(func));
+		std::future<Result> result = task->get_future();
+		if(m_workers.empty()) {
+			(*task)();
+		}
+		else {
+			enqueue([task]() { (*task)(); });
+		}
+		return result;
+	}
+
+private:
+	void enqueue(std::function<void()> task);
+	void workerLoop();
+
+	std::vector<std::thread> m_workers;
+	std::deque<std::function<void()>> m_tasks;
+	std::mutex m_mutex;
+	std::condition_variable m_condition;
+	bool m_stopping = false;
+};
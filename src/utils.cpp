@@ -1,7 +1,20 @@
 #include "utils.hpp"
+#include <cstdio>
 #include <fstream>
 #include <sstream>
 #include <memory>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 std::string FileUtility::readText(const std::string& filename)
 {
@@ -28,4 +41,82 @@ std::vector<char> FileUtility::readBinary(const std::string& filename)
 	std::vector<char> buffer(size);
 	file.read(buffer.data(), size);
 	return buffer;
-}
\ No newline at end of file
+}
+
+FileUtility::MappedFile::MappedFile(const std::string& filename)
+{
+#ifdef _WIN32
+	m_file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(m_file == INVALID_HANDLE_VALUE) {
+		m_file = nullptr;
+		throw std::runtime_error("Could not open file: " + filename);
+	}
+	LARGE_INTEGER size;
+	if(GetFileSizeEx(m_file, &size) && size.QuadPart > 0) {
+		m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if(m_mapping) {
+			m_data = static_cast<const unsigned char*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+			m_size = size_t(size.QuadPart);
+			m_mapped = m_data != nullptr;
+		}
+	}
+#else
+	const int fd = open(filename.c_str(), O_RDONLY);
+	if(fd < 0) {
+		throw std::runtime_error("Could not open file: " + filename);
+	}
+	struct stat status;
+	if(fstat(fd, &status) == 0 && status.st_size > 0) {
+		void* address = mmap(nullptr, size_t(status.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if(address != MAP_FAILED) {
+			madvise(address, size_t(status.st_size), MADV_SEQUENTIAL);
+			m_data = static_cast<const unsigned char*>(address);
+			m_size = size_t(status.st_size);
+			m_mapped = true;
+		}
+	}
+	close(fd);
+#endif
+
+	if(!m_mapped) {
+		m_buffer = readBinary(filename);
+		m_data = reinterpret_cast<const unsigned char*>(m_buffer.data());
+		m_size = m_buffer.size();
+	}
+}
+
+FileUtility::MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+	if(m_mapped) {
+		UnmapViewOfFile(m_data);
+	}
+	if(m_mapping) {
+		CloseHandle(m_mapping);
+	}
+	if(m_file) {
+		CloseHandle(m_file);
+	}
+#else
+	if(m_mapped) {
+		munmap(const_cast<unsigned char*>(m_data), m_size);
+	}
+#endif
+}
+
+void Utility::Hash64::update(const void* data, size_t size)
+{
+	const unsigned char* bytes = static_cast<const unsigned char*>(data);
+	uint64_t state = m_state;
+	for(size_t i=0; i<size; ++i) {
+		state = (state ^ bytes[i]) * 0x100000001b3ull;
+	}
+	m_state = state;
+}
+
+std::string Utility::toHex(uint64_t value)
+{
+	char buffer[17];
+	std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+	return buffer;
+}
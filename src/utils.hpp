@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <string>
 #include <vector>
 #include <type_traits>
@@ -22,6 +24,37 @@ namespace FileUtility
 	 * @return Contents of the file as bytes.
 	 */
 	std::vector<char> readBinary(const std::string& filename);
+
+	/**
+	 * @brief Read-only memory mapping of a whole file.
+	 *
+	 * Pages are read on first access straight from the page cache, so decoders can work on the
+	 * file contents without stdio buffering or an intermediate heap copy. Where mapping is not
+	 * possible the file is read into memory instead.
+	 */
+	class MappedFile
+	{
+	public:
+		explicit MappedFile(const std::string& filename);
+		~MappedFile();
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		const unsigned char* data() const { return m_data; }
+		size_t size() const { return m_size; }
+		bool isMapped() const { return m_mapped; }
+
+	private:
+		const unsigned char* m_data = nullptr;
+		size_t m_size = 0;
+		bool m_mapped = false;
+		std::vector<char> m_buffer;  // Contents when the file could not be mapped.
+#ifdef _WIN32
+		void* m_file = nullptr;
+		void* m_mapping = nullptr;
+#endif
+	};
 };
 
 // General utility functions
@@ -72,4 +105,31 @@ namespace Utility
 		return levels;
 	}
 
+	/**
+	 * @brief Incremental 64-bit FNV-1a hash, used to build content-addressed cache keys.
+	 */
+	class Hash64
+	{
+	public:
+		void update(const void* data, size_t size);
+		void update(const std::string& text) { update(text.data(), text.size()); }
+
+		template<typename T>
+		void update(const T& value)
+		{
+			static_assert(std::is_trivially_copyable<T>::value, "Type must be trivially copyable.");
+			update(&value, sizeof(T));
+		}
+
+		uint64_t value() const { return m_state; }
+
+	private:
+		uint64_t m_state = 0xcbf29ce484222325ull;
+	};
+
+	/**
+	 * @brief Formats a 64-bit value as 16 hexadecimal digits.
+	 */
+	std::string toHex(uint64_t value);
+
 };
@@ -0,0 +1,62 @@
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <glm/gtc/packing.hpp>
+
+#include "ibl.hpp"
+
+// Build-time generator for the split-sum BRDF LUT.
+// The LUT does not depend on the scene, so it is integrated once here (same kernel as spbrdf.cs) and
+// written as a C++ array of packed RG16F texels that Renderer::setup() uploads without any compute pass.
+
+int main(int argc, char* argv[])
+{
+	if(argc < 2 || argc > 4) {
+		std::printf("Usage: PBR-BRDF-LUT <output.inc> [size (default 256)] [samples (default 1024)]\n");
+		return 1;
+	}
+
+	try {
+		const std::string outputFile = argv[1];
+		const int size = argc > 2 ? std::stoi(argv[2]) : 256;
+
+		IBL::KernelSettings settings;
+		if(argc > 3) {
+			settings.brdfSamples = std::stoul(argv[3]);
+		}
+
+		const std::vector<glm::vec2> lut = IBL::integrateBRDF(size, settings);
+
+		std::ofstream file{outputFile};
+		if(!file.is_open()) {
+			throw std::runtime_error("Could not open file for writing: " + outputFile);
+		}
+
+		file << "// Generated by PBR-BRDF-LUT (tools/brdflut.cpp); do not edit.\n";
+		file << "// " << size << "x" << size << " split-sum BRDF LUT, " << settings.brdfSamples << " GGX samples per texel.\n";
+		file << "// One packHalf2x16 (scale, bias) pair per texel: upload as GL_RG / GL_HALF_FLOAT.\n";
+		file << "constexpr int kEmbeddedBRDF_LUT_Size = " << size << ";\n";
+		file << "const uint32_t kEmbeddedBRDF_LUT[" << lut.size() << "] = {\n";
+		for(size_t i=0; i<lut.size(); ++i) {
+			char value[16];
+			std::snprintf(value, sizeof(value), "0x%08x,", glm::packHalf2x16(lut[i]));
+			file << ((i % 8) == 0 ? "\t" : " ") << value << ((i % 8) == 7 ? "\n" : "");
+		}
+		if(lut.size() % 8 != 0) {
+			file << "\n";
+		}
+		file << "};\n";
+
+		if(!file) {
+			throw std::runtime_error("Failed to write file: " + outputFile);
+		}
+	}
+	catch(const std::exception& e) {
+		std::fprintf(stderr, "Error: %s\n", e.what());
+		return 1;
+	}
+}
@@ -0,0 +1,416 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stb_image.h>
+
+#include "ibl.hpp"
+#include "image.hpp"
+#include "simd.hpp"
+#include "threading.hpp"
+#include "utils.hpp"
+
+// Standalone CPU baker for the image-based lighting resources produced by Renderer::setup().
+// Writes the pre-filtered specular map, irradiance map and BRDF LUT as Radiance HDR files using the
+// same naming as PBR-IBL --dump-ibl, so GPU and CPU results can be compared with --compare.
+
+namespace
+{
+	struct Options
+	{
+		std::string inputFile;
+		std::string outputDirectory;
+		std::string compareDirectory;
+		std::string facesDirectory;
+		int envMapSize = 1024;
+		int irradianceMapSize = 32;
+		int brdfLUTSize = 256;
+		bool benchmark = false;
+		bool irradianceSH = false;
+		bool irradianceBenchmark = false;
+		bool decodeBenchmark = false;
+		IBL::KernelSettings kernels;
+	};
+
+	void printUsage()
+	{
+		std::printf(
+			"Usage: PBR-IBL-Bake [options] <environment> <output directory>\n"
+			"The environment is an equirectangular or cross layout .hdr image, or a directory of cube faces\n"
+			"(posx, negx, posy, negy, posz, negz .hdr).\n"
+			"Options:\n"
+			"  --env-size <n>             Environment cube map size (default 1024)\n"
+			"  --irradiance-size <n>      Irradiance cube map size (default 32)\n"
+			"  --brdf-size <n>            BRDF LUT size (default 256)\n"
+			"  --specular-samples <n>     GGX samples per pre-filtered texel, reduced on rough levels (default 1024)\n"
+			"  --irradiance-samples <n>   Hemisphere samples per irradiance texel (default 65536)\n"
+			"  --brdf-samples <n>         GGX samples per BRDF LUT texel (default 1024)\n"
+			"  --filtered-irradiance      Filtered importance sampling for irmap (cosine-weighted, coarser mips)\n"
+			"  --irradiance-sh            Also project irradiance onto SH and report its error against irmap\n"
+			"  --irradiance-benchmark     Report irmap error versus time for uniform and filtered sampling\n"
+			"  --benchmark                Only report kernel throughput, do not write outputs\n"
+			"  --decode-benchmark         Only compare the RGBE decoder with stb_image on the environment file\n"
+			"  --compare <directory>      Compare results against shader output dumped by PBR-IBL --dump-ibl\n"
+			"  --faces <directory>        Only convert the environment to cube faces loadable by PBR-IBL --environment\n");
+	}
+
+	Options parseOptions(int argc, char* argv[])
+	{
+		Options options;
+		std::vector<std::string> positional;
+		for(int i=1; i<argc; ++i) {
+			const std::string arg = argv[i];
+			auto value = [&]() -> std::string {
+				if(i + 1 >= argc) {
+					throw std::runtime_error("Missing value for option: " + arg);
+				}
+				return argv[++i];
+			};
+
+			if(arg == "--env-size")                options.envMapSize = std::stoi(value());
+			else if(arg == "--irradiance-size")    options.irradianceMapSize = std::stoi(value());
+			else if(arg == "--brdf-size")          options.brdfLUTSize = std::stoi(value());
+			else if(arg == "--specular-samples")   options.kernels.specularSamples = std::stoul(value());
+			else if(arg == "--irradiance-samples") options.kernels.irradianceSamples = std::stoul(value());
+			else if(arg == "--brdf-samples")       options.kernels.brdfSamples = std::stoul(value());
+			else if(arg == "--filtered-irradiance") options.kernels.filteredIrradiance = true;
+			else if(arg == "--irradiance-sh")      options.irradianceSH = true;
+			else if(arg == "--irradiance-benchmark") options.irradianceBenchmark = true;
+			else if(arg == "--benchmark")          options.benchmark = true;
+			else if(arg == "--decode-benchmark")   options.decodeBenchmark = true;
+			else if(arg == "--compare")            options.compareDirectory = value();
+			else if(arg == "--faces")              options.facesDirectory = value();
+			else if(arg.compare(0, 2, "--") == 0) {
+				throw std::runtime_error("Unknown option: " + arg);
+			}
+			else {
+				positional.push_back(arg);
+			}
+		}
+
+		const size_t required = (options.benchmark || options.decodeBenchmark || !options.facesDirectory.empty()) ? 1 : 2;
+		if(positional.size() < required || positional.size() > 2) {
+			printUsage();
+			std::exit(1);
+		}
+		options.inputFile = positional[0];
+		if(positional.size() > 1 && !options.benchmark && !options.decodeBenchmark) {
+			options.outputDirectory = positional[1];
+		}
+		return options;
+	}
+
+	// Runs a kernel once and reports its throughput in output texels per second.
+	template<typename Func>
+	auto measure(const char* name, size_t numTexels, Func&& func)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		auto result = func();
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		std::printf("%-28s %10zu texels %10.3f s %14.0f texels/s\n", name, numTexels, seconds, double(numTexels) / seconds);
+		return result;
+	}
+
+	// Decodes a Radiance file with stb_image and with RGBEDecoder in every output format, reporting throughput
+	// in megapixels per second and the largest pixel buffer each one holds.
+	void benchmarkDecoding(const std::string& filename)
+	{
+		const FileUtility::MappedFile file{filename};
+		if(!RGBEDecoder::isRGBE(file.data(), file.size())) {
+			throw std::runtime_error("Not a Radiance RGBE file: " + filename);
+		}
+
+		auto run = [](size_t peakBytes, auto&& func) {
+			const auto start = std::chrono::steady_clock::now();
+			func();
+			const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			return std::make_pair(seconds, peakBytes);
+		};
+		auto report = [](const char* name, size_t numPixels, std::pair<double, size_t> result) {
+			std::printf("%-34s %9.3f s %9.1f Mpixels/s %10.2f MB peak\n", name, result.first, numPixels / result.first * 1e-6,
+						result.second / 1048576.0);
+		};
+
+		int width = 0, height = 0, channels = 0;
+		float* reference = nullptr;
+		const auto stbResult = run(0, [&]() {
+			reference = stbi_loadf_from_memory(file.data(), int(file.size()), &width, &height, &channels, 3);
+		});
+		if(!reference) {
+			throw std::runtime_error(std::string("stb_image failed: ") + stbi_failure_reason());
+		}
+		const size_t numPixels = size_t(width) * height;
+		std::printf("RGBE decoding of %s (%dx%d, %.2f MB, %u threads)\n", filename.c_str(), width, height, file.size() / 1048576.0,
+					ThreadPool::instance().concurrency());
+		report("stbi_loadf (float)", numPixels, {stbResult.first, numPixels * 3 * sizeof(float)});
+
+		std::vector<unsigned char> pixels(numPixels * RGBEDecoder::bytesPerPixel(RGBEDecoder::Format::Float, 3));
+		const auto indexResult = run(0, [&]() { RGBEDecoder{file.data(), file.size()}; });
+		report("RGBEDecoder scanline index", numPixels, {indexResult.first, (size_t(height) + 1) * sizeof(size_t)});
+
+		const RGBEDecoder decoder{file.data(), file.size()};
+		report("RGBEDecoder float, 1 thread", numPixels, run(pixels.size(), [&]() {
+			decoder.decodeRows(0, height, RGBEDecoder::Format::Float, 3, pixels.data());
+		}));
+		const bool identical = std::memcmp(pixels.data(), reference, pixels.size()) == 0;
+		stbi_image_free(reference);
+
+		const std::pair<RGBEDecoder::Format, const char*> formats[] = {
+			{RGBEDecoder::Format::Float, "RGBEDecoder float"},
+			{RGBEDecoder::Format::Half, "RGBEDecoder half"},
+			{RGBEDecoder::Format::RGB9E5, "RGBEDecoder RGB9E5"},
+		};
+		for(const auto& format : formats) {
+			const size_t bytes = numPixels * RGBEDecoder::bytesPerPixel(format.first, 3);
+			report(format.second, numPixels, run(bytes, [&]() { decoder.decode(format.first, 3, pixels.data()); }));
+		}
+
+		// Streaming keeps a few scanlines per thread; the sink only touches the rows, as an upload would.
+		constexpr int StreamRows = 8;
+		const size_t streamBytes = size_t(ThreadPool::instance().concurrency()) * StreamRows * width * RGBEDecoder::bytesPerPixel(RGBEDecoder::Format::Half, 3);
+		volatile unsigned char checksum = 0;
+		report("RGBEDecoder half, streamed", numPixels, run(streamBytes, [&]() {
+			decoder.stream(RGBEDecoder::Format::Half, 3, StreamRows, [&](int, int, const void* rows) {
+				checksum = checksum ^ *static_cast<const unsigned char*>(rows);
+			});
+		}));
+		std::printf("Float output %s stbi_loadf\n", identical ? "is bit-identical to" : "DIFFERS from");
+	}
+
+	std::vector<float> toRGB(const glm::vec4* texels, size_t count)
+	{
+		std::vector<float> rgb(count * 3);
+		for(size_t i=0; i<count; ++i) {
+			rgb[i*3 + 0] = texels[i].r;
+			rgb[i*3 + 1] = texels[i].g;
+			rgb[i*3 + 2] = texels[i].b;
+		}
+		return rgb;
+	}
+
+	std::vector<float> toRGB(const std::vector<glm::vec2>& texels)
+	{
+		std::vector<float> rgb(texels.size() * 3);
+		for(size_t i=0; i<texels.size(); ++i) {
+			rgb[i*3 + 0] = texels[i].x;
+			rgb[i*3 + 1] = texels[i].y;
+			rgb[i*3 + 2] = 0.0f;
+		}
+		return rgb;
+	}
+
+	std::string faceFilename(const std::string& directory, const std::string& name, int level, int face)
+	{
+		return directory + "/" + name + "_" + std::to_string(level) + "_" + std::to_string(face) + ".hdr";
+	}
+
+	void writeCubemap(const IBL::Cubemap& cubemap, const std::string& directory, const std::string& name)
+	{
+		for(int level=0; level<cubemap.levels; ++level) {
+			const int size = cubemap.levelSize(level);
+			for(int face=0; face<6; ++face) {
+				const std::vector<float> rgb = toRGB(cubemap.face(level, face), size_t(size) * size);
+				Image::writeHDR(faceFilename(directory, name, level, face), size, size, 3, rgb.data());
+			}
+		}
+	}
+
+	void reportComparison(const std::string& name, const std::vector<float>& computed, const std::string& referenceFile)
+	{
+		const std::shared_ptr<Image> reference = Image::fromFile(referenceFile, 3);
+		if(size_t(reference->width()) * reference->height() * 3 != computed.size()) {
+			throw std::runtime_error("Reference size mismatch: " + referenceFile);
+		}
+		const IBL::ErrorStats stats = IBL::compare(computed.data(), reference->pixels<float>(), computed.size());
+		std::printf("  %-20s max abs %.6f  rmse %.6f  relative rmse %.4f%%\n", name.c_str(), stats.maxAbsolute, stats.rmse, 100.0 * stats.relativeRMSE);
+	}
+
+	// Reference irradiance (scaled by 1/pi like irmap.cs) integrated over every texel of one level of the
+	// environment, weighted by its exact solid angle: free of sampling noise for a cosine lobe.
+	IBL::Cubemap integrateIrradiance(const IBL::Cubemap& envMap, int level, int size)
+	{
+		const int sourceSize = envMap.levelSize(level);
+		const float invSourceSize = 1.0f / float(sourceSize);
+
+		std::vector<glm::vec4> texels;  // xyz = direction, w = solid angle
+		std::vector<glm::vec3> radiance;
+		for(int face=0; face<6; ++face) {
+			const glm::vec4* row = envMap.face(level, face);
+			for(int y=0; y<sourceSize; ++y) {
+				for(int x=0; x<sourceSize; ++x) {
+					const float u = 2.0f * (float(x) + 0.5f) * invSourceSize - 1.0f;
+					const float v = 2.0f * (float(y) + 0.5f) * invSourceSize - 1.0f;
+					const float d = 1.0f + u*u + v*v;
+					glm::vec3 direction{0.0f};
+					switch(face) {
+					case 0: direction = {1.0f, -v, -u}; break;
+					case 1: direction = {-1.0f, -v, u}; break;
+					case 2: direction = {u, 1.0f, v}; break;
+					case 3: direction = {u, -1.0f, -v}; break;
+					case 4: direction = {u, -v, 1.0f}; break;
+					case 5: direction = {-u, -v, -1.0f}; break;
+					}
+					texels.push_back({glm::normalize(direction), 4.0f * invSourceSize * invSourceSize / (d * std::sqrt(d))});
+					radiance.push_back(glm::vec3{row[y * sourceSize + x]});
+				}
+			}
+		}
+
+		IBL::Cubemap result{size, 1};
+		ThreadPool::instance().parallelFor(size_t(6 * size), [&](size_t index) {
+			const int face = int(index) / size;
+			const int y = int(index) % size;
+			for(int x=0; x<size; ++x) {
+				const glm::vec3 normal = IBL::texelDirection(face, x, y, size);
+				glm::vec3 sum{0.0f};
+				for(size_t i=0; i<texels.size(); ++i) {
+					const float cosTheta = glm::dot(normal, glm::vec3{texels[i]});
+					if(cosTheta > 0.0f) {
+						sum += radiance[i] * (cosTheta * texels[i].w);
+					}
+				}
+				result.face(0, face)[y * size + x] = glm::vec4{sum / 3.141592654f, 1.0f};
+			}
+		});
+		return result;
+	}
+
+	// Times the irradiance convolution over a range of sample counts with uniform and filtered importance
+	// sampling and reports the error of each against the noise-free reference.
+	void benchmarkIrradiance(const IBL::Cubemap& envMap, int size, IBL::KernelSettings kernels)
+	{
+		const int level = std::max(0, envMap.levels - 7);
+		const IBL::Cubemap reference = integrateIrradiance(envMap, level, size);
+		const std::vector<float> referenceRGB = toRGB(reference.mips[0].data(), reference.mips[0].size());
+
+		std::printf("Irradiance error versus time (reference: all texels of the %dx%d level):\n", envMap.levelSize(level), envMap.levelSize(level));
+		std::printf("  %-9s %8s %12s %12s %14s\n", "sampling", "samples", "time (ms)", "max abs", "relative rmse");
+		for(bool filtered : {false, true}) {
+			for(unsigned int samples=64; samples<=64*1024; samples*=4) {
+				kernels.irradianceSamples = samples;
+				kernels.filteredIrradiance = filtered;
+
+				const auto start = std::chrono::steady_clock::now();
+				const IBL::Cubemap irradianceMap = IBL::convolveIrradiance(envMap, size, kernels);
+				const double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+				const std::vector<float> rgb = toRGB(irradianceMap.mips[0].data(), irradianceMap.mips[0].size());
+				const IBL::ErrorStats stats = IBL::compare(rgb.data(), referenceRGB.data(), rgb.size());
+				std::printf("  %-9s %8u %12.2f %12.6f %13.4f%%\n", filtered ? "filtered" : "uniform", samples, milliseconds, stats.maxAbsolute, 100.0 * stats.relativeRMSE);
+			}
+		}
+	}
+
+	void compareCubemap(const IBL::Cubemap& cubemap, const std::string& directory, const std::string& name)
+	{
+		for(int level=0; level<cubemap.levels; ++level) {
+			const int size = cubemap.levelSize(level);
+			for(int face=0; face<6; ++face) {
+				const std::vector<float> rgb = toRGB(cubemap.face(level, face), size_t(size) * size);
+				const std::string label = name + " " + std::to_string(level) + "/" + std::to_string(face);
+				reportComparison(label, rgb, faceFilename(directory, name, level, face));
+			}
+		}
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try {
+		const Options options = parseOptions(argc, argv);
+		if(options.decodeBenchmark) {
+			benchmarkDecoding(options.inputFile);
+			return 0;
+		}
+
+		std::printf("IBL - CPU bake [%s, %d lanes, %u threads]\n", SIMD::Name, SIMD::Width, ThreadPool::instance().concurrency());
+
+		IBL::EnvironmentSource source = IBL::loadEnvironment(options.inputFile);
+
+		// Cube map inputs are used at their own resolution.
+		const int envMapSize = source.equirect ? options.envMapSize : source.cubemap.size;
+		size_t envTexels = 0;
+		for(int size=envMapSize; size>=1; size/=2) {
+			envTexels += 6 * size_t(size) * size;
+		}
+		const size_t specularTexels = envTexels - 6 * size_t(envMapSize) * envMapSize;
+
+		const IBL::Cubemap envMap = measure(source.equirect ? "equirect2cube + mipmaps" : "cube faces + mipmaps", envTexels, [&]() {
+			if(source.equirect) {
+				return IBL::equirectToCubemap(*source.equirect, envMapSize);
+			}
+			IBL::Cubemap cubemap{envMapSize, int(std::log2(envMapSize)) + 1};
+			cubemap.mips[0] = std::move(source.cubemap.mips[0]);
+			cubemap.generateMipmaps();
+			return cubemap;
+		});
+
+		if(!options.facesDirectory.empty()) {
+			IBL::writeCubemapFaces(envMap, options.facesDirectory);
+			std::printf("Wrote cube faces to: %s\n", options.facesDirectory.c_str());
+			return 0;
+		}
+
+		const IBL::Cubemap specularMap = measure("spmap (specular prefilter)", specularTexels, [&]() {
+			return IBL::prefilterSpecular(envMap, options.kernels);
+		});
+		const IBL::Cubemap irradianceMap = measure("irmap (irradiance)", 6 * size_t(options.irradianceMapSize) * options.irradianceMapSize, [&]() {
+			return IBL::convolveIrradiance(envMap, options.irradianceMapSize, options.kernels);
+		});
+		const std::vector<glm::vec2> brdfLUT = measure("spbrdf (BRDF LUT)", size_t(options.brdfLUTSize) * options.brdfLUTSize, [&]() {
+			return IBL::integrateBRDF(options.brdfLUTSize, options.kernels);
+		});
+
+		if(options.irradianceBenchmark) {
+			benchmarkIrradiance(envMap, options.irradianceMapSize, options.kernels);
+		}
+
+		if(options.irradianceSH) {
+			// Projection runs on a fixed-size mip so its cost does not depend on the input resolution.
+			const int level = std::max(0, envMap.levels - 7);
+			const int size = envMap.levelSize(level);
+			const IBL::IrradianceSH sh = measure("irradiance SH projection", 6 * size_t(size) * size, [&]() {
+				return IBL::projectIrradianceSH(envMap, level);
+			});
+
+			std::vector<float> evaluated, reference;
+			for(int face=0; face<6; ++face) {
+				const glm::vec4* texels = irradianceMap.face(0, face);
+				for(int y=0; y<irradianceMap.size; ++y) {
+					for(int x=0; x<irradianceMap.size; ++x) {
+						const glm::vec3 value = IBL::evaluateIrradianceSH(sh, IBL::texelDirection(face, x, y, irradianceMap.size));
+						const glm::vec4& texel = texels[y * irradianceMap.size + x];
+						evaluated.insert(evaluated.end(), {value.r, value.g, value.b});
+						reference.insert(reference.end(), {texel.r, texel.g, texel.b});
+					}
+				}
+			}
+			const IBL::ErrorStats stats = IBL::compare(evaluated.data(), reference.data(), evaluated.size());
+			std::printf("  SH vs irmap: max abs %.6f  rmse %.6f  relative rmse %.4f%%\n", stats.maxAbsolute, stats.rmse, 100.0 * stats.relativeRMSE);
+		}
+
+		if(!options.outputDirectory.empty()) {
+			writeCubemap(specularMap, options.outputDirectory, "spmap");
+			writeCubemap(irradianceMap, options.outputDirectory, "irmap");
+			const std::vector<float> lut = toRGB(brdfLUT);
+			Image::writeHDR(options.outputDirectory + "/spbrdf.hdr", options.brdfLUTSize, options.brdfLUTSize, 3, lut.data());
+		}
+
+		if(!options.compareDirectory.empty()) {
+			std::printf("Comparison against shader output in %s:\n", options.compareDirectory.c_str());
+			compareCubemap(specularMap, options.compareDirectory, "spmap");
+			compareCubemap(irradianceMap, options.compareDirectory, "irmap");
+			reportComparison("spbrdf", toRGB(brdfLUT), options.compareDirectory + "/spbrdf.hdr");
+		}
+	}
+	catch(const std::exception& e) {
+		std::fprintf(stderr, "Error: %s\n", e.what());
+		return 1;
+	}
+}
@@ -0,0 +1,157 @@
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "material.hpp"
+#include "texturecontainer.hpp"
+#include "threading.hpp"
+
+// Converts every 8-bit texture below a directory into a GPU-ready texture container (<image>.ptex) with the
+// same settings PBR-IBL uses, so the renderer only maps and uploads them at startup. Materials with separate
+// roughness and metalness maps are packed into their ORM texture first. Up-to-date containers are kept.
+
+namespace
+{
+	struct Options
+	{
+		std::string directory = "data";
+		Mipmaps::Filter filter = Mipmaps::Filter::Kaiser;
+		bool compress = true;
+	};
+
+	void printUsage()
+	{
+		std::printf(
+			"Usage: PBR-Texture-Convert [options] [directory]\n"
+			"Converts the .png, .jpg, .tga, .bmp and .ppm/.pgm textures below the directory (default data).\n"
+			"Options:\n"
+			"  --filter <box|kaiser|lanczos>  Mipmap filter, as PBR-IBL --texture-mips (default kaiser)\n"
+			"  --no-compression               Store uncompressed levels, as PBR-IBL --texture-compression none\n");
+	}
+
+	Options parseOptions(int argc, char* argv[])
+	{
+		Options options;
+		std::vector<std::string> positional;
+		for(int i=1; i<argc; ++i) {
+			const std::string arg = argv[i];
+			auto value = [&]() -> std::string {
+				if(i + 1 >= argc) {
+					throw std::runtime_error("Missing value for option: " + arg);
+				}
+				return argv[++i];
+			};
+
+			if(arg == "--filter") {
+				const std::string filter = value();
+				if(filter == "box")          options.filter = Mipmaps::Filter::Box;
+				else if(filter == "kaiser")  options.filter = Mipmaps::Filter::Kaiser;
+				else if(filter == "lanczos") options.filter = Mipmaps::Filter::Lanczos;
+				else throw std::runtime_error("Unknown filter: " + filter);
+			}
+			else if(arg == "--no-compression") options.compress = false;
+			else if(arg == "--help") {
+				printUsage();
+				std::exit(0);
+			}
+			else if(arg.compare(0, 2, "--") == 0) {
+				throw std::runtime_error("Unknown option: " + arg);
+			}
+			else {
+				positional.push_back(arg);
+			}
+		}
+
+		if(positional.size() > 1) {
+			printUsage();
+			std::exit(1);
+		}
+		if(!positional.empty()) {
+			options.directory = positional[0];
+		}
+		return options;
+	}
+
+	std::string lowercaseExtension(const std::filesystem::path& path)
+	{
+		std::string extension = path.extension().string();
+		std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+		return extension;
+	}
+
+	std::vector<std::string> findTextures(const std::string& directory)
+	{
+		static const std::set<std::string> Extensions = {".png", ".jpg", ".jpeg", ".tga", ".bmp", ".ppm", ".pgm"};
+
+		std::vector<std::string> textures;
+		for(const auto& entry : std::filesystem::recursive_directory_iterator(directory)) {
+			if(entry.is_regular_file() && Extensions.count(lowercaseExtension(entry.path()))) {
+				textures.push_back(entry.path().generic_string());
+			}
+		}
+		std::sort(textures.begin(), textures.end());
+		return textures;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	try {
+		const Options options = parseOptions(argc, argv);
+		ThreadPool& pool = ThreadPool::instance();
+		std::printf("Texture conversion [%s, %u threads]\n", options.directory.c_str(), pool.concurrency());
+
+		const auto startTime = std::chrono::steady_clock::now();
+
+		// The renderer samples the packed ORM texture, so pack it for every material that only has separate maps.
+		std::set<std::string> materialPrefixes;
+		for(const std::string& texture : findTextures(options.directory)) {
+			const std::string suffix = "Roughness.png";
+			if(texture.size() > suffix.size() && texture.compare(texture.size() - suffix.size(), suffix.size(), suffix) == 0) {
+				materialPrefixes.insert(texture.substr(0, texture.size() - suffix.size()));
+			}
+		}
+		for(const std::string& prefix : materialPrefixes) {
+			Material::packORM(prefix);
+		}
+
+		// Textures convert in parallel; each conversion also spreads its filtering and encoding over the pool.
+		const std::vector<std::string> textures = findTextures(options.directory);
+		std::atomic<size_t> sourceBytes{0}, containerBytes{0};
+		std::mutex failuresMutex;
+		std::vector<std::string> failures;
+		pool.parallelFor(textures.size(), [&](size_t i) {
+			try {
+				const Material::TextureSettings settings = Material::textureSettings(textures[i], options.filter, options.compress);
+				const std::shared_ptr<TextureContainer> container = TextureContainer::loadOrConvert(textures[i], settings.channels, settings.mipmaps);
+				sourceBytes += std::filesystem::file_size(textures[i]);
+				containerBytes += container->size();
+			}
+			catch(const std::exception& e) {
+				std::lock_guard<std::mutex> lock{failuresMutex};
+				failures.push_back(textures[i] + ": " + e.what());
+			}
+		});
+
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		std::printf("Converted %zu textures in %.2f s: %.2f MB of images -> %.2f MB of containers\n", textures.size() - failures.size(),
+					seconds, sourceBytes / 1048576.0, containerBytes / 1048576.0);
+		for(const std::string& failure : failures) {
+			std::fprintf(stderr, "Error: %s\n", failure.c_str());
+		}
+		return failures.empty() ? 0 : 1;
+	}
+	catch(const std::exception& e) {
+		std::fprintf(stderr, "Error: %s\n", e.what());
+		return 1;
+	}
+}